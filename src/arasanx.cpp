@@ -125,7 +125,21 @@ int CDECL main(int argc, char **argv) {
     if (arg < argc) {
         if (strcmp(argv[arg],"bench") == 0) {
             Bench b;
-            Bench::Results res = b.bench(true);
+            if (arg+1 < argc && strcmp(argv[arg+1],"scaling") == 0) {
+                return b.scalingCommand(std::vector<std::string>(argv+arg+2,argv+argc)) ? 0 : -1;
+            }
+            else if (arg+1 < argc && strcmp(argv[arg+1],"rep") == 0) {
+                return Bench::repetitionCommand(std::vector<std::string>(argv+arg+2,argv+argc)) ? 0 : -1;
+            }
+            else if (arg+2 < argc && strcmp(argv[arg+1],"-n") == 0) {
+                uint64_t nodes = 0;
+                if (!Options::setOption<uint64_t>(argv[arg+2],nodes) || nodes == 0) {
+                    std::cerr << "invalid value for -n: " << argv[arg+2] << std::endl;
+                    return -1;
+                }
+                b.setNodeLimit(nodes);
+            }
+            Bench::Results res = b.bench(/*verbose=*/false);
             std::cout << res;
             return 0;
         } else {
@@ -4,9 +4,17 @@
 #include "notation.h"
 #include "search.h"
 #include "chessio.h"
+#include "movegen.h"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <random>
 #include <sstream>
+#include <thread>
 
 static const std::array<std::string,25> epds = {
     "r2q1rk1/pb1nbp1p/1pp1pp2/8/2BPN2P/5N2/PPP1QPP1/2KR3R w - - bm Nfg5; id \"arasan20.112\"; c0 \"Loop M1-P 4CPU-Deep Junior 10.1 4CPU, CEGT Quad 40/120 2007\";",
@@ -36,12 +44,12 @@ static const std::array<std::string,25> epds = {
     "8/8/4b3/4k3/7P/3R1K2/3pr3/8 b - - bm Bg4+; c0 \"Kartunen-Topalov, ECC Open 2015\";"
 };
 
-Bench::Results Bench::bench(int hashSize, int depth, int cores, bool verbose)
+Bench::Results Bench::bench(bool verbose, int depth, int cores)
 {
     auto tmp_hash = globals::options.search.hash_table_size;
     int tmp_cores = globals::options.search.ncpus;
     int tmp_book = globals::options.book.book_enabled;
-    globals::options.search.hash_table_size = hashSize;
+    if (hashSize) globals::options.search.hash_table_size = hashSize;
     globals::options.search.ncpus = std::min<int>(cores,Constants::MaxCPUs);
     globals::options.book.book_enabled = 0;
 
@@ -52,10 +60,115 @@ Bench::Results Bench::bench(int hashSize, int depth, int cores, bool verbose)
     searcher->updateSearchOptions();
     searcher->setThreadCount(globals::options.search.ncpus);
 
+    Results results = runSuite(searcher, depth, verbose);
+    delete searcher;
+    globals::options.search.hash_table_size = tmp_hash;
+    globals::options.search.ncpus = tmp_cores;
+    globals::options.book.book_enabled = tmp_book;
+    return results;
+}
+
+Bench::Results Bench::runSuite(SearchController *searcher, int depth, bool verbose)
+{
     Results results;
+    std::stringstream hashInfo;
+    searcher->hashTable.printAllocation(hashInfo);
+    results.hashInfo = hashInfo.str();
     for (std::string s : epds) {
         benchLine(searcher, s, results, depth, verbose);
     }
+    return results;
+}
+
+Bench::ScalingOptions::ScalingOptions()
+    : maxThreads(std::max<int>(1,std::min<int>(std::thread::hardware_concurrency(),
+                                                Constants::MaxCPUs))),
+      runs(3),
+      depth(13),
+      hashSize(globals::options.search.hash_table_size),
+      nodeLimit(0)
+{
+}
+
+bool Bench::parseScalingOptions(const std::vector<std::string> &args, ScalingOptions &opts)
+{
+    for (auto it = args.begin(); it != args.end(); it++) {
+        const std::string &opt = *it;
+        if (opt != "-t" && opt != "-r" && opt != "-d" && opt != "-n" && opt != "-H" && opt != "-j") {
+            std::cerr << "unrecognized bench option: " << opt << std::endl;
+            return false;
+        }
+        if (++it == args.end()) {
+            std::cerr << "expected value after " << opt << std::endl;
+            return false;
+        }
+        if (opt == "-j") {
+            opts.jsonFile = *it;
+            continue;
+        }
+        if (opt == "-H") {
+            Options::setMemoryOption(opts.hashSize,*it);
+            continue;
+        }
+        if (opt == "-n") {
+            if (!Options::setOption<uint64_t>(*it,opts.nodeLimit) || opts.nodeLimit == 0) {
+                std::cerr << "invalid value for -n: " << *it << std::endl;
+                return false;
+            }
+            continue;
+        }
+        std::stringstream num(*it);
+        int val = 0;
+        num >> val;
+        if (num.fail() || val < 1) {
+            std::cerr << "invalid value for " << opt << ": " << *it << std::endl;
+            return false;
+        }
+        if (opt == "-t") {
+            opts.maxThreads = std::min<int>(val,Constants::MaxCPUs);
+        }
+        else if (opt == "-r") {
+            opts.runs = val;
+        }
+        else {
+            opts.depth = std::min<int>(val,Constants::MaxPly-1);
+        }
+    }
+    return true;
+}
+
+Bench::ScalingResults Bench::scaling(const ScalingOptions &opts, bool verbose)
+{
+    auto tmp_hash = globals::options.search.hash_table_size;
+    int tmp_cores = globals::options.search.ncpus;
+    int tmp_book = globals::options.book.book_enabled;
+    globals::options.search.hash_table_size = opts.hashSize;
+    globals::options.search.ncpus = 1;
+    globals::options.book.book_enabled = 0;
+
+    // ensure TBs and NNUE are initialized
+    globals::delayedInit();
+
+    SearchController *searcher = new SearchController();
+    searcher->updateSearchOptions();
+    nodeLimit = opts.nodeLimit;
+
+    ScalingResults results;
+    for (int threads = 1; ; threads = std::min<int>(2*threads,opts.maxThreads)) {
+        globals::options.search.ncpus = threads;
+        searcher->setThreadCount(threads);
+        results.push_back(ScalingEntry(threads));
+        for (int run = 0; run < opts.runs; run++) {
+            // start each run from the same (empty) hash table state
+            searcher->clearHashTables();
+            results.back().runs.push_back(runSuite(searcher, opts.depth, verbose));
+            if (verbose) {
+                std::cout << "threads=" << threads << " run=" << run+1 << std::endl;
+                std::cout << results.back().runs.back();
+            }
+        }
+        if (threads >= opts.maxThreads) break;
+    }
     delete searcher;
     globals::options.search.hash_table_size = tmp_hash;
     globals::options.search.ncpus = tmp_cores;
@@ -63,6 +176,166 @@ Bench::Results Bench::bench(int hashSize, int depth, int cores, bool verbose)
     return results;
 }
 
+bool Bench::scalingCommand(const std::vector<std::string> &args)
+{
+    ScalingOptions opts;
+    if (!parseScalingOptions(args,opts)) {
+        return false;
+    }
+    ScalingResults results = scaling(opts);
+    printScaling(std::cout,opts,results);
+    if (!opts.jsonFile.empty()) {
+        std::ofstream out(opts.jsonFile,std::ios::out | std::ios::trunc);
+        if (!out.good()) {
+            std::cerr << "failed to open " << opts.jsonFile << " for output" << std::endl;
+            return false;
+        }
+        printScalingJSON(out,opts,results);
+    }
+    return true;
+}
+
+// Summary of the runs at one thread count
+struct ScalingSummary
+{
+    double time, timeSD; // mean and std. deviation of suite time (ms)
+    double nps, npsSD; // mean and std. deviation of nodes per second
+    double npsSpeedup, ttdSpeedup; // relative to the 1st entry
+    double wakeup; // mean helper thread start latency (microseconds)
+};
+
+static void meanAndSD(const std::vector<double> &vals, double &mean, double &sd)
+{
+    mean = sd = 0.0;
+    if (vals.empty()) return;
+    for (double v : vals) mean += v;
+    mean /= vals.size();
+    if (vals.size() < 2) return;
+    for (double v : vals) sd += (v-mean)*(v-mean);
+    sd = std::sqrt(sd/(vals.size()-1));
+}
+
+static std::vector<ScalingSummary> summarize(const Bench::ScalingResults &results)
+{
+    std::vector<ScalingSummary> summaries;
+    for (const Bench::ScalingEntry &entry : results) {
+        std::vector<double> times, nps;
+        uint64_t wakeup = 0ULL, searches = 0ULL;
+        for (const Bench::Results &r : entry.runs) {
+            times.push_back(double(r.time));
+            nps.push_back(r.time ? (1000.0*r.nodes)/r.time : 0.0);
+            wakeup += r.wakeup;
+            searches += r.searches;
+        }
+        ScalingSummary s;
+        s.wakeup = searches ? double(wakeup)/searches : 0.0;
+        meanAndSD(times,s.time,s.timeSD);
+        meanAndSD(nps,s.nps,s.npsSD);
+        if (summaries.empty()) {
+            s.npsSpeedup = s.ttdSpeedup = 1.0;
+        } else {
+            const ScalingSummary &base = summaries[0];
+            s.npsSpeedup = base.nps > 0.0 ? s.nps/base.nps : 0.0;
+            s.ttdSpeedup = s.time > 0.0 ? base.time/s.time : 0.0;
+        }
+        summaries.push_back(s);
+    }
+    return summaries;
+}
+
+void Bench::printScaling(std::ostream &o, const ScalingOptions &opts, const ScalingResults &results)
+{
+    std::vector<ScalingSummary> summaries(summarize(results));
+    std::ios_base::fmtflags original_flags = o.flags();
+    if (opts.nodeLimit) {
+        o << "Nodes\t: " << opts.nodeLimit << std::endl;
+    } else {
+        o << "Depth\t: " << opts.depth << std::endl;
+    }
+    o << "Runs\t: " << opts.runs << std::endl;
+    if (!results.empty() && !results[0].runs.empty()) {
+        o << "Hash\t: " << results[0].runs[0].hashInfo << std::endl;
+    }
+    o << "Threads" << std::setw(12) << "Time" << std::setw(8) << "SD%"
+      << std::setw(12) << "NPS" << std::setw(8) << "SD%"
+      << std::setw(12) << "NPS speedup" << std::setw(12) << "TTD speedup"
+      << std::setw(12) << "Wakeup(us)" << std::endl;
+    o.setf(std::ios::fixed);
+    for (size_t i = 0; i < results.size(); i++) {
+        const ScalingSummary &s = summaries[i];
+        o << std::setw(7) << results[i].threads
+          << std::setprecision(0) << std::setw(12) << s.time
+          << std::setprecision(1) << std::setw(8) << (s.time > 0.0 ? 100.0*s.timeSD/s.time : 0.0)
+          << std::setprecision(0) << std::setw(12) << s.nps
+          << std::setprecision(1) << std::setw(8) << (s.nps > 0.0 ? 100.0*s.npsSD/s.nps : 0.0)
+          << std::setprecision(2) << std::setw(12) << s.npsSpeedup
+          << std::setw(12) << s.ttdSpeedup
+          << std::setprecision(1) << std::setw(12) << s.wakeup << std::endl;
+    }
+    o.flags(original_flags);
+}
+
+static void jsonString(std::ostream &o, const std::string &s)
+{
+    o << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            o << '\\' << c;
+        }
+        else if (c >= 0 && c < ' ') {
+            o << ' ';
+        }
+        else {
+            o << c;
+        }
+    }
+    o << '"';
+}
+
+void Bench::printScalingJSON(std::ostream &o, const ScalingOptions &opts, const ScalingResults &results)
+{
+    std::vector<ScalingSummary> summaries(summarize(results));
+    std::ios_base::fmtflags original_flags = o.flags();
+    o.setf(std::ios::fixed);
+    o << std::setprecision(3);
+    o << "{" << std::endl;
+    o << "  \"positions\": " << epds.size() << "," << std::endl;
+    if (opts.nodeLimit) {
+        o << "  \"nodes_per_position\": " << opts.nodeLimit << "," << std::endl;
+    } else {
+        o << "  \"depth\": " << opts.depth << "," << std::endl;
+    }
+    o << "  \"runs\": " << opts.runs << "," << std::endl;
+    o << "  \"hash\": ";
+    jsonString(o, (results.empty() || results[0].runs.empty()) ? "" : results[0].runs[0].hashInfo);
+    o << "," << std::endl;
+    o << "  \"results\": [" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const ScalingEntry &entry = results[i];
+        const ScalingSummary &s = summaries[i];
+        o << "    {\"threads\": " << entry.threads << ", \"time_ms\": [";
+        for (size_t j = 0; j < entry.runs.size(); j++) {
+            if (j) o << ", ";
+            o << entry.runs[j].time;
+        }
+        o << "], \"nodes\": [";
+        for (size_t j = 0; j < entry.runs.size(); j++) {
+            if (j) o << ", ";
+            o << entry.runs[j].nodes;
+        }
+        o << "]," << std::endl;
+        o << "     \"mean_time_ms\": " << s.time << ", \"sd_time_ms\": " << s.timeSD
+          << ", \"mean_nps\": " << s.nps << ", \"sd_nps\": " << s.npsSD << "," << std::endl;
+        o << "     \"nps_speedup\": " << s.npsSpeedup << ", \"ttd_speedup\": " << s.ttdSpeedup
+          << ", \"mean_wakeup_us\": " << s.wakeup << "}";
+        if (i+1 < results.size()) o << ",";
+        o << std::endl;
+    }
+    o << "  ]" << std::endl;
+    o << "}" << std::endl;
+    o.flags(original_flags);
+}
+
 void Bench::benchLine(SearchController *searcher, const std::string &epd, Bench::Results &results, int depthLimit, bool verbose)
 {
     std::stringstream stream(epd);
@@ -91,9 +364,11 @@ void Bench::benchLine(SearchController *searcher, const std::string &epd, Bench:
 
         Statistics stats;
         MoveSet includes, excludes;
+        searcher->setNodeLimit(nodeLimit);
         Move result = searcher->findBestMove(board,
-                                             FixedDepth,
-                                             999999, 0, depthLimit,
+                                             nodeLimit ? FixedNodes : FixedDepth,
+                                             999999, 0,
+                                             nodeLimit ? Constants::MaxPly : depthLimit,
                                              0, 0, stats,
                                              verbose ? TalkLevel::Test : TalkLevel::Silent,
                                              excludes, includes);
@@ -106,7 +381,111 @@ void Bench::benchLine(SearchController *searcher, const std::string &epd, Bench:
         }
         results.nodes += stats.num_nodes;
         results.time += searcher->getElapsedTime();
+        results.wakeup += searcher->getHelperStartLatency();
+        ++results.searches;
+    }
+}
+
+bool Bench::parseRepetitionOptions(const std::vector<std::string> &args, RepetitionOptions &opts)
+{
+    for (auto it = args.begin(); it != args.end(); it++) {
+        const std::string &opt = *it;
+        if (opt == "-p" || opt == "-c") {
+            if (++it == args.end()) {
+                std::cerr << "expected value after " << opt << std::endl;
+                return false;
+            }
+            std::stringstream num(*it);
+            int val = 0;
+            num >> val;
+            if (num.fail() || val < 1) {
+                std::cerr << "invalid value for " << opt << ": " << *it << std::endl;
+                return false;
+            }
+            if (opt == "-p") {
+                opts.plies = std::min<int>(val,1000);
+            }
+            else {
+                opts.calls = val;
+            }
+        }
+        else if (opts.epdFile.empty()) {
+            opts.epdFile = opt;
+        }
+        else {
+            std::cerr << "unrecognized bench option: " << opt << std::endl;
+            return false;
+        }
+    }
+    if (opts.epdFile.empty()) {
+        std::cerr << "usage: bench rep <epd file> [-p plies] [-c checks per ply]" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Bench::repetitionCommand(const std::vector<std::string> &args)
+{
+    RepetitionOptions opts;
+    if (!parseRepetitionOptions(args,opts)) {
+        return false;
+    }
+    std::ifstream in(opts.epdFile);
+    if (!in.good()) {
+        std::cerr << "failed to open " << opts.epdFile << std::endl;
+        return false;
+    }
+    // fixed seed, so runs are comparable
+    std::mt19937 rng(1234);
+    uint64_t positions = 0, plies = 0, checks = 0, reps = 0;
+    std::chrono::nanoseconds elapsed(0);
+    Board board;
+    EPDRecord epd_rec;
+    while (!in.eof()) {
+        if (!ChessIO::readEPDRecord(in,board,epd_rec)) break;
+        if (epd_rec.hasError()) continue;
+        ++positions;
+        for (int ply = 0; ply < opts.plies; ply++) {
+            // choose among the legal non-pawn, non-capture moves
+            Move moves[Constants::MaxMoves];
+            MoveGenerator mg(board);
+            const unsigned n = mg.generateAllMoves(moves,0);
+            std::vector<Move> reversible;
+            const bool inCheck = board.checkStatus() == InCheck;
+            const BoardState state(board.state);
+            for (unsigned i = 0; i < n; i++) {
+                if (Capture(moves[i]) != Empty || PieceMoved(moves[i]) == Pawn ||
+                    TypeOfMove(moves[i]) == KCastle || TypeOfMove(moves[i]) == QCastle) {
+                    continue;
+                }
+                board.doMove(moves[i]);
+                if (board.wasLegal(moves[i],inCheck)) {
+                    reversible.push_back(moves[i]);
+                }
+                board.undoMove(moves[i],state);
+            }
+            if (reversible.empty()) break;
+            board.doMove(reversible[rng() % reversible.size()]);
+            ++plies;
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < opts.calls; i++) {
+                // same target as Scoring::isDraw
+                const int target = (i % 8 < 2) ? 2 : 1;
+                reps += board.repCount(target) >= target;
+            }
+            elapsed += std::chrono::steady_clock::now() - start;
+            checks += opts.calls;
+        }
     }
+    std::cout << "Positions\t: " << positions << std::endl;
+    std::cout << "Plies\t: " << plies << std::endl;
+    std::cout << "Checks\t: " << checks << std::endl;
+    std::cout << "Repeated\t: " << std::fixed << std::setprecision(1)
+              << (checks ? 100.0*reps/checks : 0.0) << "%" << std::endl;
+    std::cout << "Time\t: " << elapsed.count()/1000000 << " ms" << std::endl;
+    std::cout << "Per check\t: " << std::setprecision(2)
+              << (checks ? double(elapsed.count())/checks : 0.0) << " ns" << std::endl;
+    return true;
 }
 
 std::ostream & operator << (std::ostream &o, const Bench::Results &results)
@@ -114,5 +493,6 @@ std::ostream & operator << (std::ostream &o, const Bench::Results &results)
     o << "Time\t: " << results.time << std::endl;
     o << "Nodes\t: " << results.nodes << std::endl;
     o << "NPS\t: "  << 1000*results.nodes/results.time << std::endl;
+    o << "Hash\t: " << results.hashInfo << std::endl;
     return o;
 }
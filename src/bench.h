@@ -6,6 +6,7 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 class SearchController;
 
@@ -18,14 +19,97 @@ public:
     {
         uint64_t nodes;
         uint64_t time;
-        Results() : nodes(0ULL), time(0ULL) {};
+        uint64_t wakeup; // total helper thread start latency (microseconds)
+        unsigned searches;
+        std::string hashInfo; // hash size and page type
+        Results() : nodes(0ULL), time(0ULL), wakeup(0ULL), searches(0) {};
     };
 
-    Results bench(int hashSize=1000, int depth=13, int cores=1, bool verbose=false);
+    // Fixed hash table size for bench, so that the node count does
+    // not depend on the configured size.
+    static constexpr size_t DEFAULT_HASH_SIZE = 32*1024*1024;
+
+    // Search the bench positions, with the hash table size set by
+    // setHashSize (DEFAULT_HASH_SIZE if not set).
+    Results bench(bool verbose=false, int depth=13, int cores=1);
+
+    // Hash table size in bytes, or 0 for the configured size.
+    void setHashSize(size_t bytes) {
+        hashSize = bytes;
+    }
+
+    // If non-zero, search each position to a fixed node count
+    // rather than a fixed depth.
+    void setNodeLimit(uint64_t nodes) {
+        nodeLimit = nodes;
+    }
 
     friend std::ostream & operator << (std::ostream &o, const Results &results);
 
+    // Options for the SMP scaling benchmark ("bench scaling")
+    struct ScalingOptions
+    {
+        int maxThreads; // thread counts are 1, 2, 4 .. maxThreads
+        int runs; // repetitions of the suite per thread count
+        int depth;
+        size_t hashSize;
+        uint64_t nodeLimit; // if non-zero, search fixed nodes, not depth
+        std::string jsonFile; // if non-empty, JSON output goes here
+        ScalingOptions();
+    };
+
+    // Results of all runs at one thread count
+    struct ScalingEntry
+    {
+        int threads;
+        std::vector<Results> runs;
+        ScalingEntry(int n) : threads(n) {}
+    };
+
+    using ScalingResults = std::vector<ScalingEntry>;
+
+    // Parse options following "bench scaling". Returns false and
+    // outputs a message to std::cerr on error.
+    static bool parseScalingOptions(const std::vector<std::string> &args, ScalingOptions &opts);
+
+    // Run the bench suite over a range of thread counts
+    ScalingResults scaling(const ScalingOptions &opts, bool verbose=false);
+
+    // Output a summary of scaling results, as text
+    static void printScaling(std::ostream &o, const ScalingOptions &opts, const ScalingResults &results);
+
+    // Parse options, run the scaling benchmark and output results,
+    // for the "bench scaling" command. Returns false on error.
+    bool scalingCommand(const std::vector<std::string> &args);
+
+    // Output scaling results as JSON
+    static void printScalingJSON(std::ostream &o, const ScalingOptions &opts, const ScalingResults &results);
+
+    // Options for the repetition detection benchmark ("bench rep")
+    struct RepetitionOptions
+    {
+        std::string epdFile; // positions to start from
+        int plies; // reversible moves played from each position
+        int calls; // repetition checks per ply
+        RepetitionOptions() : plies(100), calls(100) {}
+    };
+
+    // Parse options following "bench rep". Returns false and
+    // outputs a message to std::cerr on error.
+    static bool parseRepetitionOptions(const std::vector<std::string> &args, RepetitionOptions &opts);
+
+    // Time repetition detection: from each EPD position, play a
+    // random sequence of reversible moves and check for repetitions
+    // after each one. Runs the "bench rep" command. Returns false on
+    // error.
+    static bool repetitionCommand(const std::vector<std::string> &args);
+
 private:
+    uint64_t nodeLimit = 0;
+    size_t hashSize = DEFAULT_HASH_SIZE;
+
+    Results runSuite(SearchController *searcher, int depth, bool verbose);
+
     void benchLine(SearchController *searcher, const std::string &epd, Results &results, int depthLimit, bool verbose);
 };
 
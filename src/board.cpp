@@ -36,7 +36,7 @@ const hash_t rep_codes[3] =
 static Board *initialBoard = nullptr;
 
 void Board::setupInitialBoard() {
-   initialBoard = (Board*)malloc(sizeof(Board));
+   initialBoard = new Board(NoInit());
    static PieceType pieces[] =
    {
       Rook,
@@ -69,9 +69,8 @@ void Board::setupInitialBoard() {
    initialBoard->state.castleStatus[White] = initialBoard->state.castleStatus[Black] = CanCastleEitherSide;
    initialBoard->state.moveCount = 0;
    initialBoard->state.movesFromNull = 0;
-   initialBoard->repListHead = initialBoard->repList;
    initialBoard->setSecondaryVars();
-   *(initialBoard->repListHead)++ = initialBoard->hashCode();
+   initialBoard->clearHistory();
 }
 
 void Board::init() {
@@ -81,7 +80,8 @@ void Board::init() {
 }
 
 void Board::cleanup() {
-   free(reinterpret_cast<void*>(initialBoard));
+   delete initialBoard;
+   initialBoard = nullptr;
 }
 
 void Board::setSecondaryVars()
@@ -140,6 +140,7 @@ void Board::setSecondaryVars()
          }
       }
    }
+   attackInfo = 0;
    state.hashCode = BoardHash::hashCode(*this);
    pawnHashCodeW = BoardHash::pawnHash(*this,White);
    pawnHashCodeB = BoardHash::pawnHash(*this,Black);
@@ -177,12 +178,13 @@ Board::Board()
 }
 
 Board::Board(const Board &b)
+   : repPrefix(b.repPrefix), repPrefixLen(b.repPrefixLen)
 {
    // Copy all contents except the repetition list
    memcpy(&contents,&b.contents,(uint8_t*)repList-(uint8_t*)&contents);
-   // Copy the repetition table
+   // Copy the unshared part of the repetition list
    int rep_entries = (int)(b.repListHead - b.repList);
-   assert(rep_entries>=0 && rep_entries<RepListSize);
+   assert(rep_entries>=0 && rep_entries<=RepListSize);
    if (rep_entries) {
      memcpy(repList,b.repList,sizeof(hash_t)*rep_entries);
    }
@@ -195,12 +197,14 @@ Board &Board::operator = (const Board &b)
    {
       // Copy all contents except the repetition list
       memcpy(&contents,&b.contents,(uint8_t*)repList-(uint8_t*)&contents);
-      // Copy the repetition table
+      // Copy the unshared part of the repetition list
       int rep_entries = (int)(b.repListHead - b.repList);
       if (rep_entries) {
           memcpy(repList,b.repList,sizeof(hash_t)*rep_entries);
       }
       repListHead = repList + rep_entries;
+      repPrefix = b.repPrefix;
+      repPrefixLen = b.repPrefixLen;
    }
    return *this;
 }
@@ -209,6 +213,56 @@ Board::~Board()
 {
 }
 
+void Board::shareHistory()
+{
+   const int rep_entries = (int)(repListHead - repList);
+   if (rep_entries == 0) return;
+   auto history = std::make_shared<std::vector<hash_t>>();
+   history->reserve(repPrefixLen + rep_entries);
+   if (repPrefix) {
+      history->assign(repPrefix->begin(),repPrefix->begin()+repPrefixLen);
+   }
+   history->insert(history->end(),repList,repListHead);
+   repPrefixLen = history->size();
+   repPrefix = std::move(history);
+   repListHead = repList;
+   rebuildRepFilter();
+}
+
+void Board::popSharedHistory()
+{
+   // Undoing a move made before the history was shared (rare).
+   assert(repPrefix && repPrefixLen > 0);
+   if (--repPrefixLen == 0) {
+      repPrefix.reset();
+   }
+   // The filter may not count the positions now in reach.
+   rebuildRepFilter();
+}
+
+void Board::rebuildRepFilter()
+{
+   assert(repListHead == repList);
+   std::fill(repFilter,repFilter+RepFilterSize,0);
+   if (!repPrefix) return;
+   // Positions before the last irreversible move (or null move)
+   // cannot repeat here or in any position reached from here.
+   int entries = std::min<int>(state.movesFromNull,state.moveCount) + 1;
+   for (size_t i = repPrefixLen; i > 0 && entries > 0; --i, --entries) {
+      uint8_t &count = repFilter[repFilterIndex((*repPrefix)[i-1])];
+      if (count != RepFilterMax) ++count;
+   }
+}
+
+void Board::clearHistory()
+{
+   repPrefix.reset();
+   repPrefixLen = 0;
+   repListHead = repList;
+   rebuildRepFilter();
+   pushHistory(hashCode());
+}
+
 #ifdef _DEBUG
 const Piece &Board::operator[]( const Square sq ) const
 {
@@ -265,9 +319,437 @@ static FORCEINLINE void Xor(hash_t &h,Square sq,Piece piece) {
    h ^= hash_codes[sq][(int)piece];
 }
 
+template <ColorType side>
+static FORCEINLINE hash_t castleCode(CastleType cs) {
+   return side == White ? w_castle_status[(int)cs] : b_castle_status[(int)cs];
+}
+
+template <ColorType side>
+static FORCEINLINE CastleType UpdateCastleStatus(CastleType cs, Square sq) {
+   return side == White ? UpdateCastleStatusW(cs,sq) : UpdateCastleStatusB(cs,sq);
+}
+
+template <ColorType side>
+FORCEINLINE void Board::movePiece(PieceType piece, Bitboard &bits, Square start, Square dest)
+{
+   const Piece p = MakePiece<side>(piece);
+   Xor(state.hashCode, start, p);
+   Xor(state.hashCode, dest, p);
+   contents[dest] = p;
+   bits.setClear(Bitboard::mask[start] | Bitboard::mask[dest]);
+}
+
+template <ColorType side>
+void Board::makeMove(Move move, Square old_epsq)
+{
+   constexpr ColorType oside = side == White ? Black : White;
+   hash_t &ourPawnHash = side == White ? pawnHashCodeW : pawnHashCodeB;
+   hash_t &oppPawnHash = side == White ? pawnHashCodeB : pawnHashCodeW;
+   const Square start = StartSquare(move);
+   const Square dest = DestSquare(move);
+   const MoveType moveType = TypeOfMove(move);
+   if (moveType == KCastle || moveType == QCastle)
+   {
+      state.moveCount = 0;
+      const Square kp = kingSquare(side);
+      const Square newkp = moveType == KCastle ? kp + 2 : kp - 2;
+      // old and new squares of rook
+      const Square oldrooksq = moveType == KCastle ? kp + 3 : kp - 4;
+      const Square newrooksq = moveType == KCastle ? kp + 1 : kp - 1;
+
+      // update the hash code
+      Xor(state.hashCode, oldrooksq, MakePiece<side>(Rook));
+      Xor(state.hashCode, kp, MakePiece<side>(King));
+      Xor(state.hashCode, newrooksq, MakePiece<side>(Rook));
+      Xor(state.hashCode, newkp, MakePiece<side>(King));
+      state.hashCode ^= castleCode<side>(state.castleStatus[side]);
+      state.hashCode ^= castleCode<side>(CantCastleEitherSide);
+
+      kingPos[side] = newkp;
+      state.castleStatus[side] = CantCastleEitherSide;
+      contents[kp] = contents[oldrooksq] = EmptyPiece;
+      contents[newrooksq] = MakePiece<side>(Rook);
+      contents[newkp] = MakePiece<side>(King);
+      rook_bits[side].clear(oldrooksq);
+      rook_bits[side].set(newrooksq);
+      clearAll(side,kp);
+      clearAll(side,oldrooksq);
+      setAll(side,newkp);
+      setAll(side,newrooksq);
+      return;
+   }
+   assert(contents[start] != EmptyPiece);
+   Square target = dest; // where we captured
+   Piece capture = contents[dest]; // what we captured
+   switch (TypeOfPiece(contents[start])) {
+   case Empty: break;
+   case Pawn:
+   {
+      constexpr Piece ourPawn = MakePiece<side>(Pawn);
+      state.moveCount = 0;
+      switch (moveType)
+      {
+      case EnPassant:
+         // update hash code
+         Xor(state.hashCode, start, ourPawn);
+         Xor(state.hashCode, dest, ourPawn);
+         Xor(ourPawnHash, start, ourPawn);
+         Xor(ourPawnHash, dest, ourPawn);
+         assert(dest - 8*Direction[side] == old_epsq);
+         target = old_epsq;
+         capture = MakePiece<oside>(Pawn);
+         contents[dest] = ourPawn;
+         pawn_bits[side].set(dest);
+         break;
+      case Promotion:
+         // update hash code
+         Xor(state.hashCode, start, ourPawn);
+         Xor(state.hashCode, dest, MakePiece<side>(PromoteTo(move)));
+         Xor(ourPawnHash, start, ourPawn);
+         contents[dest] = MakePiece<side>(PromoteTo(move));
+         material[side].removePawn();
+         material[side].addPiece(PromoteTo(move));
+         switch (PromoteTo(move))
+         {
+         case Knight:
+            knight_bits[side].set(dest);
+            break;
+         case Bishop:
+            bishop_bits[side].set(dest);
+            break;
+         case Rook:
+            rook_bits[side].set(dest);
+            break;
+         case Queen:
+            queen_bits[side].set(dest);
+            break;
+         default:
+            break;
+         }
+         break;
+      default:
+         Xor(state.hashCode, start, ourPawn);
+         Xor(state.hashCode, dest, ourPawn);
+         Xor(ourPawnHash, start, ourPawn);
+         Xor(ourPawnHash, dest, ourPawn);
+         contents[dest] = ourPawn;
+         if ((side == White ? dest - start : start - dest) == 16) // 2-square pawn advance
+         {
+            if (TEST_MASK(Attacks::ep_mask[File(dest)-1][(int)side],pawn_bits[oside])) {
+               state.enPassantSq = dest;
+               state.hashCode ^= ep_codes[0];
+               state.hashCode ^= ep_codes[dest];
+            }
+         }
+         pawn_bits[side].set(dest);
+         break;
+      }
+      pawn_bits[side].clear(start);
+      break;
+   }
+   case Knight:
+      movePiece<side>(Knight,knight_bits[side],start,dest);
+      break;
+   case Bishop:
+      movePiece<side>(Bishop,bishop_bits[side],start,dest);
+      break;
+   case Rook:
+      movePiece<side>(Rook,rook_bits[side],start,dest);
+      if ((int)state.castleStatus[side]<3) {
+         state.hashCode ^= castleCode<side>(state.castleStatus[side]);
+         state.castleStatus[side] = UpdateCastleStatus<side>(state.castleStatus[side],start);
+         state.hashCode ^= castleCode<side>(state.castleStatus[side]);
+      }
+      break;
+   case Queen:
+      movePiece<side>(Queen,queen_bits[side],start,dest);
+      break;
+   case King:
+      Xor(state.hashCode, start, MakePiece<side>(King));
+      Xor(state.hashCode, dest, MakePiece<side>(King));
+      contents[dest] = MakePiece<side>(King);
+      kingPos[side] = dest;
+      state.hashCode ^= castleCode<side>(castleStatus(side));
+      state.hashCode ^= castleCode<side>(CantCastleEitherSide);
+      state.castleStatus[side] = CantCastleEitherSide;
+      break;
+   }
+   contents[start] = EmptyPiece;
+   if (capture != EmptyPiece)
+   {
+      state.moveCount = 0;
+      assert(OnBoard(target));
+      occupied[oside].clear(target);
+      Xor(state.hashCode, target, capture);
+      switch (TypeOfPiece(capture))
+      {
+      case Empty: break;
+      case Pawn:
+         assert(pawn_bits[oside].isSet(target));
+         pawn_bits[oside].clear(target);
+         Xor(oppPawnHash, target, capture);
+         if (moveType == EnPassant)
+         {
+            contents[target] = EmptyPiece;
+            clearAll(oside,target);
+         }
+         material[oside].removePawn();
+         break;
+      case Rook:
+         rook_bits[oside].clear(target);
+         material[oside].removePiece(Rook);
+         if ((int)state.castleStatus[oside]<3) {
+            state.hashCode ^= castleCode<oside>(state.castleStatus[oside]);
+            state.castleStatus[oside] = UpdateCastleStatus<oside>(state.castleStatus[oside],dest);
+            state.hashCode ^= castleCode<oside>(state.castleStatus[oside]);
+         }
+         break;
+      case Knight:
+         knight_bits[oside].clear(target);
+         material[oside].removePiece(Knight);
+         break;
+      case Bishop:
+         bishop_bits[oside].clear(target);
+         material[oside].removePiece(Bishop);
+         break;
+      case Queen:
+         queen_bits[oside].clear(target);
+         material[oside].removePiece(Queen);
+         break;
+      case King:
+         assert(0);
+         kingPos[oside] = InvalidSquare;
+         state.castleStatus[oside] = CantCastleEitherSide;
+         material[oside].removePiece(King);
+         break;
+      default:
+         break;
+      }
+   }
+   setAll(side,dest);
+   clearAll(side,start);
+}
+
+template <ColorType side>
+hash_t Board::hashCodeAfter(Move move, hash_t newHash) const
+{
+   constexpr ColorType oside = side == White ? Black : White;
+   const Square start = StartSquare(move);
+   const Square dest = DestSquare(move);
+   const MoveType moveType = TypeOfMove(move);
+   if (moveType == KCastle || moveType == QCastle)
+   {
+      const Square kp = kingSquare(side);
+      Xor(newHash, moveType == KCastle ? kp+3 : kp-4, MakePiece<side>(Rook));
+      Xor(newHash, kp, MakePiece<side>(King));
+      Xor(newHash, moveType == KCastle ? kp+1 : kp-1, MakePiece<side>(Rook));
+      Xor(newHash, moveType == KCastle ? kp+2 : kp-2, MakePiece<side>(King));
+      newHash ^= castleCode<side>(state.castleStatus[side]);
+      newHash ^= castleCode<side>(CantCastleEitherSide);
+      return newHash;
+   }
+   Square target = dest; // where we captured
+   switch (PieceMoved(move))
+   {
+   case Empty: break;
+   case Pawn:
+      Xor(newHash, start, MakePiece<side>(Pawn));
+      switch (moveType)
+      {
+      case EnPassant:
+         Xor(newHash, dest, MakePiece<side>(Pawn));
+         target = state.enPassantSq;
+         break;
+      case Promotion:
+         Xor(newHash, dest, MakePiece<side>(PromoteTo(move)));
+         break;
+      default:
+         Xor(newHash, dest, MakePiece<side>(Pawn));
+         if ((side == White ? dest - start : start - dest) == 16) // 2-square pawn advance
+         {
+            if (TEST_MASK(Attacks::ep_mask[File(dest)-1][(int)side],pawn_bits[oside])) {
+               newHash ^= ep_codes[0];
+               newHash ^= ep_codes[dest];
+            }
+         }
+         break;
+      }
+      break;
+   case Knight:
+      Xor(newHash, start, MakePiece<side>(Knight));
+      Xor(newHash, dest, MakePiece<side>(Knight));
+      break;
+   case Bishop:
+      Xor(newHash, start, MakePiece<side>(Bishop));
+      Xor(newHash, dest, MakePiece<side>(Bishop));
+      break;
+   case Rook:
+      Xor(newHash, start, MakePiece<side>(Rook));
+      Xor(newHash, dest, MakePiece<side>(Rook));
+      if ((int)state.castleStatus[side]<3) {
+         newHash ^= castleCode<side>(state.castleStatus[side]);
+         newHash ^= castleCode<side>(UpdateCastleStatus<side>(state.castleStatus[side],start));
+      }
+      break;
+   case Queen:
+      Xor(newHash, start, MakePiece<side>(Queen));
+      Xor(newHash, dest, MakePiece<side>(Queen));
+      break;
+   case King:
+      Xor(newHash, start, MakePiece<side>(King));
+      Xor(newHash, dest, MakePiece<side>(King));
+      newHash ^= castleCode<side>(castleStatus(side));
+      newHash ^= castleCode<side>(CantCastleEitherSide);
+      break;
+   }
+   if (Capture(move) != Empty)
+   {
+      assert(OnBoard(target));
+      Xor(newHash, target, MakePiece<oside>(Capture(move)));
+      if (Capture(move) == Rook) {
+         if ((int)state.castleStatus[oside]<3) {
+            newHash ^= castleCode<oside>(state.castleStatus[oside]);
+            newHash ^= castleCode<oside>(UpdateCastleStatus<oside>(state.castleStatus[oside],dest));
+         }
+      }
+   }
+   return newHash;
+}
+
+template <ColorType side>
+void Board::unmakeMove(Move move)
+{
+   constexpr ColorType oside = side == White ? Black : White;
+   const Square start = StartSquare(move);
+   const Square dest = DestSquare(move);
+   const MoveType moveType = TypeOfMove(move);
+   const Bitboard bits(Bitboard::mask[start] |
+                       Bitboard::mask[dest]);
+   Square target = dest;
+   // fix up start square:
+   if (moveType == Promotion || moveType == EnPassant)
+   {
+      contents[start] = MakePiece<side>(Pawn);
+   }
+   else
+   {
+      contents[start] = contents[dest];
+   }
+   setAll(side,start);
+   switch (PieceMoved(move)) {
+   case Empty: break;
+   case Pawn:
+   {
+      hash_t &ourPawnHash = side == White ? pawnHashCodeW : pawnHashCodeB;
+      Xor(ourPawnHash,start,MakePiece<side>(Pawn));
+      switch (moveType) {
+      case Promotion:
+         material[side].addPawn();
+         material[side].removePiece(PromoteTo(move));
+         switch (PromoteTo(move))
+         {
+         case Knight:
+            knight_bits[side].clear(dest);
+            break;
+         case Bishop:
+            bishop_bits[side].clear(dest);
+            break;
+         case Rook:
+            rook_bits[side].clear(dest);
+            break;
+         case Queen:
+            queen_bits[side].clear(dest);
+            break;
+         default:
+            break;
+         }
+         break;
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#endif
+      case EnPassant:
+         target = dest - 8*Direction[side];
+         assert(OnBoard(target));
+         assert(contents[target]==EmptyPiece);
+         // note: falls through to normal case
+      case Normal:
+         pawn_bits[side].clear(dest);
+         Xor(ourPawnHash,dest,MakePiece<side>(Pawn));
+         break;
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+      default:
+         break;
+      }
+      pawn_bits[side].set(start);
+      break;
+   }
+   case Knight:
+      knight_bits[side].setClear(bits);
+      break;
+   case Bishop:
+      bishop_bits[side].setClear(bits);
+      break;
+   case Rook:
+      rook_bits[side].setClear(bits);
+      break;
+   case Queen:
+      queen_bits[side].setClear(bits);
+      break;
+   case King:
+      kingPos[side] = start;
+      break;
+   default:
+      break;
+   }
+   // fix up dest square
+   clearAll(side,dest);
+   contents[dest] = EmptyPiece;
+   contents[target] = MakePiece<oside>(Capture(move));
+   if (Capture(move) != Empty)
+   {
+      switch (Capture(move))
+      {
+      case Pawn:
+         assert(!pawn_bits[oside].isSet(target));
+         pawn_bits[oside].set(target);
+         Xor(side == White ? pawnHashCodeB : pawnHashCodeW,target,MakePiece<oside>(Pawn));
+         material[oside].addPawn();
+         break;
+      case Knight:
+         knight_bits[oside].set(target);
+         material[oside].addPiece(Knight);
+         break;
+      case Bishop:
+         bishop_bits[oside].set(target);
+         material[oside].addPiece(Bishop);
+         break;
+      case Rook:
+         rook_bits[oside].set(target);
+         material[oside].addPiece(Rook);
+         break;
+      case Queen:
+         queen_bits[oside].set(target);
+         material[oside].addPiece(Queen);
+         break;
+      case King:
+         kingPos[oside] = target;
+         material[oside].addPiece(King);
+         break;
+      default:
+         break;
+      }
+      setAll(oside,target);
+   }
+}
+
+
 void Board::doNull(NodeInfo *node)
 {
    state.checkStatus = CheckUnknown;
+   attackInfo = 0;
    // We can't reset the halfmove counter because we might overwrite
    // existing entries in the repList then. But we keep separate
    // track of how far we are from a null move (idea from Stockfish).
@@ -280,14 +762,13 @@ void Board::doNull(NodeInfo *node)
    state.enPassantSq = InvalidSquare;
    side = oppositeSide();
    state.hashCode = BoardHash::setSideToMove(state.hashCode,side);
-   *repListHead++ = state.hashCode;
+   pushHistory(state.hashCode);
 #ifdef NNUE
    if (node) {
       (node+1)->dirty_num = 0;
-      (node+1)->accum.setState(nnue::AccumulatorState::Empty);
+      (node+1)->accum->setState(nnue::AccumulatorState::Empty);
    }
 #endif
-   assert(repListHead-repList < (int)RepListSize);
    assert(state.hashCode == BoardHash::hashCode(*this));
 }
 
@@ -296,12 +777,17 @@ void Board::doMove( Move move, [[maybe_unused]] NodeInfo *node )
    assert(!IsNull(move));
    assert(state.hashCode == BoardHash::hashCode(*this));
    state.checkStatus = CheckUnknown;
+   attackInfo = 0;
    ++state.moveCount;
    ++state.movesFromNull;
 #ifdef NNUE
    if (node) {
-       (node+1)->dirty_num = 0;
-       (node+1)->accum.setState(nnue::AccumulatorState::Empty);
+       // The changes for an incremental NNUE update are computed
+       // from the move only if the next node is evaluated (see
+       // ChessInterface).
+       (node+1)->dirty_move = move;
+       (node+1)->dirty_num = DirtyState::Pending + side;
+       (node+1)->accum->setState(nnue::AccumulatorState::Empty);
    }
 #endif
    if (state.enPassantSq != InvalidSquare)
@@ -314,9 +800,8 @@ void Board::doMove( Move move, [[maybe_unused]] NodeInfo *node )
 
    assert(PieceMoved(move) != Empty);
 
-   const Square start = StartSquare(move);
-   const Square dest = DestSquare(move);
-   const MoveType moveType = TypeOfMove(move);
+   [[maybe_unused]] const Square start = StartSquare(move);
+   [[maybe_unused]] const Square dest = DestSquare(move);
    assert(PieceMoved(move) == TypeOfPiece(contents[start]));
 #ifdef _DEBUG
    if (Capture(move) != Empty) {
@@ -328,551 +813,13 @@ void Board::doMove( Move move, [[maybe_unused]] NodeInfo *node )
    }
 #endif
    if (side == White)
-   {
-      if (moveType == KCastle)
-      {
-         state.moveCount = 0;
-
-         // update the hash code
-         const Square kp = kingSquare(White);
-         Xor(state.hashCode, kp+3, WhiteRook);
-         Xor(state.hashCode, kp, WhiteKing);
-         Xor(state.hashCode, kp+1, WhiteRook);
-         Xor(state.hashCode, kp+2, WhiteKing);
-         state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-         state.hashCode ^= w_castle_status[(int)CantCastleEitherSide];
-
-         const int newkp = kp + 2;
-         kingPos[White] = newkp;
-         state.castleStatus[White] = CantCastleEitherSide;
-         // find old square of rook
-         Square oldrooksq = kp + 3;
-         Square newrooksq = kp + 1;
-         contents[kp] = contents[oldrooksq] = EmptyPiece;
-         contents[newrooksq] = WhiteRook;
-         contents[newkp] = WhiteKing;
-         rook_bits[White].clear(oldrooksq);
-         rook_bits[White].set(newrooksq);
-         clearAll(White,kp);
-         clearAll(White,oldrooksq);
-         setAll(White,newkp);
-         setAll(White,newrooksq);
-#ifdef NNUE
-         if (node) {
-             (node+1)->dirty_num = 2;
-             (node+1)->dirty[0] = DirtyState(static_cast<nnue::Square>(kp),
-                                             static_cast<nnue::Square>(newkp),
-                                             nnue::WhiteKing);
-             (node+1)->dirty[1] = DirtyState(static_cast<nnue::Square>(oldrooksq),
-                                             static_cast<nnue::Square>(newrooksq),
-                                             nnue::WhiteRook);
-         }
-#endif
-      }
-      else if (moveType == QCastle)
-      {
-         state.moveCount = 0;
-
-         // update the hash code
-         const Square kp = kingSquare(White);
-         Xor(state.hashCode, kp-4, WhiteRook);
-         Xor(state.hashCode, kp, WhiteKing);
-         Xor(state.hashCode, kp-1, WhiteRook);
-         Xor(state.hashCode, kp-2, WhiteKing);
-         state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-         state.hashCode ^= w_castle_status[(int)CantCastleEitherSide];
-
-         const int newkp = kp - 2;
-         kingPos[White] = newkp;
-         state.castleStatus[White] = CantCastleEitherSide;
-         // find old square of rook
-         Square oldrooksq = kp - 4;
-         Square newrooksq = kp - 1;
-         contents[kp] = contents[oldrooksq] = Piece();
-         contents[newrooksq] = WhiteRook;
-         contents[kp-2] = WhiteKing;
-         rook_bits[White].clear(oldrooksq);
-         rook_bits[White].set(newrooksq);
-         clearAll(White,kp);
-         clearAll(White,oldrooksq);
-         setAll(White,newkp);
-         setAll(White,newrooksq);
-#ifdef NNUE
-         if (node) {
-             (node+1)->dirty_num = 2;
-             (node+1)->dirty[0] = DirtyState(static_cast<nnue::Square>(kp),
-                                             static_cast<nnue::Square>(newkp),
-                                             nnue::WhiteKing);
-             (node+1)->dirty[1] = DirtyState(static_cast<nnue::Square>(oldrooksq),
-                                             static_cast<nnue::Square>(newrooksq),
-                                             nnue::WhiteRook);
-         }
-#endif
-      }
-      else // not castling
-      {
-         assert(contents[start] != EmptyPiece);
-         const Bitboard bits(Bitboard::mask[start] |
-                             Bitboard::mask[dest]);
-         Square target = dest; // where we captured
-         Piece capture = contents[dest]; // what we captured
-#ifdef NNUE
-         if (node && moveType != Promotion) {
-             (node+1)->dirty_num = 1;
-             (node+1)->dirty[0] = DirtyState(static_cast<nnue::Square>(start),
-                                             static_cast<nnue::Square>(dest),
-                                             static_cast<nnue::Piece>(MakePiece(PieceMoved(move),White)));
-         }
-#endif
-         switch (TypeOfPiece(contents[StartSquare(move)])) {
-         case Empty: break;
-         case Pawn:
-            state.moveCount = 0;
-            switch (moveType)
-            {
-            case EnPassant:
-               // update hash code
-               Xor(state.hashCode, start, WhitePawn);
-               Xor(state.hashCode, dest, WhitePawn);
-               Xor(pawnHashCodeW, start, WhitePawn);
-               Xor(pawnHashCodeW, dest, WhitePawn);
-               assert(dest - 8 == old_epsq);
-               target = old_epsq;
-               capture = BlackPawn;
-               contents[dest] = WhitePawn;
-               pawn_bits[White].set(dest);
-               break;
-            case Promotion:
-               // update hash code
-               Xor(state.hashCode, start, WhitePawn);
-               Xor(state.hashCode, dest, MakeWhitePiece(PromoteTo(move)));
-               Xor(pawnHashCodeW, start, WhitePawn);
-               contents[dest] = MakeWhitePiece(PromoteTo(move));
-               material[White].removePawn();
-               material[White].addPiece(PromoteTo(move));
-               switch (PromoteTo(move))
-               {
-               case Knight:
-                  knight_bits[White].set(dest);
-                  break;
-               case Bishop:
-                  bishop_bits[White].set(dest);
-                  break;
-               case Rook:
-                  rook_bits[White].set(dest);
-                  break;
-               case Queen:
-                  queen_bits[White].set(dest);
-                  break;
-               default:
-                  break;
-               }
-#ifdef NNUE
-               if (node) {
-                 (node+1)->dirty[(node+1)->dirty_num++] = DirtyState(static_cast<nnue::Square>(start),
-                                                                     nnue::InvalidSquare,
-                                                                     nnue::WhitePawn);
-                 (node+1)->dirty[(node+1)->dirty_num++] = DirtyState(nnue::InvalidSquare,
-                                                                     static_cast<nnue::Square>(dest),
-                                                                     static_cast<nnue::Piece>(MakePiece(PromoteTo(move),White)));
-               }
-#endif
-               break;
-            default:
-               Xor(state.hashCode, start, WhitePawn );
-               Xor(state.hashCode, dest, WhitePawn );
-               Xor(pawnHashCodeW, start, WhitePawn);
-               Xor(pawnHashCodeW, dest, WhitePawn);
-               contents[dest] = WhitePawn;
-               if (dest - start == 16) // 2-square pawn advance
-               {
-                  if (TEST_MASK(Attacks::ep_mask[File(dest)-1][(int)White],pawn_bits[Black])) {
-                    state.enPassantSq = dest;
-                    state.hashCode ^= ep_codes[0];
-                    state.hashCode ^= ep_codes[dest];
-                  }
-               }
-               pawn_bits[White].set(dest);
-               break;
-            }
-            pawn_bits[White].clear(start);
-            break;
-         case Knight:
-            Xor(state.hashCode, start, WhiteKnight);
-            Xor(state.hashCode, dest, WhiteKnight);
-            contents[dest] = WhiteKnight;
-            knight_bits[White].setClear(bits);
-            break;
-         case Bishop:
-            Xor(state.hashCode, start, WhiteBishop);
-            Xor(state.hashCode, dest, WhiteBishop);
-            contents[dest] = WhiteBishop;
-            bishop_bits[White].setClear(bits);
-            break;
-         case Rook:
-            Xor(state.hashCode, start, WhiteRook );
-            Xor(state.hashCode, dest, WhiteRook );
-            contents[dest] = WhiteRook;
-            rook_bits[White].setClear(bits);
-            if ((int)state.castleStatus[White]<3) {
-               state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-               state.castleStatus[White] = UpdateCastleStatusW(state.castleStatus[White],start);
-               state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-            }
-            break;
-         case Queen:
-            Xor(state.hashCode, start, WhiteQueen);
-            Xor(state.hashCode, dest, WhiteQueen);
-            contents[dest] = WhiteQueen;
-            queen_bits[White].setClear(bits);
-            break;
-         case King:
-            Xor(state.hashCode, start, WhiteKing );
-            Xor(state.hashCode, dest, WhiteKing );
-            contents[dest] = WhiteKing;
-            kingPos[White] = dest;
-            state.hashCode ^= w_castle_status[(int)castleStatus(White)];
-            state.hashCode ^= w_castle_status[(int)CantCastleEitherSide];
-            state.castleStatus[White] = CantCastleEitherSide;
-            break;
-         }
-         contents[start] = EmptyPiece;
-         if (capture != EmptyPiece)
-         {
-#ifdef NNUE
-            if (node) {
-              (node+1)->dirty[(node+1)->dirty_num++] = DirtyState(static_cast<nnue::Square>(target),nnue::InvalidSquare,
-                                                                  static_cast<nnue::Piece>(capture));
-            }
-#endif
-            state.moveCount = 0;
-            assert(target != InvalidSquare);
-            occupied[Black].clear(target);
-            Xor(state.hashCode, target, capture);
-            switch (TypeOfPiece(capture))
-            {
-            case Empty: break;
-            case Pawn:
-               assert(pawn_bits[Black].isSet(target));
-               pawn_bits[Black].clear(target);
-               Xor(pawnHashCodeB, target, capture);
-               if (moveType == EnPassant)
-               {
-                  contents[target] = EmptyPiece;
-                  clearAll(Black,target);
-               }
-               material[Black].removePawn();
-               break;
-            case Rook:
-               rook_bits[Black].clear(target);
-               material[Black].removePiece(Rook);
-               if ((int)state.castleStatus[Black]<3) {
-                  state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-                  state.castleStatus[Black] = UpdateCastleStatusB(state.castleStatus[Black],dest);
-                  state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-               }
-               break;
-            case Knight:
-               knight_bits[Black].clear(target);
-               material[Black].removePiece(Knight);
-               break;
-            case Bishop:
-               bishop_bits[Black].clear(target);
-               material[Black].removePiece(Bishop);
-               break;
-            case Queen:
-               queen_bits[Black].clear(target);
-               material[Black].removePiece(Queen);
-               break;
-            case King:
-               assert(0);
-               kingPos[Black] = InvalidSquare;
-               state.castleStatus[Black] = CantCastleEitherSide;
-               material[Black].removePiece(King);
-               break;
-            default:
-               break;
-            }
-         }
-      }
-      setAll(White,dest);
-      clearAll(White,start);
-
-   }
-   else // side == Black
-   {
-      if (moveType == KCastle)
-      {
-         state.moveCount = 0;
-         const Square kp = kingSquare(Black);
-
-         // update the hash code
-         Xor(state.hashCode, kp+3, BlackRook);
-         Xor(state.hashCode, kp, BlackKing);
-         Xor(state.hashCode, kp+1, BlackRook);
-         Xor(state.hashCode, kp+2, BlackKing);
-         state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-         state.hashCode ^= b_castle_status[(int)CantCastleEitherSide];
-
-         const int newkp = kp + 2;
-         kingPos[Black] = newkp;
-         state.castleStatus[Black] = CantCastleEitherSide;
-         // find old square of rook
-         Square oldrooksq = kp + 3;
-         Square newrooksq = kp + 1;
-         contents[kp] = contents[oldrooksq] = EmptyPiece;
-         contents[newrooksq] = BlackRook;
-         contents[kp+2] = BlackKing;
-         rook_bits[Black].clear(oldrooksq);
-         rook_bits[Black].set(newrooksq);
-         clearAll(Black,kp);
-         clearAll(Black,oldrooksq);
-         setAll(Black,newkp);
-         setAll(Black,newrooksq);
-#ifdef NNUE
-         if (node) {
-             (node+1)->dirty_num = 2;
-             (node+1)->dirty[0] = DirtyState(static_cast<nnue::Square>(kp),
-                                             static_cast<nnue::Square>(newkp),
-                                             nnue::BlackKing);
-             (node+1)->dirty[1] = DirtyState(static_cast<nnue::Square>(oldrooksq),
-                                             static_cast<nnue::Square>(newrooksq),
-                                             nnue::BlackRook);
-         }
-#endif
-      }
-      else if (moveType == QCastle)
-      {
-         state.moveCount = 0;
-         const Square kp = kingSquare(Black);
-
-         // update the hash code
-         Xor(state.hashCode, kp-4, BlackRook);
-         Xor(state.hashCode, kp, BlackKing);
-         Xor(state.hashCode, kp-1, BlackRook);
-         Xor(state.hashCode, kp-2, BlackKing);
-         state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-         state.hashCode ^= b_castle_status[(int)CantCastleEitherSide];
-
-         const int newkp = kp - 2;
-         kingPos[Black] = newkp;
-         state.castleStatus[Black] = CantCastleEitherSide;
-         // find old square of rook
-         Square oldrooksq = kp - 4;
-         Square newrooksq = kp - 1;
-         contents[kp] = contents[oldrooksq] = EmptyPiece;
-         contents[newrooksq] = BlackRook;
-         contents[kp-2] = BlackKing;
-         rook_bits[Black].clear(oldrooksq);
-         rook_bits[Black].set(newrooksq);
-         clearAll(Black,kp);
-         clearAll(Black,oldrooksq);
-         setAll(Black,newkp);
-         setAll(Black,newrooksq);
-#ifdef NNUE
-         if (node) {
-             (node+1)->dirty_num = 2;
-             (node+1)->dirty[0] = DirtyState(static_cast<nnue::Square>(kp),
-                                             static_cast<nnue::Square>(newkp),
-                                             nnue::BlackKing);
-             (node+1)->dirty[1] = DirtyState(static_cast<nnue::Square>(oldrooksq),
-                                             static_cast<nnue::Square>(newrooksq),
-                                             nnue::BlackRook);
-         }
-#endif
-      }
-      else // not castling
-      {
-         assert(contents[start] != EmptyPiece);
-         const Bitboard bits(Bitboard::mask[start] |
-                           Bitboard::mask[dest]);
-         Square target = dest; // where we captured
-         Piece capture = contents[dest]; // what we captured
-#ifdef NNUE
-         if (node && moveType != Promotion) {
-             (node+1)->dirty_num = 1;
-             (node+1)->dirty[0] = DirtyState(static_cast<nnue::Square>(start),
-                                             static_cast<nnue::Square>(dest),
-                                             static_cast<nnue::Piece>(MakePiece(PieceMoved(move),Black)));
-         }
-#endif
-         switch (TypeOfPiece(contents[StartSquare(move)])) {
-         case Empty: break;
-         case Pawn:
-            state.moveCount = 0;
-            switch (moveType)
-            {
-            case EnPassant:
-               // update hash code
-               Xor(state.hashCode, start, BlackPawn);
-               Xor(state.hashCode, dest, BlackPawn);
-               Xor(pawnHashCodeB, start, BlackPawn);
-               Xor(pawnHashCodeB, dest, BlackPawn);
-               assert(dest + 8 == old_epsq);
-               target = old_epsq;
-               capture = WhitePawn;
-               contents[dest] = BlackPawn;
-               pawn_bits[Black].set(dest);
-               break;
-            case Promotion:
-               // update hash code
-               Xor(state.hashCode, start, BlackPawn);
-               Xor(state.hashCode, dest, MakeBlackPiece(PromoteTo(move)));
-               Xor(pawnHashCodeB, start, BlackPawn);
-               contents[dest] = MakeBlackPiece(PromoteTo(move));
-               material[Black].removePawn();
-               material[Black].addPiece(PromoteTo(move));
-               switch (PromoteTo(move))
-               {
-               case Knight:
-                  knight_bits[Black].set(dest);
-                  break;
-               case Bishop:
-                  bishop_bits[Black].set(dest);
-                  break;
-               case Rook:
-                  rook_bits[Black].set(dest);
-                  break;
-               case Queen:
-                  queen_bits[Black].set(dest);
-                  break;
-               default:
-                  break;
-               }
-#ifdef NNUE
-               if (node) {
-                 (node+1)->dirty[(node+1)->dirty_num++] = DirtyState(static_cast<nnue::Square>(start),
-                                                                     nnue::InvalidSquare,
-                                                                     nnue::BlackPawn);
-                 (node+1)->dirty[(node+1)->dirty_num++] = DirtyState(nnue::InvalidSquare,
-                                                                     static_cast<nnue::Square>(dest),
-                                                                     static_cast<nnue::Piece>(MakePiece(PromoteTo(move),Black)));
-               }
-#endif
-               break;
-            default:
-               Xor(state.hashCode, start, BlackPawn );
-               Xor(state.hashCode, dest, BlackPawn );
-               Xor(pawnHashCodeB, start, BlackPawn);
-               Xor(pawnHashCodeB, dest, BlackPawn);
-               contents[dest] = BlackPawn;
-               if (start - dest == 16) // 2-square pawn advance
-               {
-                  if (TEST_MASK(Attacks::ep_mask[File(dest)-1][(int)Black],pawn_bits[White])) {
-                    state.enPassantSq = dest;
-                    state.hashCode ^= ep_codes[0];
-                    state.hashCode ^= ep_codes[dest];
-                  }
-               }
-               pawn_bits[Black].set(dest);
-               break;
-            }
-            pawn_bits[Black].clear(start);
-            break;
-         case Knight:
-            Xor(state.hashCode, start, BlackKnight);
-            Xor(state.hashCode, dest, BlackKnight);
-            contents[dest] = BlackKnight;
-            knight_bits[Black].setClear(bits);
-            break;
-         case Bishop:
-            Xor(state.hashCode, start, BlackBishop);
-            Xor(state.hashCode, dest, BlackBishop);
-            contents[dest] = BlackBishop;
-            bishop_bits[Black].setClear(bits);
-            break;
-         case Rook:
-            Xor(state.hashCode, start, BlackRook );
-            Xor(state.hashCode, dest, BlackRook );
-            contents[dest] = BlackRook;
-            rook_bits[Black].setClear(bits);
-            if ((int)state.castleStatus[Black]<3) {
-                state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-                state.castleStatus[Black] = UpdateCastleStatusB(state.castleStatus[Black],start);
-                state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-            }
-            break;
-         case Queen:
-            Xor(state.hashCode, start, BlackQueen);
-            Xor(state.hashCode, dest, BlackQueen);
-            contents[dest] = BlackQueen;
-            queen_bits[Black].setClear(bits);
-            break;
-         case King:
-            Xor(state.hashCode, start, BlackKing );
-            Xor(state.hashCode, dest, BlackKing );
-            contents[dest] = BlackKing;
-            kingPos[Black] = dest;
-            state.hashCode ^= b_castle_status[(int)castleStatus(Black)];
-            state.hashCode ^= b_castle_status[(int)CantCastleEitherSide];
-            state.castleStatus[Black] = CantCastleEitherSide;
-            break;
-         }
-         contents[start] = EmptyPiece;
-         if (capture != EmptyPiece)
-         {
-#ifdef NNUE
-            if (node) {
-              (node+1)->dirty[(node+1)->dirty_num++] = DirtyState(static_cast<nnue::Square>(target),nnue::InvalidSquare,
-                                                                  static_cast<nnue::Piece>(capture));
-            }
-#endif
-            state.moveCount = 0;
-            assert(OnBoard(target));
-            occupied[White].clear(target);
-            Xor(state.hashCode, target, capture);
-            switch (TypeOfPiece(capture)) {
-            case Empty: break;
-            case Pawn:
-               assert(pawn_bits[White].isSet(target));
-               pawn_bits[White].clear(target);
-               Xor(pawnHashCodeW, target, capture);
-               if (moveType == EnPassant)
-               {
-                  contents[target] = EmptyPiece;
-                  clearAll(White,target);
-               }
-               material[White].removePawn();
-               break;
-            case Rook:
-               rook_bits[White].clear(target);
-               material[White].removePiece(Rook);
-               if ((int)state.castleStatus[White]<3) {
-                  state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-                  state.castleStatus[White] = UpdateCastleStatusW(state.castleStatus[White],dest);
-                  state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-               }
-               break;
-            case Knight:
-               knight_bits[White].clear(target);
-               material[White].removePiece(Knight);
-               break;
-            case Bishop:
-               bishop_bits[White].clear(target);
-               material[White].removePiece(Bishop);
-               break;
-            case Queen:
-               queen_bits[White].clear(target);
-               material[White].removePiece(Queen);
-               break;
-            case King:
-               assert(0);
-               kingPos[White] = InvalidSquare;
-               state.castleStatus[White] = CantCastleEitherSide;
-               material[White].removePiece(King);
-               break;
-            default:
-               break;
-            }
-         }
-         setAll(Black,dest);
-         clearAll(Black,start);
-      }
-   }
+      makeMove<White>(move,old_epsq);
+   else
+      makeMove<Black>(move,old_epsq);
 
    // changing side to move so flip those bits
    state.hashCode = BoardHash::setSideToMove(state.hashCode,oppositeSide());
-   *repListHead++ = state.hashCode;
+   pushHistory(state.hashCode);
    //assert(pawn_hash(White) == BoardHash::pawnHash(*this),White);
    assert(getMaterial(sideToMove()).pawnCount() == (int)pawn_bits[side].bitCount());
    side = oppositeSide();
@@ -910,208 +857,30 @@ hash_t Board::hashCode( Move move ) const
        newHash ^= ep_codes[state.enPassantSq];
        newHash ^= ep_codes[0];
    }
-   const Square start = StartSquare(move);
-   const Square dest = DestSquare(move);
-   const MoveType moveType = TypeOfMove(move);
    if (side == White)
-   {
-      if (moveType == KCastle)
-      {
-         const Square kp = kingSquare(White);
-         Xor(newHash, kp+3, WhiteRook);
-         Xor(newHash, kp, WhiteKing);
-         Xor(newHash, kp+1, WhiteRook);
-         Xor(newHash, kp+2, WhiteKing);
-         newHash ^= w_castle_status[(int)state.castleStatus[White]];
-         newHash ^= w_castle_status[(int)CantCastleEitherSide];
-      }
-      else if (moveType == QCastle)
-      {
-         const Square kp = kingSquare(White);
-         Xor(newHash, kp-4, WhiteRook);
-         Xor(newHash, kp, WhiteKing);
-         Xor(newHash, kp-1, WhiteRook);
-         Xor(newHash, kp-2, WhiteKing);
-         newHash ^= w_castle_status[(int)state.castleStatus[White]];
-         newHash ^= w_castle_status[(int)CantCastleEitherSide];
-      }
-      else // not castling
-      {
-         Square target = dest; // where we captured
-         switch (TypeOfPiece(contents[StartSquare(move)]))
-         {
-         case Empty: break;
-         case Pawn:
-            switch (moveType)
-            {
-            case EnPassant:
-               // update hash code
-               Xor(newHash, start, WhitePawn);
-               Xor(newHash, dest, WhitePawn);
-               target = state.enPassantSq;
-               break;
-            case Promotion:
-               // update hash code
-               Xor(newHash, start, WhitePawn);
-               Xor(newHash, dest, MakeWhitePiece(PromoteTo(move)));
-               break;
-            default:
-               Xor(newHash, start, WhitePawn );
-               Xor(newHash, dest, WhitePawn );
-               if (start - dest == 16) // 2-square pawn advance
-               {
-                  if (TEST_MASK(Attacks::ep_mask[File(dest)-1][(int)White],pawn_bits[Black])) {
-                    newHash ^= ep_codes[0];
-                    newHash ^= ep_codes[dest];
-                  }
-               }
-               break;
-            }
-            break;
-         case Knight:
-            Xor(newHash, start, WhiteKnight);
-            Xor(newHash, dest, WhiteKnight);
-            break;
-         case Bishop:
-            Xor(newHash, start, WhiteBishop);
-            Xor(newHash, dest, WhiteBishop);
-            break;
-         case Rook:
-            Xor(newHash, start, WhiteRook );
-            Xor(newHash, dest, WhiteRook );
-            if ((int)state.castleStatus[White]<3) {
-               newHash ^= w_castle_status[(int)state.castleStatus[White]];
-               newHash ^= w_castle_status[(int)UpdateCastleStatusW(state.castleStatus[White],start)];
-            }
-            break;
-         case Queen:
-            Xor(newHash, start, WhiteQueen);
-            Xor(newHash, dest, WhiteQueen);
-            break;
-         case King:
-            Xor(newHash, start, WhiteKing );
-            Xor(newHash, dest, WhiteKing );
-            newHash ^= w_castle_status[(int)castleStatus(White)];
-            newHash ^= w_castle_status[(int)CantCastleEitherSide];
-            break;
-         }
-         if (Capture(move) != Empty)
-         {
-            Piece cap = MakeBlackPiece(Capture(move));
-            assert(OnBoard(target));
-            Xor(newHash, target, cap);
-            if (Capture(move) == Rook) {
-               if ((int)state.castleStatus[Black]<3) {
-                  newHash ^= b_castle_status[(int)state.castleStatus[Black]];
-                  newHash ^= b_castle_status[(int)UpdateCastleStatusB(state.castleStatus[Black],dest)];
-               }
-            }
-         }
-      }
+      newHash = hashCodeAfter<White>(move,newHash);
+   else
+      newHash = hashCodeAfter<Black>(move,newHash);
 
-   }
-   else // side == Black
-   {
-      if (moveType == KCastle)
-      {
-         const Square kp = kingSquare(Black);
-         Xor(newHash, kp+3, BlackRook);
-         Xor(newHash, kp, BlackKing);
-         Xor(newHash, kp+1, BlackRook);
-         Xor(newHash, kp+2, BlackKing);
-         newHash ^= b_castle_status[(int)state.castleStatus[Black]];
-         newHash ^= b_castle_status[(int)CantCastleEitherSide];
-      }
-      else if (moveType == QCastle)
-      {
-         const Square kp = kingSquare(Black);
-         Xor(newHash, kp-4, BlackRook);
-         Xor(newHash, kp, BlackKing);
-         Xor(newHash, kp-1, BlackRook);
-         Xor(newHash, kp-2, BlackKing);
-         newHash ^= b_castle_status[(int)state.castleStatus[Black]];
-         newHash ^= b_castle_status[(int)CantCastleEitherSide];
-      }
-      else // not castling
-      {
-         Square target = dest; // where we captured
-         switch (TypeOfPiece(contents[StartSquare(move)]))
-         {
-         case Empty: break;
-         case Pawn:
-            switch (moveType)
-            {
-            case EnPassant:
-               // update hash code
-               Xor(newHash, start, BlackPawn);
-               Xor(newHash, dest, BlackPawn);
-               target = state.enPassantSq;
-               break;
-            case Promotion:
-               // update hash code
-               Xor(newHash, start, BlackPawn);
-               Xor(newHash, dest, MakeBlackPiece(PromoteTo(move)));
-               break;
-            default:
-               Xor(newHash, start, BlackPawn );
-               Xor(newHash, dest, BlackPawn );
-               if (dest - start == 16) // 2-square pawn advance
-               {
-                  if (TEST_MASK(Attacks::ep_mask[File(dest)-1][(int)Black],pawn_bits[White])) {
-                    newHash ^= ep_codes[0];
-                    newHash ^= ep_codes[dest];
-                  }
-               }
-               break;
-            }
-            break;
-         case Knight:
-            Xor(newHash, start, BlackKnight);
-            Xor(newHash, dest, BlackKnight);
-            break;
-         case Bishop:
-            Xor(newHash, start, BlackBishop);
-            Xor(newHash, dest, BlackBishop);
-            break;
-         case Rook:
-            Xor(newHash, start, BlackRook );
-            Xor(newHash, dest, BlackRook );
-            if ((int)state.castleStatus[Black]<3) {
-               newHash ^= b_castle_status[(int)state.castleStatus[Black]];
-               newHash ^= b_castle_status[(int)UpdateCastleStatusB(state.castleStatus[Black],dest)];
-            }
-            break;
-         case Queen:
-            Xor(newHash, start, BlackQueen);
-            Xor(newHash, dest, BlackQueen);
-            break;
-         case King:
-            Xor(newHash, start, BlackKing );
-            Xor(newHash, dest, BlackKing );
-            newHash ^= b_castle_status[(int)castleStatus(Black)];
-            newHash ^= b_castle_status[(int)CantCastleEitherSide];
-            break;
-         }
-         if (Capture(move) != Empty)
-         {
-            Piece cap = MakeWhitePiece(Capture(move));
-            assert(OnBoard(target));
-            Xor(newHash, target, cap);
-            if (Capture(move) == Rook) {
-               if ((int)state.castleStatus[White]<3) {
-                  newHash ^= w_castle_status[(int)state.castleStatus[White]];
-                  newHash ^= w_castle_status[(int)UpdateCastleStatusW(state.castleStatus[White],dest)];
-               }
-            }
-         }
+   // changing side to move so flip those bits
+   return BoardHash::setSideToMove(newHash,oppositeSide());
+}
 
+hash_t Board::pawnHash( Move move ) const
+{
+   hash_t newHash = pawnHash();
+   if (PieceMoved(move) == Pawn) {
+      const Piece ourPawn = MakePiece(Pawn,sideToMove());
+      Xor(newHash, StartSquare(move), ourPawn);
+      if (TypeOfMove(move) != Promotion) {
+         Xor(newHash, DestSquare(move), ourPawn);
       }
    }
-
-   if (sideToMove() == White)
-      newHash |= (hash_t)1;
-   else
-      newHash &= (hash_t)~1;
+   if (Capture(move) == Pawn) {
+      const Square target = TypeOfMove(move) == EnPassant ?
+         state.enPassantSq : DestSquare(move);
+      Xor(newHash, target, MakePiece(Pawn,oppositeSide()));
+   }
    return newHash;
 }
 
@@ -1138,8 +907,6 @@ void Board::undoMove( Move move, const BoardState &old_state )
    if (!IsNull(move))
    {
       const MoveType moveType = TypeOfMove(move);
-      const Square start = StartSquare(move);
-      const Square dest = DestSquare(move);
       if (moveType == KCastle)
       {
          Square kp = kingSquare(side);
@@ -1157,254 +924,16 @@ void Board::undoMove( Move move, const BoardState &old_state )
          undoCastling(kp,oldkingsq,newrooksq,oldrooksq);
       }
       else if (side == White)
-      {
-         const Bitboard bits(Bitboard::mask[start] |
-                           Bitboard::mask[dest]);
-         // not castling
-         Square target = dest;
-         // fix up start square:
-         if (moveType == Promotion || moveType == EnPassant)
-         {
-            contents[start] = WhitePawn;
-         }
-         else
-         {
-            contents[start] = contents[dest];
-         }
-         setAll(White,start);
-         switch (TypeOfPiece(contents[start])) {
-         case Empty: break;
-         case Pawn:
-            Xor(pawnHashCodeW,start,WhitePawn);
-            switch (moveType) {
-            case Promotion:
-               material[White].addPawn();
-               material[White].removePiece(PromoteTo(move));
-               switch (PromoteTo(move))
-               {
-               case Knight:
-                  knight_bits[White].clear(dest);
-                  break;
-               case Bishop:
-                  bishop_bits[White].clear(dest);
-                  break;
-               case Rook:
-                  rook_bits[White].clear(dest);
-                  break;
-               case Queen:
-                  queen_bits[White].clear(dest);
-                  break;
-               default:
-                  break;
-               }
-               break;
-#ifdef __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
-#endif
-            case EnPassant:
-               target = dest - 8;
-               assert(OnBoard(target));
-               assert(contents[target]==EmptyPiece);
-               // note: falls through to normal case
-            case Normal:
-               pawn_bits[White].clear(dest);
-               Xor(pawnHashCodeW,dest,WhitePawn);
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif
-            default:
-               break;
-            }
-            pawn_bits[White].set(start);
-            break;
-         case Knight:
-            knight_bits[White].setClear(bits);
-            break;
-         case Bishop:
-            bishop_bits[White].setClear(bits);
-            break;
-         case Rook:
-            rook_bits[White].setClear(bits);
-            break;
-         case Queen:
-            queen_bits[White].setClear(bits);
-            break;
-         case King:
-            kingPos[White] = start;
-            break;
-         default:
-            break;
-         }
-         // fix up dest square
-         clearAll(White,dest);
-         contents[dest] = EmptyPiece;
-         contents[target] = MakePiece(Capture(move),Black);
-         if (Capture(move) != Empty)
-         {
-            switch (Capture(move))
-            {
-            case Pawn:
-                           assert(!pawn_bits[Black].isSet(target));
-               pawn_bits[Black].set(target);
-               Xor(pawnHashCodeB,target,BlackPawn);
-               material[Black].addPawn();
-               break;
-            case Knight:
-               knight_bits[Black].set(target);
-               material[Black].addPiece(Knight);
-               break;
-            case Bishop:
-               bishop_bits[Black].set(target);
-               material[Black].addPiece(Bishop);
-               break;
-            case Rook:
-               rook_bits[Black].set(target);
-               material[Black].addPiece(Rook);
-               break;
-            case Queen:
-               queen_bits[Black].set(target);
-               material[Black].addPiece(Queen);
-               break;
-            case King:
-               kingPos[Black] = target;
-               material[Black].addPiece(King);
-               break;
-            default:
-               break;
-            }
-            setAll(Black,target);
-         }
-      }
-      else // side == Black
-      {
-         const Bitboard bits(Bitboard::mask[start] |
-                           Bitboard::mask[dest]);
-         // not castling
-         Square target = dest;
-         // fix up start square:
-         if (moveType == Promotion || moveType == EnPassant)
-         {
-            contents[start] = BlackPawn;
-         }
-         else
-         {
-            contents[start] = contents[dest];
-         }
-         setAll(Black,start);
-         switch (TypeOfPiece(contents[start])) {
-         case Empty: break;
-         case Pawn:
-            Xor(pawnHashCodeB,start,BlackPawn);
-            switch (moveType) {
-            case Promotion:
-            {
-               material[Black].addPawn();
-               material[Black].removePiece(PromoteTo(move));
-               switch (PromoteTo(move))
-               {
-               case Knight:
-                  knight_bits[Black].clear(dest);
-                  break;
-               case Bishop:
-                  bishop_bits[Black].clear(dest);
-                  break;
-               case Rook:
-                  rook_bits[Black].clear(dest);
-                  break;
-               case Queen:
-                  queen_bits[Black].clear(dest);
-                  break;
-               default:
-                  break;
-               }
-               break;
-            }
-#ifdef __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
-#endif
-            case EnPassant:
-               target = dest + 8;
-               assert(OnBoard(target));
-               assert(contents[target]== EmptyPiece);
-               // note: falls through to normal case
-            case Normal:
-               pawn_bits[Black].clear(dest);
-               Xor(pawnHashCodeB,dest,BlackPawn);
-               break;
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif
-            default:
-               break;
-            }
-            pawn_bits[Black].set(start);
-            break;
-         case Knight:
-            knight_bits[Black].setClear(bits);
-            break;
-         case Bishop:
-            bishop_bits[Black].setClear(bits);
-            break;
-         case Rook:
-            rook_bits[Black].setClear(bits);
-            break;
-         case Queen:
-            queen_bits[Black].setClear(bits);
-            break;
-         case King:
-            kingPos[Black] = start;
-            break;
-         default:
-            break;
-         }
-         // fix up dest square
-         clearAll(Black,dest);
-         contents[dest] = EmptyPiece;
-         contents[target] = MakePiece(Capture(move),White);
-         if (Capture(move) != Empty)
-         {
-            switch (Capture(move))
-            {
-            case Pawn:
-                           assert(!pawn_bits[White].isSet(target));
-               pawn_bits[White].set(target);
-               Xor(pawnHashCodeW,target,WhitePawn);
-               material[White].addPawn();
-               break;
-            case Knight:
-               knight_bits[White].set(target);
-               material[White].addPiece(Knight);
-               break;
-            case Bishop:
-               bishop_bits[White].set(target);
-               material[White].addPiece(Bishop);
-               break;
-            case Rook:
-               rook_bits[White].set(target);
-               material[White].addPiece(Rook);
-               break;
-            case Queen:
-               queen_bits[White].set(target);
-               material[White].addPiece(Queen);
-               break;
-            case King:
-               kingPos[White] = target;
-               material[White].addPiece(King);
-               break;
-            default:
-               break;
-            }
-            setAll(White,target);
-         }
-      }
+         unmakeMove<White>(move);
+      else
+         unmakeMove<Black>(move);
    }
    state = old_state;
+   attackInfo = 0;
    assert(getMaterial(sideToMove()).pawnCount() == (int)pawn_bits[side].bitCount());
    assert(getMaterial(oppositeSide()).pawnCount() == (int)pawn_bits[oppositeSide()].bitCount());
 
-   --repListHead;
+   popHistory();
    allOccupied = Bitboard(occupied[White] | occupied[Black]);
    assert(state.hashCode == BoardHash::hashCode(*this));
 #if defined(_DEBUG) && defined(FULL_DEBUG)
@@ -1458,6 +987,8 @@ int Board::anyAttacks(const Square sq, ColorType side) const
 {
    if (sq == InvalidSquare)
       return 0;
+   if (hasAttackedSquares(side))
+      return cachedAttacks[side].isSet(sq);
    if (TEST_MASK(Attacks::pawn_attacks[sq][side],pawn_bits[side])) return 1;
    if (TEST_MASK(Attacks::knight_attacks[sq],knight_bits[side])) return 1;
    if (Attacks::king_attacks[sq].isSet(kingSquare(side))) return 1;
@@ -1674,7 +1205,9 @@ const Bitboard Board::bishopAttacks(Square sq,ColorType side) const {
 
 CheckStatusType Board::getCheckStatus() const
 {
-   if (anyAttacks(kingSquare(sideToMove()),oppositeSide()))
+   if ((attackInfo & CheckersValid) ?
+       !cachedCheckers.isClear() :
+       anyAttacks(kingSquare(sideToMove()),oppositeSide()))
    {
       // This is a const function, but we cache its result
       Board &b = (Board&)*this;
@@ -1689,6 +1222,18 @@ CheckStatusType Board::getCheckStatus() const
    return state.checkStatus;
 }
 
+void Board::calcCheckers() const
+{
+   cachedCheckers = calcAttacks(kingSquare(sideToMove()),oppositeSide());
+   attackInfo |= CheckersValid;
+}
+
+void Board::calcPinned() const
+{
+   cachedPinned = getPinned(kingSquare(sideToMove()),oppositeSide(),sideToMove());
+   attackInfo |= PinnedValid;
+}
+
 // This variant of CheckStatus sees if the last move made
 // delivered check. It is generally faster than checkStatus
 // with no param, because we can use the last move information
@@ -1997,12 +1542,17 @@ int Board::repCount(int target) const noexcept
     int entries = std::min<int>(state.movesFromNull,state.moveCount) - 2;
     if (entries <= 0) return 0;
     hash_t to_match = hashCode();
+    // Check the filter first. The current position is normally the
+    // last history entry, and then is counted once itself.
+    const unsigned self = repListHead != repList && repListHead[-1] == to_match;
+    if (repFilter[repFilterIndex(to_match)] <= self) return 0;
     int count = 0;
-    for (hash_t *repList=repListHead-3;
-       entries>=0;
-       repList-=2,entries-=2)
+    // Search back from 2 plies before the current position, first
+    // in this board's part of the history, then in the shared part.
+    int i = (int)(repListHead - repList) - 3;
+    for (; i >= 0 && entries >= 0; i -= 2, entries -= 2)
     {
-      if (*repList == to_match)
+      if (repList[i] == to_match)
       {
          count++;
          if (count >= target)
@@ -2010,8 +1560,21 @@ int Board::repCount(int target) const noexcept
             return count;
          }
       }
-   }
-   return count;
+    }
+    if (entries >= 0 && repPrefix) {
+       for (i += (int)repPrefixLen; i >= 0 && entries >= 0; i -= 2, entries -= 2)
+       {
+          if ((*repPrefix)[i] == to_match)
+          {
+             count++;
+             if (count >= target)
+             {
+                return count;
+             }
+          }
+       }
+    }
+    return count;
 }
 
 bool Board::anyRep() const noexcept
@@ -2021,13 +1584,19 @@ bool Board::anyRep() const noexcept
    // hash codes cannot match:
    if (entries < 3) return 0;
    std::unordered_set<hash_t> codes;
-   for (hash_t *repList=repListHead-1;
-      entries>0;
-      repList--,entries--) {
-      if (!codes.emplace(*repList).second) {
+   int i = (int)(repListHead - repList) - 1;
+   for (; i >= 0 && entries > 0; i--, entries--) {
+      if (!codes.emplace(repList[i]).second) {
          return 1;
       }
    }
+   if (repPrefix) {
+      for (i += (int)repPrefixLen; i >= 0 && entries > 0; i--, entries--) {
+         if (!codes.emplace((*repPrefix)[i]).second) {
+            return 1;
+         }
+      }
+   }
    return 0;
 }
 
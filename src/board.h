@@ -11,6 +11,9 @@
 #include "attacks.h"
 #include "material.h"
 
+#include <memory>
+#include <vector>
+
 struct NodeInfo;
 
 class Board;
@@ -110,6 +113,7 @@ public:
 
    void setSideToMove( ColorType color ) {
      side = color;
+     attackInfo = 0;
    }
 
    const Material &getMaterial( ColorType c ) const
@@ -121,6 +125,9 @@ public:
       return pawnHashCodeW ^ pawnHashCodeB;
    }
 
+   // returns what pawn hash code will be after move
+   hash_t pawnHash( Move m ) const;
+
    Square enPassantSq() const {
       return state.enPassantSq;
    }
@@ -145,6 +152,39 @@ public:
        state.checkStatus = s;
    }
 
+   enum AttackInfoFlags { CheckersValid = 1, PinnedValid = 2,
+                          WhiteAttacksValid = 4, BlackAttacksValid = 8 };
+
+   // Pieces giving check to the side to move (cached).
+   const Bitboard &checkers() const {
+      if (!(attackInfo & CheckersValid)) calcCheckers();
+      return cachedCheckers;
+   }
+
+   // Pieces of the side to move that are pinned to its King (cached).
+   const Bitboard &pinned() const {
+      if (!(attackInfo & PinnedValid)) calcPinned();
+      return cachedPinned;
+   }
+
+   // All squares attacked by "side" (cached). Same as allAttacks(side).
+   const Bitboard &attackedSquares(ColorType side) const {
+      if (!hasAttackedSquares(side)) setAttackedSquares(side,allAttacks(side));
+      return cachedAttacks[side];
+   }
+
+   // True if the attacked squares for "side" are cached.
+   bool hasAttackedSquares(ColorType side) const {
+      return (attackInfo & (WhiteAttacksValid << side)) != 0;
+   }
+
+   // Cache the attacked squares for "side", if computed elsewhere
+   // (for example by the evaluation).
+   void setAttackedSquares(ColorType side, const Bitboard &attacks) const {
+      cachedAttacks[side] = attacks;
+      attackInfo |= (WhiteAttacksValid << side);
+   }
+
    Square kingSquare(ColorType c) const {
         return kingPos[c];
    }
@@ -190,10 +230,17 @@ public:
    // Undoes a previous null move.
    void undoNull(const BoardState &oldState) {
       state = oldState;
-       --repListHead;
+      attackInfo = 0;
+      popHistory();
       side = OppositeColor(side);
    }
 
+   // Move the repetition history into an immutable prefix shared
+   // by copies of this board, so that copying it (for example to
+   // start a search thread) does not copy the history. Also resets
+   // the repetition filter, so it covers only the current search.
+   void shareHistory();
+
    // Return true if move m would attack square "target" after it is
    // made (call before the move is made). This is somewhat imperfect
    // (does not handle irregular moves such as castling)
@@ -403,7 +450,11 @@ public:
 
    private:
 
-   static const int RepListSize = 1024;
+   static const int RepListSize = 256;
+
+   static const int RepFilterSize = 256; // must be a power of 2
+
+   static const uint8_t RepFilterMax = 255; // saturated count
 
    ALIGN_VAR(16) Piece contents[64];
    Square kingPos[2];
@@ -422,20 +473,99 @@ public:
    Bitboard occupied[2];
    Bitboard allOccupied;
 
+   // Attack information for the position, computed on demand and
+   // cached so that the search, move generators, SEE and the
+   // evaluation can share it. attackInfo has a bit set for each
+   // valid entry (see AttackInfoFlags). This is not part of
+   // BoardState, so is not saved and restored with it: it is
+   // cleared whenever the position changes.
+   mutable int attackInfo;
+   mutable Bitboard cachedCheckers;
+   mutable Bitboard cachedPinned;
+   mutable Bitboard cachedAttacks[2];
+
    Bitboard allPawns() const {
        return pawn_bits[White] | pawn_bits[Black];
    }
 
-   hash_t repList[RepListSize]; //  move history for repetition detection
+   // Counts, by hash code, of the positions in the repetition history
+   // (see rebuildRepFilter). A position whose count is zero, not counting
+   // itself, cannot be a repetition. Copied with the board contents.
+   // A count that reaches RepFilterMax stays there until the filter
+   // is rebuilt.
+   uint8_t repFilter[RepFilterSize];
+
+   hash_t repList[RepListSize]; // recent move history for repetition detection
    hash_t *repListHead; // head of history list
 
 private:
 
+   // Older move history, shared between copies of the board. Only
+   // the first repPrefixLen entries are in use (undoing moves past the
+   // share point shortens it). Must follow repList (not copied by
+   // memcpy).
+   std::shared_ptr<const std::vector<hash_t>> repPrefix;
+   size_t repPrefixLen;
+
+   struct NoInit {};
+
+   explicit Board(NoInit) : repPrefixLen(0) {}
+
+   static unsigned repFilterIndex(hash_t h) noexcept {
+      return unsigned(h) & (RepFilterSize-1);
+   }
+
+   void pushHistory(hash_t h) {
+      if (repListHead == repList + RepListSize) shareHistory();
+      *repListHead++ = h;
+      uint8_t &count = repFilter[repFilterIndex(h)];
+      if (count != RepFilterMax) ++count;
+   }
+
+   void popHistory() {
+      if (repListHead != repList) {
+         uint8_t &count = repFilter[repFilterIndex(*--repListHead)];
+         if (count != RepFilterMax) --count;
+      }
+      else popSharedHistory();
+   }
+
+   void popSharedHistory();
+
+   // Reset the repetition filter to count only the positions
+   // that repCount can examine from this position or its successors.
+   // Called when the unshared part of the history is empty.
+   void rebuildRepFilter();
+
+   // Clear the repetition history, except for the current position.
+   void clearHistory();
+
    static void setupInitialBoard();
 
    void undoCastling(Square kp, Square oldkingsq,
            Square newrooksq, Square oldrooksq);
 
+   // compute and cache checkers() and pinned()
+   void calcCheckers() const;
+
+   void calcPinned() const;
+
+   // Make, unmake and hash update for a non-null move, specialized by
+   // the side to move (castling is handled generically in undoMove).
+   template <ColorType side>
+   void makeMove(Move m, Square old_epsq);
+
+   template <ColorType side>
+   void unmakeMove(Move m);
+
+   template <ColorType side>
+   hash_t hashCodeAfter(Move m, hash_t h) const;
+
+   // Move a piece other than a pawn or king, updating the hash code,
+   // contents and the piece's bitboard "bits" (but not the occupancy).
+   template <ColorType side>
+   void movePiece(PieceType piece, Bitboard &bits, Square start, Square dest);
+
    void setAll(ColorType color, Square sq) {
      allOccupied.set(sq);
      occupied[color].set(sq);
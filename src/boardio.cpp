@@ -156,8 +156,8 @@ int BoardIO::readFEN(Board &board, const std::string &buf)
    {
      return 0;
    }
-   assert(board.state.moveCount+1<Board::RepListSize);
-   board.repList[board.state.moveCount++] = board.hashCode();
+   board.clearHistory();
+   board.state.moveCount++;
 
    if (board.kingPos[White] == InvalidSquare ||
        board.kingPos[Black] == InvalidSquare) {
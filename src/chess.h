@@ -197,6 +197,12 @@ FORCEINLINE Piece MakeBlackPiece( PieceType type ) {
   return (Piece)((int)type + 8);
 }
 
+// MakePiece for a side known at compile time
+template <ColorType side>
+FORCEINLINE constexpr Piece MakePiece( PieceType type ) {
+  return (side == White || type == Empty) ? (Piece)((int)type) : (Piece)((int)type + 8);
+}
+
 FORCEINLINE PieceType TypeOfPiece( Piece piece ) {
   return ((PieceType)((int)piece & 7));
 }
@@ -16,6 +16,7 @@ enum {MaxMoves = 220};
 enum {MaxCaptures = 40};
 enum {MaxChecks = 40};
 enum {MaxCPUs = 256};
+enum {MaxNumaNodes = 16};
 
 static constexpr int INFINITE_TIME = 100000000;
 
@@ -6,6 +6,16 @@
 #include "legal.h"
 #include "learn.h"
 #include "scoring.h"
+#ifdef NUMA
+#include "topo.h"
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
 extern "C"
 {
 #if !defined(_MAC) && !defined(__clang__) && !defined(__FreeBSD__)
@@ -13,7 +23,67 @@ extern "C"
 #endif
 #include <memory.h>
 #include <stddef.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+}
+
+// Header of a saved hash table file. It occupies one bucket-sized
+// block, so the table that follows stays cache-line aligned.
+struct HashFileHeader {
+   char magic[8];
+   uint32_t version; // entry layout version
+   uint32_t entrySize;
+   uint32_t bucketSize;
+   uint32_t bucketEntries;
+   uint64_t buckets;
+   uint64_t hashFree;
+   uint64_t keyCheck; // hash of the starting position
+   uint32_t age;
+   uint8_t padding[12];
+};
+
+static_assert(sizeof(HashFileHeader) == sizeof(HashBucket), "hash file header size must equal bucket size");
+
+static const char HASH_FILE_MAGIC[8] = {'A','R','A','S','A','N','T','T'};
+
+// Increment this if HashEntry or HashBucket layout changes.
+static const uint32_t HASH_FILE_VERSION = 2;
+
+static uint64_t hashKeyCheck()
+{
+   // Detects a change to the hash codes
+   const Board board;
+   return board.hashCode();
+}
+
+#ifdef __linux__
+static const size_t HUGE_PAGE_2M = 2*1024*1024;
+static const size_t HUGE_PAGE_1G = 1024*1024*1024;
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// Try to map an explicit huge page region (requires pages reserved
+// via /proc/sys/vm/nr_hugepages or the kernel command line).
+static void *mapHugePages(size_t bytes, size_t pageSize, int sizeFlag)
+{
+   if (bytes < pageSize || bytes % pageSize) return nullptr;
+   void *mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | sizeFlag,
+                    -1, 0);
+   return mem == MAP_FAILED ? nullptr : mem;
 }
+#endif
 
 Hash::Hash() {
    hashTable = nullptr;
@@ -21,38 +91,198 @@ Hash::Hash() {
    hashMask = 0x0ULL;
    hashFree = 0;
    hash_init_done = 0;
+   pageType = PageType::Normal;
+   mapBase = nullptr;
+   mapSize = 0;
+#ifdef NUMA
+   topo = nullptr;
+   numaPolicy = NumaPolicy::FirstTouch;
+   numaNodes = 1;
+   pageShift = 12;
+   stripeBuckets = 1;
+#endif
+}
+
+const char *Hash::pageTypeImage(PageType type)
+{
+   switch(type) {
+   case PageType::Huge1G:
+      return "1 GB huge pages";
+   case PageType::Huge2M:
+      return "2 MB huge pages";
+   case PageType::TransparentHuge:
+      return "transparent huge pages";
+   case PageType::Mapped:
+      return "mapped from file";
+   default:
+      return "normal pages";
+   }
+}
+
+void Hash::printAllocation(std::ostream &o) const
+{
+   const size_t bytes = (hashSize/HashBucket::Entries)*sizeof(HashBucket);
+   if (bytes % (1024*1024) == 0) {
+      o << bytes/(1024*1024) << " MB";
+   } else if (bytes % 1024 == 0) {
+      o << bytes/1024 << " KB";
+   } else {
+      o << bytes << " bytes";
+   }
+   o << ", " << pageTypeImage(pageType);
+#ifdef NUMA
+   if (numaPolicy == NumaPolicy::Interleave) {
+      o << ", interleaved across " << numaNodes << " node(s)";
+   } else if (numaPolicy == NumaPolicy::Stripe) {
+      o << ", striped across " << numaNodes << " node(s)";
+   }
+#endif
+}
+
+HashBucket *Hash::allocTable(size_t bytes)
+{
+   HashBucket *table = nullptr;
+#ifdef __linux__
+   // Prefer explicit huge pages, largest size first. These fail
+   // unless the system has huge pages reserved.
+   if ((table = (HashBucket*)mapHugePages(bytes,HUGE_PAGE_1G,MAP_HUGE_1GB)) != nullptr) {
+      pageType = PageType::Huge1G;
+      return table;
+   }
+   if ((table = (HashBucket*)mapHugePages(bytes,HUGE_PAGE_2M,MAP_HUGE_2MB)) != nullptr) {
+      pageType = PageType::Huge2M;
+      return table;
+   }
+   if (bytes >= HUGE_PAGE_2M) {
+      // Fall back to transparent huge pages, if enabled in the kernel.
+      ALIGNED_MALLOC(table, HashBucket, bytes, HUGE_PAGE_2M);
+      if (table != nullptr) {
+         pageType = madvise(table, bytes, MADV_HUGEPAGE) == 0 ?
+            PageType::TransparentHuge : PageType::Normal;
+      }
+      return table;
+   }
+#endif
+   pageType = PageType::Normal;
+   ALIGNED_MALLOC(table, HashBucket, bytes, 128);
+   return table;
+}
+
+void Hash::freeTable()
+{
+   if (hashTable == nullptr) return;
+#ifndef _WIN32
+   if (pageType == PageType::Mapped) {
+      munmap(mapBase, mapSize);
+      mapBase = nullptr;
+      mapSize = 0;
+   }
+   else
+#endif
+#ifdef __linux__
+   if (pageType == PageType::Huge1G || pageType == PageType::Huge2M) {
+      munmap(hashTable, sizeof(HashBucket)*(hashSize/HashBucket::Entries));
+   }
+   else
+#endif
+   {
+      ALIGNED_FREE(hashTable);
+   }
+   hashTable = nullptr;
+   pageType = PageType::Normal;
+#ifdef NUMA
+   numaPolicy = NumaPolicy::FirstTouch;
+#endif
 }
 
 void Hash::initHash(size_t bytes)
 {
    if (!hash_init_done) {
-      hashSize = bytes/sizeof(HashEntry);
-      if (!hashSize) {
-         hashMask = 0;
-         hash_init_done++;
+      allocHash(bytes);
+      clearHash();
+   }
+}
+
+void Hash::allocHash(size_t bytes)
+{
+   size_t buckets = bytes/sizeof(HashBucket);
+   if (!buckets) {
+      hashSize = 0;
+      hashMask = 0;
+      hash_init_done++;
+      return;
+   }
+   unsigned hashPower;
+   for (hashPower = 1; hashPower < 64; hashPower++) {
+       if ((1ULL << hashPower) > buckets) {
+           hashPower--;
+           break;
+       }
+   }
+   buckets = 1ULL << hashPower;
+   hashMask = (uint64_t)(buckets-1);
+   hashSize = buckets*HashBucket::Entries;
+   hashTable = allocTable(sizeof(HashBucket)*buckets);
+   if (hashTable == nullptr) {
+       std::cerr << "hash table allocation failed!" << std::endl;
+       hashSize = 0;
+   }
+#ifdef NUMA
+   else {
+       applyNumaPolicy();
+   }
+#endif
+   hash_init_done++;
+}
+
+#ifdef NUMA
+void Hash::applyNumaPolicy()
+{
+   numaPolicy = NumaPolicy::FirstTouch;
+   if (topo == nullptr) return;
+   const std::string &policy = globals::options.search.hash_numa_policy;
+   numaNodes = std::min<unsigned>(topo->nodeCount(),Constants::MaxNumaNodes);
+   switch(pageType) {
+   case PageType::Huge1G:
+      pageShift = 30;
+      break;
+   case PageType::Huge2M:
+   case PageType::TransparentHuge:
+      pageShift = 21;
+      break;
+   default:
+      pageShift = 12;
+   }
+   const size_t buckets = hashSize/HashBucket::Entries;
+   const size_t bytes = buckets*sizeof(HashBucket);
+   // This is done before the table is first touched (cleared), so
+   // no pages actually need to be migrated.
+   if (policy == "interleave") {
+      if (topo->interleaveMemory(hashTable,bytes)) {
+         std::cerr << "warning: failed to interleave hash table memory" << std::endl;
          return;
       }
-      unsigned hashPower;
-      for (hashPower = 1; hashPower < 64; hashPower++) {
-          if ((1ULL << hashPower) > hashSize) {
-              hashPower--;
-              break;
-          }
-      }
-      hashSize = 1ULL << hashPower;
-      hashMask = (uint64_t)(hashSize-1);
-      size_t hashSizePlus = hashSize + MaxRehash;
-      ALIGNED_MALLOC(hashTable,
-         HashEntry,
-         sizeof(HashEntry)*hashSizePlus,128);
-      if (hashTable == nullptr) {
-          std::cerr << "hash table allocation failed!" << std::endl;
-          hashSize = 0;
+      numaPolicy = NumaPolicy::Interleave;
+   }
+   else if (policy == "stripe") {
+      // Divide the table into equal parts on page boundaries, one
+      // part per node.
+      const size_t pageBuckets = std::max<size_t>(1,(size_t(1) << pageShift)/sizeof(HashBucket));
+      stripeBuckets = (buckets + numaNodes - 1)/numaNodes;
+      stripeBuckets = pageBuckets*((stripeBuckets + pageBuckets - 1)/pageBuckets);
+      for (unsigned node = 0; node < numaNodes; node++) {
+         const size_t first = node*stripeBuckets;
+         if (first >= buckets) break;
+         const size_t n = std::min<size_t>(stripeBuckets,buckets-first);
+         if (topo->bindMemoryToNode(hashTable+first,n*sizeof(HashBucket),node)) {
+            std::cerr << "warning: failed to bind hash table memory to node " << node << std::endl;
+            return;
+         }
       }
-      clearHash();
-      hash_init_done++;
+      numaPolicy = NumaPolicy::Stripe;
    }
 }
+#endif
 
 void Hash::resizeHash(size_t bytes)
 {
@@ -63,25 +293,164 @@ void Hash::resizeHash(size_t bytes)
 
 void Hash::freeHash()
 {
-   ALIGNED_FREE(hashTable);
+   freeTable();
    hash_init_done = 0;
 }
 
 
 void Hash::clearHash()
+{
+   clearSlice(0,1);
+   clearDone();
+}
+
+void Hash::clearSlice(unsigned index, unsigned n)
 {
    if (hashSize == 0) return;
-   hashFree = hashSize;
+   // Divide the table on 2MB boundaries where possible, so that each
+   // page is first touched by only one thread.
+   const size_t buckets = hashSize/HashBucket::Entries;
+   const size_t chunkSize = std::max<size_t>(1,std::min<size_t>(buckets,2*1024*1024/sizeof(HashBucket)));
+   const size_t chunks = buckets/chunkSize;
+   const size_t first = chunkSize*((chunks*index)/n);
+   const size_t last = chunkSize*((chunks*(index+1))/n);
    HashEntry empty;
-   for (size_t i = 0; i < hashSize; i++) {
-       hashTable[i] = empty;
+   for (size_t i = first; i < last; i++) {
+       for (HashEntry &entry : hashTable[i].entries) {
+           entry = empty;
+       }
    }
+}
+
+void Hash::clearDone()
+{
+   if (hashSize == 0) return;
+   hashFree = hashSize;
    if (globals::options.learning.position_learning) {
       loadLearnInfo();
-    }
+   }
 }
 
 
+bool Hash::save(const std::string &fileName, unsigned age, std::string &err) const
+{
+   if (hashSize == 0) {
+      err = "no hash table";
+      return false;
+   }
+   HashFileHeader header;
+   memset(&header, '\0', sizeof(header));
+   memcpy(header.magic, HASH_FILE_MAGIC, sizeof(header.magic));
+   header.version = HASH_FILE_VERSION;
+   header.entrySize = sizeof(HashEntry);
+   header.bucketSize = sizeof(HashBucket);
+   header.bucketEntries = HashBucket::Entries;
+   header.buckets = hashSize/HashBucket::Entries;
+   header.hashFree = hashFree;
+   header.keyCheck = hashKeyCheck();
+   header.age = age;
+   // Write to a temporary file and then rename it. The target may be
+   // currently mapped (see load), and must not be truncated in place.
+   const std::string tmpName(fileName + ".tmp");
+   std::ofstream out(tmpName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+   if (!out.good()) {
+      err = "cannot open " + tmpName;
+      return false;
+   }
+   out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+   out.write(reinterpret_cast<const char*>(hashTable), std::streamsize(sizeof(HashBucket)*header.buckets));
+   out.close();
+   if (out.fail()) {
+      err = "error writing " + tmpName;
+      std::remove(tmpName.c_str());
+      return false;
+   }
+#ifdef _WIN32
+   std::remove(fileName.c_str());
+#endif
+   if (std::rename(tmpName.c_str(), fileName.c_str())) {
+      err = "cannot rename " + tmpName + " to " + fileName;
+      std::remove(tmpName.c_str());
+      return false;
+   }
+   return true;
+}
+
+bool Hash::load(const std::string &fileName, unsigned &age, std::string &err)
+{
+   if (hashSize == 0) {
+      err = "no hash table";
+      return false;
+   }
+   std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+   if (!in.good()) {
+      err = "cannot open " + fileName;
+      return false;
+   }
+   HashFileHeader header;
+   in.read(reinterpret_cast<char*>(&header), sizeof(header));
+   const size_t buckets = hashSize/HashBucket::Entries;
+   if (in.fail() || memcmp(header.magic, HASH_FILE_MAGIC, sizeof(header.magic))) {
+      err = fileName + " is not a hash file";
+      return false;
+   }
+   if (header.version != HASH_FILE_VERSION ||
+       header.entrySize != sizeof(HashEntry) ||
+       header.bucketSize != sizeof(HashBucket) ||
+       header.bucketEntries != HashBucket::Entries ||
+       header.keyCheck != hashKeyCheck()) {
+      err = fileName + " was written by an incompatible version";
+      return false;
+   }
+   if (header.buckets != buckets) {
+      std::stringstream msg;
+      msg << fileName << " is for a " << header.buckets*sizeof(HashBucket)/(1024*1024) <<
+         " MB hash table, current size differs";
+      err = msg.str();
+      return false;
+   }
+   if (header.age > HashEntry::MAX_AGE || header.hashFree > hashSize) {
+      err = fileName + " has an invalid header";
+      return false;
+   }
+   const size_t tableBytes = sizeof(HashBucket)*buckets;
+#ifdef _WIN32
+   in.read(reinterpret_cast<char*>(hashTable), std::streamsize(tableBytes));
+   if (in.fail()) {
+      err = "error reading " + fileName;
+      // contents are now undefined
+      clearHash();
+      return false;
+   }
+#else
+   in.close();
+   int fd = open(fileName.c_str(), O_RDONLY);
+   struct stat st;
+   if (fd == -1 || fstat(fd, &st) || size_t(st.st_size) != sizeof(header) + tableBytes) {
+      if (fd != -1) close(fd);
+      err = fileName + " is truncated or unreadable";
+      return false;
+   }
+   // Private mapping: entries are paged in from the file on first
+   // access, and updates do not modify the file.
+   void *mem = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (mem == MAP_FAILED) {
+      err = "cannot map " + fileName;
+      return false;
+   }
+   freeTable();
+   mapBase = mem;
+   mapSize = size_t(st.st_size);
+   hashTable = reinterpret_cast<HashBucket*>(static_cast<char*>(mem) + sizeof(header));
+   pageType = PageType::Mapped;
+#endif
+   hashFree = size_t(header.hashFree);
+   age = header.age;
+   return true;
+}
+
 void Hash::loadLearnInfo()
 {
    if (hashSize && globals::options.learning.position_learning) {
@@ -1,4 +1,4 @@
-// Copyright 1992, 1999, 2011-2015, 2017-2019, 2021 by Jon Dart.  All Rights Reserved.
+// Copyright 1992, 1999, 2011-2015, 2017-2019, 2021-2022 by Jon Dart.  All Rights Reserved.
 
 #ifndef _HASH_H
 #define _HASH_H
@@ -7,69 +7,85 @@
 #include "board.h"
 #include "legal.h"
 
+#include <algorithm>
 #include <climits>
 #include <cstddef>
+#include <ostream>
+#include <string>
 
 extern const hash_t rep_codes[3];
 
+#ifdef NUMA
+class Topology;
+#endif
+
+// Compressed transposition table entry (10 bytes). Entries are grouped
+// into 64-byte buckets (see HashBucket below), so that a probe touches
+// exactly one cache line.
 class HashEntry {
 
 public:
 
-    // Contents of the flag field
+    // Contents of the flag field (low-order bits of ageFlags; the
+    // high-order bits hold the age).
     enum {
-        TYPE_MASK = 0x7,
-        TB_MASK = 0x08,
-        LEARNED_MASK = 0x10
+        TYPE_MASK = 0x3,
+        TB_MASK = 0x04,
+        LEARNED_MASK = 0x08
     };
 
     static const int QSEARCH_CHECK_DEPTH = -1;
     static const int QSEARCH_NO_CHECK_DEPTH = -2;
 
+    // Number of bits available for the age. Age 0 is reserved for
+    // permanent (learned) entries, so searches cycle through 1..MAX_AGE.
+    static constexpr unsigned AGE_BITS = 4;
+    static constexpr unsigned MAX_AGE = (1U << AGE_BITS) - 1;
+
     // Only the first 4 values are actually stored - Invalid indicates
     // a hash hit with inadequate depth; NoHit indicates failure to find
     // a hash match.
     enum ValueType { Valid, UpperBound, LowerBound, Eval, Invalid, NoHit };
 
     HashEntry() {
-        contents.depth = 0;
-        contents.age = 0;
-        contents.flags = Eval;
-        contents.start = contents.dest = InvalidSquare;
-        contents.promotion = Empty;
-        contents.start = InvalidSquare;
-        contents.value = (stored_score_t) Constants::INVALID_SCORE;
-        setEffectiveHash(0,Constants::INVALID_SCORE);
+        packedMove = 0;
+        value = (int16_t)Constants::INVALID_SCORE;
+        static_value = (int16_t)Constants::INVALID_SCORE;
+        depth8 = 0;
+        ageFlags = Eval;
+        setEffectiveHash(0);
     }
 
     HashEntry(hash_t hash, score_t val, score_t staticValue, int depth,
               ValueType type, unsigned age, uint8_t flags = 0,
               Move bestMove = NullMove) {
-        assert(depth+2 >= 0 && depth+2 < 256);
-        contents.depth = (uint8_t)(depth+2);
-        contents.age = (uint8_t) age;
-        contents.flags = (uint8_t) (type | flags);
-        contents.start = (uint8_t) StartSquare(bestMove);
-        contents.dest = (uint8_t) DestSquare(bestMove);
-        contents.promotion = (uint8_t) PromoteTo(bestMove);
-        contents.value = stored_score_t(val);
-        setEffectiveHash(hash,staticValue);
+        assert(depth+DEPTH_BIAS > 0 && depth+DEPTH_BIAS < 256);
+        assert(age <= MAX_AGE);
+        depth8 = (uint8_t)(depth+DEPTH_BIAS);
+        ageFlags = (uint8_t)((age << FLAG_BITS) | type | flags);
+        packedMove = packMove(bestMove);
+        value = (int16_t)val;
+        static_value = (int16_t)staticValue;
+        setEffectiveHash(hash);
     }
 
+    // Only a small part of the hash code is stored, so any key value
+    // can belong to a real position: empty entries are marked by a
+    // depth field of 0 instead.
     int empty() const {
-        return getEffectiveHash() == 0x0ULL;
+        return depth8 == 0;
     }
 
     void clear() {
-        hc = 0x0ULL;
+        depth8 = 0;
     }
 
     int depth() const {
-        return (int)contents.depth - 2;
+        return (int)depth8 - DEPTH_BIAS;
     }
 
     score_t getValue() const {
-        return score_t(contents.value);
+        return score_t(value);
     }
 
     // Get value correcting mate scores for ply
@@ -101,45 +117,45 @@ public:
     }
 
     score_t staticValue() const {
-        // assumes 2's complement machine
-        unsigned bits = unsigned(hc & STATIC_VALUE_MASK);
-        if (bits & 0x8000)
-            return score_t(-32768 + (bits & 0x7fff));
-        else
-            return score_t(bits & 0x7fff);
+        return score_t(static_value);
     }
 
     void setValue(score_t score) {
-        contents.value = (stored_score_t) score;
+        value = (int16_t)score;
     }
 
     ValueType type() const {
-        return (ValueType)(contents.flags & TYPE_MASK);
+        return (ValueType)(ageFlags & TYPE_MASK);
     }
 
     unsigned age() const {
-        return (int)contents.age;
+        return (unsigned)(ageFlags >> FLAG_BITS);
     }
 
+    // Note: caller must re-validate the entry with setEffectiveHash
+    // after changing the age.
     void setAge(unsigned age) {
-        contents.age = (uint8_t) age;
+        assert(age <= MAX_AGE);
+        ageFlags = (uint8_t)((age << FLAG_BITS) | flags());
     }
 
     int learned() const {
-        return (int)((contents.flags & LEARNED_MASK) != 0);
+        return (int)((ageFlags & LEARNED_MASK) != 0);
     }
 
     int tb() const {
-        return (int)((contents.flags & TB_MASK) != 0);
+        return (int)((ageFlags & TB_MASK) != 0);
     }
 
     uint8_t flags() const {
-        return contents.flags;
+        return (uint8_t)(ageFlags & FLAG_MASK);
     }
 
     Move bestMove(const Board &b) const {
-        Move m = CreateMove(b,(Square)contents.start,(Square)contents.dest,
-                            (PieceType)contents.promotion);
+        if (packedMove == 0) return NullMove;
+        Move m = CreateMove(b,(Square)(packedMove & 0x3f),
+                            (Square)((packedMove >> 6) & 0x3f),
+                            (PieceType)(packedMove >> 12));
         return validMove(b,m) ? m : NullMove;
     }
 
@@ -149,65 +165,101 @@ public:
     }
 
     int operator == (const hash_t hash) const {
-        return getEffectiveHash() == (hash & HASH_MASK);
+        return !empty() && getEffectiveHash() == partialKey(hash);
     }
 
     int operator != (const hash_t hash) const {
-        return getEffectiveHash() != (hash & HASH_MASK);
+        return !(*this == hash);
     }
 
-    hash_t getEffectiveHash() const {
-        return (hc ^ val) & HASH_MASK;
+    uint16_t getEffectiveHash() const {
+        return key ^ dataCheck();
     }
 
-    void setEffectiveHash(hash_t hash, score_t static_score) {
-        hc = ((hash ^ val) & HASH_MASK) | (uint16_t)static_score;
+    void setEffectiveHash(hash_t hash) {
+        key = partialKey(hash) ^ dataCheck();
+    }
+
+    // Index bits are taken from the low-order end of the hash code, so
+    // the high-order bits serve as the partial key stored in the entry.
+    static uint16_t partialKey(hash_t hash) {
+        return (uint16_t)(hash >> 48);
     }
 
 protected:
 
-    static const hash_t HASH_MASK = 0xffffffffffff0000;
-    static const hash_t STATIC_VALUE_MASK = ~HASH_MASK;
+    // Added to the depth when stored, so that every stored entry has
+    // a non-zero depth field (see empty()).
+    static constexpr int DEPTH_BIAS = 3;
 
-#ifdef __INTEL_COMPILER
-#pragma pack(push,1)
-#endif
-    struct Contents
-    BEGIN_PACKED_STRUCT
-    stored_score_t value;
-    uint8_t depth;
-    uint8_t age;
-    uint8_t flags;
-    signed char start, dest, promotion;
-    END_PACKED_STRUCT
-
-#ifdef __INTEL_COMPILER
-#pragma pack(pop)
-#endif
-    union
-    {
-        Contents contents;
-        uint64_t val;
-    };
+    static constexpr unsigned FLAG_BITS = 4;
+    static constexpr uint8_t FLAG_MASK = (1U << FLAG_BITS) - 1;
 
-    // static value is packed in the low-order hash bits
-    uint64_t hc;
+    // The stored key is xor'd with the rest of the entry. The entry is
+    // read and written without locking, and a torn copy (key from one
+    // position, data from another) will then fail the key comparison.
+    uint16_t dataCheck() const {
+        return packedMove ^ (uint16_t)value ^ (uint16_t)static_value ^
+            (uint16_t)((depth8 << 8) | ageFlags);
+    }
+
+    // start, dest and promotion in 15 bits. 0 is used for NullMove
+    // (a1-a1 is not a legal move).
+    static uint16_t packMove(Move m) {
+        if (IsNull(m)) return 0;
+        return (uint16_t)(StartSquare(m) | (DestSquare(m) << 6) |
+                          (PromoteTo(m) << 12));
+    }
+
+    uint16_t key;
+    uint16_t packedMove;
+    int16_t value;
+    int16_t static_value;
+    uint8_t depth8;
+    uint8_t ageFlags;
+};
+
+// A bucket of compressed entries occupying one 64-byte cache line.
+struct HashBucket {
+    static constexpr int Entries = 6;
+    static constexpr size_t Size = 64;
+
+    HashEntry entries[Entries];
+    uint8_t padding[Size - Entries*sizeof(HashEntry)];
 };
 
+static_assert(sizeof(HashEntry) == 10, "unexpected HashEntry size");
+static_assert(sizeof(HashBucket) == HashBucket::Size, "HashBucket must fill one cache line");
+
 class Hash {
 
   friend class Scoring;
  public:
+    // Type of memory backing the table
+    enum class PageType { Normal, TransparentHuge, Huge2M, Huge1G, Mapped };
+
     Hash();
 
+    // allocate and clear the table
     void initHash(size_t bytes);
 
+    // allocate the table without clearing it. The caller must clear it
+    // (via clearHash, or clearSlice+clearDone) before use.
+    void allocHash(size_t bytes);
+
     void resizeHash(size_t bytes);
 
     void freeHash();
 
     void clearHash();
 
+    // Clear part "index" of "n" roughly equal-sized parts of the table,
+    // so that the table can be cleared by multiple threads. After all
+    // parts are cleared, call clearDone.
+    void clearSlice(unsigned index, unsigned n);
+
+    void clearDone();
+
     // put info from the external permanent hash table into the
     // in-memory hash table
     void loadLearnInfo();
@@ -217,11 +269,9 @@ class Hash {
                                     HashEntry &he)
     {
         if (!hashSize) return HashEntry::NoHit;
-        int probe = (int)(hashCode & hashMask);
-
-        HashEntry *p = &hashTable[probe];
+        HashEntry *p = hashTable[hashCode & hashMask].entries;
         HashEntry *hit = nullptr;
-        for (int i = MaxRehash; i != 0; --i, p++) {
+        for (int i = HashBucket::Entries; i != 0; --i, p++) {
             // Copy hashtable entry before hash test below (avoids
             // race where entry is validated, then changed).
             HashEntry entry(*p);
@@ -230,7 +280,7 @@ class Hash {
                 // so update the age to discourage replacement:
                 if (entry.age() && (entry.age() != age)) {
                    entry.setAge(age);
-                   entry.setEffectiveHash(hashCode,entry.staticValue());
+                   entry.setEffectiveHash(hashCode);
                    *p = entry;
                 }
                 hit = p;
@@ -262,15 +312,14 @@ class Hash {
                    Move best_move) {
 
         if (!hashSize) return;
-        int probe = (int)(hashCode & hashMask);
-        HashEntry *p = &hashTable[probe];
+        HashEntry *p = hashTable[hashCode & hashMask].entries;
 
         HashEntry *best = nullptr;
         assert(value >= SHRT_MIN && value <= SHRT_MAX);
         // Of the positions that hash to the same locations
         // as this one, find the best one to replace.
         score_t maxScore = score_t(-Constants::MaxPly*DEPTH_INCREMENT);
-        for (int i = MaxRehash; i != 0; --i) {
+        for (int i = HashBucket::Entries; i != 0; --i) {
             HashEntry &q = *p;
 
             if (q.empty()) {
@@ -304,10 +353,72 @@ class Hash {
        }
     }
 
+    // Fetch the bucket for hashCode into cache, in advance of a
+    // probe.
+    void prefetch(hash_t hashCode) const {
+        if (hashSize) PREFETCH(&hashTable[hashCode & hashMask]);
+    }
+
     size_t getHashSize() const {
         return hashSize;
     }
 
+    PageType getPageType() const {
+        return pageType;
+    }
+
+    static const char *pageTypeImage(PageType type);
+
+#ifdef NUMA
+    // Placement of the table across NUMA nodes (see the
+    // search.hash_numa_policy option)
+    enum class NumaPolicy { FirstTouch, Interleave, Stripe };
+
+    // Set the topology used to place the table in memory. Takes
+    // effect when the table is next allocated.
+    void setTopology(Topology *t) {
+        topo = t;
+    }
+
+    NumaPolicy getNumaPolicy() const {
+        return numaPolicy;
+    }
+
+    unsigned getNumaNodes() const {
+        return numaNodes;
+    }
+
+    // Logical index of the node holding the bucket for hashCode, or
+    // -1 if not known (first-touch placement).
+    int nodeOf(hash_t hashCode) const {
+        const size_t index = hashCode & hashMask;
+        switch (numaPolicy) {
+        case NumaPolicy::Interleave:
+            // Linux interleaves pages by their offset in the mapping
+            return int((reinterpret_cast<uintptr_t>(hashTable + index) >> pageShift) % numaNodes);
+        case NumaPolicy::Stripe:
+            return int(std::min<size_t>(index/stripeBuckets,numaNodes-1));
+        default:
+            return -1;
+        }
+    }
+#endif
+
+    // Output size and page type (for diagnostics)
+    void printAllocation(std::ostream &) const;
+
+    // Write the table to a file, preceded by a header giving the
+    // entry layout, table size and current age. Returns false and
+    // sets err on failure.
+    bool save(const std::string &fileName, unsigned age, std::string &err) const;
+
+    // Replace the table contents with a snapshot written by save().
+    // The snapshot must match the current entry layout and table
+    // size, else it is rejected. Where supported, the file is
+    // memory-mapped copy-on-write, so pages are read in on first
+    // use. On success, sets age to the snapshot's age.
+    bool load(const std::string &fileName, unsigned &age, std::string &err);
+
     // Percent full (percentage x 10)
     int pctFull() const {
         if (hashSize == 0)
@@ -317,15 +428,42 @@ class Hash {
     }
 
 private:
-    score_t replaceScore(const HashEntry &pos, int age) const {
-        return score_t((std::abs((int)pos.age()-(int)age)<<12) - pos.depth());
+    HashBucket *allocTable(size_t bytes);
+
+    void freeTable();
+
+#ifdef NUMA
+    // Bind the newly allocated table to nodes according to the
+    // search.hash_numa_policy option
+    void applyNumaPolicy();
+#endif
+
+    // Searches since the entry was stored: ages cycle through
+    // 1..MAX_AGE, so this is the distance modulo MAX_AGE.
+    static unsigned ageDistance(unsigned entryAge, unsigned age) {
+        return (age + HashEntry::MAX_AGE - entryAge) % HashEntry::MAX_AGE;
     }
 
-    HashEntry *hashTable;
+    score_t replaceScore(const HashEntry &pos, unsigned age) const {
+        return score_t((int(ageDistance(pos.age(),age))<<12) - pos.depth());
+    }
+
+    HashBucket *hashTable;
+    // hashSize and hashFree are counts of entries, not buckets
     size_t hashSize, hashFree;
     hash_t hashMask;
-    static const int MaxRehash = 4;
     int hash_init_done;
+    PageType pageType;
+    // start and length of the file mapping, if pageType is Mapped
+    void *mapBase;
+    size_t mapSize;
+#ifdef NUMA
+    Topology *topo;
+    NumaPolicy numaPolicy; // policy in effect for the current table
+    unsigned numaNodes;
+    unsigned pageShift; // log2 of the page size
+    size_t stripeBuckets; // buckets per node, for the Stripe policy
+#endif
 };
 
 #endif
@@ -29,8 +29,9 @@ static FORCEINLINE void swap( Move moves[], int scores[], int i, int j)
 RootMoveGenerator::RootMoveGenerator(const Board &board,
                                      SearchContext *s,
                                      Move pvMove,
-                                     int trace)
-    : MoveGenerator(board,s,nullptr,0,pvMove,trace),
+                                     int trace,
+                                     bool legal)
+    : MoveGenerator(board,s,nullptr,0,pvMove,trace,legal),
      excluded(0)
 {
    batch = moves;
@@ -40,7 +41,7 @@ RootMoveGenerator::RootMoveGenerator(const Board &board,
       moveList.push_back(me);
    }
    int j = batch_count;
-   if (board.checkStatus() != InCheck) {
+   if (!legal && board.checkStatus() != InCheck) {
       // exclude illegal moves
       const BoardState state(board.state);
       Board tmp(board);
@@ -204,7 +205,7 @@ Move MoveGenerator::nextEvasion(int &ord) {
    if (batch_count==0) {
      if (phase == START_PHASE) {
         ++phase;
-        if (!IsNull(hashMove)) {
+        if (!IsNull(hashMove) && (!legal || mg::isLegal(board,hashMove,pinned))) {
            ord = order++;
            assert(ord<Constants::MaxMoves);
            SetPhase(hashMove,HASH_MOVE_PHASE);
@@ -287,7 +288,7 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
       switch(phase) {
          case HASH_MOVE_PHASE:
          {
-            if (!IsNull(hashMove)) {
+            if (!IsNull(hashMove) && (!legal || mg::isLegal(board,hashMove,pinned))) {
                *moves = hashMove;
                SetPhase(*moves,phase);
 #ifdef _TRACE
@@ -305,6 +306,9 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
          case WINNING_CAPTURE_PHASE:
          {
             numMoves = mg::generateCaptures(board,moves,ply==0);
+            if (legal) {
+               numMoves = mg::filterLegal(board,moves,numMoves,pinned);
+            }
             mg::initialSortCaptures(moves,numMoves);
             index = 0;
             break;
@@ -314,7 +318,8 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
             if (!context) continue;
             context->getKillers(ply,killer1,killer2);
             if (!IsNull(killer1) && !MovesEqual(hashMove,killer1)) {
-               if (validMove(board,killer1)) {
+               if (validMove(board,killer1) &&
+                   (!legal || mg::isLegal(board,killer1,pinned))) {
                   SetPhase(killer1,KILLER1_PHASE);
                   moves[numMoves++] = killer1;
                   index = 0;
@@ -326,7 +331,8 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
          {
             if (!context) continue;
             if (!IsNull(killer2) && !MovesEqual(hashMove,killer2)) {
-               if (validMove(board,killer2)) {
+               if (validMove(board,killer2) &&
+                   (!legal || mg::isLegal(board,killer2,pinned))) {
                   SetPhase(killer2,KILLER2_PHASE);
                   moves[numMoves++] = killer2;
                   index = 0;
@@ -339,6 +345,9 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
          case HISTORY_PHASE:
          {
             numMoves = mg::generateNonCaptures(board,moves);
+            if (legal) {
+               numMoves = mg::filterLegal(board,moves,numMoves,pinned);
+            }
             if (numMoves) {
                Move counter(context && node && ply > 0 ? context->getCounterMove(board,(node-1)->last_move) :
                             NullMove);
@@ -391,7 +400,7 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
 
 MoveGenerator::MoveGenerator( const Board &ABoard,
                               SearchContext *s, NodeInfo *n, unsigned curr_ply, Move pvMove,
-                              int trace)
+                              int trace, bool legalOnly)
     : board(ABoard),
       context(s),
       node(n),
@@ -404,8 +413,12 @@ MoveGenerator::MoveGenerator( const Board &ABoard,
       forced(0),
       phase(START_PHASE),
       hashMove(pvMove),
-      master(trace)
+      master(trace),
+      legal(legalOnly)
 {
+   if (legal) {
+      pinned = mg::pinnedPieces(board);
+   }
 }
 
 unsigned MoveGenerator::generateAllMoves(Move *moves,int repeatable)
@@ -418,6 +431,9 @@ unsigned MoveGenerator::generateAllMoves(Move *moves,int repeatable)
    else {
       numMoves += mg::generateCaptures(board,moves+numMoves,ply==0);
       numMoves += mg::generateNonCaptures(board,moves+numMoves);
+      if (legal) {
+         numMoves = mg::filterLegal(board,moves,numMoves,pinned);
+      }
    }
    if (repeatable) {
       int scores[Constants::MaxMoves];
@@ -442,23 +458,26 @@ unsigned MoveGenerator::generateAllMoves(Move *moves,int repeatable)
    return numMoves;
 }
 
-uint64_t RootMoveGenerator::perft(Board &b, int depth) {
+uint64_t RootMoveGenerator::perft(Board &b, int depth, bool legal) {
    if (depth == 0) return 1;
 
+   Move moves[Constants::MaxMoves];
+   MoveGenerator mg(b,nullptr,nullptr,0,NullMove,0,legal);
+   const unsigned n = mg.generateAllMoves(moves,0);
+   if (legal && depth == 1) {
+      // bulk count
+      return n;
+   }
    uint64_t nodes = 0ULL;
-   Move m;
-   RootMoveGenerator mg(b);
+   const bool inCheck = b.checkStatus() == InCheck;
    BoardState state = b.state;
-   int order;
-   while ((m = mg.nextMove(order)) != NullMove) {
-      if (depth > 1) {
-         b.doMove(m);
-         nodes += perft(b,depth-1);
-         b.undoMove(m,state);
-      } else {
-         // skip do/undo
-         nodes++;
+   for (unsigned i = 0; i < n; i++) {
+      const Move m = moves[i];
+      b.doMove(m);
+      if (legal || b.wasLegal(m,inCheck)) {
+         nodes += perft(b,depth-1,legal);
       }
+      b.undoMove(m,state);
    }
    return nodes;
 }
@@ -487,6 +506,161 @@ int RootMoveGenerator::rank_root_moves()
 #endif
 }
 
+// Shift "b" "n" squares forward from the point of view of "side".
+template <ColorType side>
+static FORCEINLINE Bitboard forward(Bitboard b, int n) {
+   if constexpr (side == White) b.shl(n); else b.shr(n);
+   return b;
+}
+
+template <ColorType side>
+static FORCEINLINE unsigned generatePawnNonCaptures(const Board &board, Move *moves)
+{
+   constexpr int step = side == White ? 8 : -8;
+   unsigned numMoves = 0;
+   Bitboard pawns(forward<side>(board.pawn_bits[side],8));
+   // exclude promotions
+   pawns &= ~(board.allOccupied | Attacks::rank_mask[side == White ? 7 : 0]);
+   Square sq;
+   while (pawns.iterate(sq)) {
+      moves[numMoves++] = CreateMove(sq-step,sq,Pawn);
+      if (Rank<side>(sq)==3 && board[sq+step] == EmptyPiece)
+         moves[numMoves++] = CreateMove(sq-step,sq+step,Pawn);
+   }
+   return numMoves;
+}
+
+template <ColorType side>
+static FORCEINLINE unsigned generatePawnCaptures(const Board &board, Move *moves, bool allPromotions, const Bitboard &targets)
+{
+   constexpr ColorType oside = side == White ? Black : White;
+   constexpr int step = side == White ? 8 : -8;
+   unsigned numMoves = 0;
+   const Bitboard &pawns = board.pawn_bits[side];
+   auto addPromotions = [&](Square start, Square dest) {
+      moves[numMoves++] =
+         CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
+      moves[numMoves++] =
+         CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
+      if (allPromotions) {
+         moves[numMoves++] =
+            CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
+         moves[numMoves++] =
+            CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
+      }
+   };
+   // captures toward the h-file for White, the a-file for Black
+   // (7 squares forward), then toward the other edge (9 squares
+   // forward). Captures that would wrap around the board are masked
+   // off.
+   constexpr uint64_t wrap7 = side == White ? 0x8080808080808080ULL : 0x0101010101010101ULL;
+   constexpr uint64_t wrap9 = side == White ? 0x0101010101010101ULL : 0x8080808080808080ULL;
+   Square dest;
+   for (int n : {7, 9}) {
+      Bitboard pawns1(forward<side>(pawns,n));
+      pawns1 &= ~(n == 7 ? wrap7 : wrap9);
+      pawns1 &= board.occupied[oside];
+      while (pawns1.iterate(dest)) {
+         const Square start = side == White ? dest-n : dest+n;
+         if (Rank<side>(start) == 7) {
+            addPromotions(start,dest);
+         }
+         else if (targets.isSet(dest)) {
+            moves[numMoves++] =
+               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]));
+         }
+      }
+   }
+   // non-capture promotions
+   Bitboard pawns1(forward<side>(pawns & Attacks::rank_mask[side == White ? 6 : 1],8));
+   pawns1 &= ~board.allOccupied;
+   while (pawns1.iterate(dest)) {
+      addPromotions(dest-step,dest);
+   }
+   const Square epsq = board.enPassantSq();
+   if (!IsInvalid(epsq) && targets.isSet(epsq)) {
+      assert(TypeOfPiece(board[epsq])==Pawn);
+      dest = epsq + step;
+      if (File(epsq) != 8 && board[epsq + 1] == MakePiece<side>(Pawn)) {
+         if (board[dest] == EmptyPiece)
+            moves[numMoves++] =
+               CreateMove(epsq+1,dest,Pawn,Pawn,Empty,
+               EnPassant);
+      }
+      if (File(epsq) != 1 && board[epsq - 1] == MakePiece<side>(Pawn)) {
+         if (board[dest] == EmptyPiece)
+            moves[numMoves++] =
+               CreateMove(epsq-1,dest,Pawn,Pawn,Empty,
+               EnPassant);
+      }
+   }
+   return numMoves;
+}
+
+// Pawn pushes that give check to the opposing king on "kp".
+template <ColorType side>
+static FORCEINLINE unsigned generatePawnChecks(const Board &board, Move *moves, Square kp)
+{
+   constexpr int step = side == White ? 8 : -8;
+   unsigned numMoves = 0;
+   Square sq;
+   Bitboard pawns(forward<side>(board.pawn_bits[side],8));
+   pawns &= ~(board.allOccupied | Attacks::rank_mask[side == White ? 7 : 0]);
+   Bitboard pawns1(pawns & Attacks::pawn_attacks[kp][side]);
+   while (pawns1.iterate(sq)) {
+      moves[numMoves++] = CreateMove(sq-step,sq,Pawn);
+   }
+   pawns = forward<side>(pawns & Attacks::rank_mask[side == White ? 2 : 5],8);
+   pawns &= ~board.allOccupied;
+   pawns &= Attacks::pawn_attacks[kp][side];
+   while (pawns.iterate(sq)) {
+      moves[numMoves++] = CreateMove(sq-2*step,sq,Pawn);
+   }
+   return numMoves;
+}
+
+// Pawn pushes that block a check along "btwn_squares".
+template <ColorType side>
+static FORCEINLINE unsigned generatePawnInterpositions(const Board &board, Move *moves, const Bitboard &btwn_squares)
+{
+   constexpr int step = side == White ? 8 : -8;
+   unsigned num_moves = 0;
+   Bitboard pawns(forward<side>(board.pawn_bits[side],8));
+   pawns &= ~board.allOccupied;
+   Bitboard pawns1(pawns);
+   pawns &= btwn_squares;
+   Square sq;
+   while (pawns.iterate(sq)) {
+      if (!board.isPinned(side, sq-step, sq)) {
+         if (Rank<side>(sq) == 8) {
+            // interposition is a promotion
+            moves[num_moves++] = CreateMove(
+               sq-step, sq, Pawn, Empty, Queen, Promotion);
+            moves[num_moves++] = CreateMove(
+               sq-step, sq, Pawn, Empty, Rook, Promotion);
+            moves[num_moves++] = CreateMove(
+               sq-step, sq, Pawn, Empty, Knight, Promotion);
+            moves[num_moves++] = CreateMove(
+               sq-step, sq, Pawn, Empty, Bishop, Promotion);
+         }
+         else {
+            moves[num_moves++] = CreateMove(sq-step, sq, Pawn, Empty);
+         }
+      }
+   }
+   pawns1 &= Attacks::rank_mask[side == White ? 2 : 5];
+   if (!pawns1.isClear()) {
+      pawns1 = forward<side>(pawns1,8);
+      pawns1 &= ~board.allOccupied;
+      pawns1 &= btwn_squares;
+      while (pawns1.iterate(sq)) {
+         if (!board.isPinned(side, sq-2*step, sq))
+            moves[num_moves++] = CreateMove(sq-2*step,sq,Pawn,Empty);
+      }
+   }
+   return num_moves;
+}
+
 unsigned mg::generateNonCaptures(const Board &board, Move *moves)
 {
    unsigned numMoves = 0;
@@ -563,30 +737,10 @@ unsigned mg::generateNonCaptures(const Board &board, Move *moves)
       }
    }
    // pawn moves
-   if (board.sideToMove() == White) {
-      Bitboard pawns(board.pawn_bits[White]);
-      pawns.shl8();
-        // exclude promotions
-      pawns &= ~(board.allOccupied | Attacks::rank_mask[7]);
-      Square sq;
-      while (pawns.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq-8,sq,Pawn);
-         if (Rank<White>(sq)==3 && board[sq+8] == EmptyPiece)
-            moves[numMoves++] = CreateMove(sq-8,sq+8,Pawn);
-      }
-   }
-   else {
-      Bitboard pawns(board.pawn_bits[Black]);
-      pawns.shr8();
-        // exclude promotions
-      pawns &= ~(board.allOccupied | Attacks::rank_mask[0]);
-      Square sq;
-      while (pawns.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq+8,sq,Pawn);
-         if (Rank<Black>(sq)==3 && board[sq-8] == EmptyPiece)
-            moves[numMoves++] = CreateMove(sq+8,sq-8,Pawn);
-      }
-   }
+   if (side == White)
+      numMoves += generatePawnNonCaptures<White>(board,moves+numMoves);
+   else
+      numMoves += generatePawnNonCaptures<Black>(board,moves+numMoves);
    return numMoves;
 }
 
@@ -595,177 +749,11 @@ unsigned mg::generateCaptures(const Board &board, Move * moves, bool allPromotio
 {
    unsigned numMoves = 0;
 
-   if (board.sideToMove() == White) {
-      Bitboard pawns(board.pawn_bits[White]);
-      Bitboard pawns1 = pawns;
-      pawns1.shl(7);
-      pawns1 &= ~0x8080808080808080ULL;
-      pawns1 &= board.occupied[Black];
-      Square dest;
-      while (pawns1.iterate(dest)) {
-         Square start = dest-7;
-         if (Rank<White>(start) == 7) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-            if (allPromotions) {
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-            }
-         }
-         else if (targets.isSet(dest)) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]));
-         }
-      }
-      pawns1 = pawns;
-      pawns1.shl(9);
-      pawns1 &= ~0x0101010101010101ULL;
-      pawns1 &= board.occupied[Black];
-      while (pawns1.iterate(dest)) {
-         Square start = dest-9;
-         if (Rank<White>(start) == 7) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-            if (allPromotions) {
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-            }
-         }
-         else if (targets.isSet(dest)) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]));
-         }
-      }
-      pawns1 = pawns;
-      pawns1 &= Attacks::rank_mask[6];
-      pawns1.shl8();
-      pawns1 &= ~board.allOccupied;
-      while (pawns1.iterate(dest)) {
-         Square start = dest - 8;
-         moves[numMoves++] =
-            CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
-         moves[numMoves++] =
-            CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-         if (allPromotions) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-         }
-      }
-      Square epsq = board.enPassantSq();
-      if (!IsInvalid(epsq) && targets.isSet(epsq)) {
-         assert(TypeOfPiece(board[epsq])==Pawn);
-         if (File(epsq) != 8 && board[epsq + 1] == WhitePawn) {
-            dest = epsq + 8;
-            if (board[dest] == EmptyPiece)
-               moves[numMoves++] =
-                  CreateMove(epsq+1,dest,Pawn,Pawn,Empty,
-                  EnPassant);
-         }
-         if (File(epsq) != 1 && board[epsq - 1] == WhitePawn) {
-            dest = epsq + 8;
-            if (board[dest] == EmptyPiece)
-               moves[numMoves++] =
-                  CreateMove(epsq-1,dest,Pawn,Pawn,Empty,
-                  EnPassant);
-         }
-      }
-   }
-   else {
-      Bitboard pawns(board.pawn_bits[Black]);
-      Bitboard pawns1 = pawns;
-      pawns1.shr(7);
-      pawns1 &= ~0x0101010101010101ULL;
-      pawns1 &= board.occupied[White];
-      Square dest;
-      while (pawns1.iterate(dest)) {
-         Square start = dest+7;
-         if (Rank<Black>(start) == 7) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-            if (allPromotions) {
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-            }
-         }
-         else if (targets.isSet(dest)) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]));
-         }
-      }
-      pawns1 = pawns;
-      pawns1.shr(9);
-      pawns1 &= ~0x8080808080808080ULL;
-      pawns1 &= board.occupied[White];
-      while (pawns1.iterate(dest)) {
-         Square start = dest+9;
-         if (Rank<Black>(start) == 7) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-            if (allPromotions) {
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-            }
-         }
-         else if (targets.isSet(dest)) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]));
-         }
-      }
-      pawns1 = pawns;
-      pawns1 &= Attacks::rank_mask[1];
-      pawns1.shr8();
-      pawns1 &= ~board.allOccupied;
-      while (pawns1.iterate(dest)) {
-         Square start = dest + 8;
-         moves[numMoves++] =
-            CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
-         moves[numMoves++] =
-            CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-         if (allPromotions) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-         }
-      }
-      Square epsq = board.enPassantSq();
-      if (!IsInvalid(epsq) && targets.isSet(epsq)) {
-         assert(TypeOfPiece(board[epsq])==Pawn);
-         if (File(epsq) != 8 && board[epsq + 1] == BlackPawn) {
-            dest = epsq - 8;
-            if (board[dest] == EmptyPiece)
-               moves[numMoves++] =
-                  CreateMove(epsq+1,dest,Pawn,Pawn,Empty,
-                  EnPassant);
-         }
-         if (File(epsq) != 1 && board[epsq - 1] == BlackPawn) {
-            dest = epsq - 8;
-            if (board[dest] == EmptyPiece)
-               moves[numMoves++] =
-                  CreateMove(epsq-1,dest,Pawn,Pawn,Empty,
-                  EnPassant);
-         }
-      }
-   }
    const ColorType side = board.sideToMove();
+   if (side == White)
+      numMoves += generatePawnCaptures<White>(board,moves,allPromotions,targets);
+   else
+      numMoves += generatePawnCaptures<Black>(board,moves,allPromotions,targets);
    Bitboard knights(board.knight_bits[side]);
    Square start, dest;
    while (knights.iterate(start)) {
@@ -932,41 +920,90 @@ unsigned mg::generateChecks(const Board &board, Move * moves, const Bitboard &di
       }
    }
    // pawn moves
-   if (board.sideToMove() == White) {
-      Square sq;
-      Bitboard pawns(board.pawn_bits[White]);
-      pawns.shl8();
-      pawns &= ~(board.allOccupied | Attacks::rank_mask[7]);
-      Bitboard pawns1(pawns & Attacks::pawn_attacks[kp][White]);
-      while (pawns1.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq-8,sq,Pawn);
-      }
-      pawns &= Attacks::rank_mask[2];
-      pawns.shl8();
-      pawns &= ~board.allOccupied;
-      pawns &= Attacks::pawn_attacks[kp][White];
-      while (pawns.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq-16,sq,Pawn);
+   if (board.sideToMove() == White)
+      numMoves += generatePawnChecks<White>(board,moves+numMoves,kp);
+   else
+      numMoves += generatePawnChecks<Black>(board,moves+numMoves,kp);
+   return numMoves;
+}
+
+// True if "sq" is attacked by "side" given the occupancy "occ". A
+// piece of "side" on "captured" is not counted as an attacker.
+static FORCEINLINE bool attackedAfter(const Board &board, Square sq, ColorType side,
+                                      const Bitboard &occ, Square captured)
+{
+   const Bitboard mask(~(1ULL << captured));
+   return TEST_MASK(Attacks::pawn_attacks[sq][side],board.pawn_bits[side] & mask) ||
+      TEST_MASK(Attacks::knight_attacks[sq],board.knight_bits[side] & mask) ||
+      Attacks::king_attacks[sq].isSet(board.kingSquare(side)) ||
+      TEST_MASK(Attacks::rookAttacks(sq,occ),(board.rook_bits[side] | board.queen_bits[side]) & mask) ||
+      TEST_MASK(Attacks::bishopAttacks(sq,occ),(board.bishop_bits[side] | board.queen_bits[side]) & mask);
+}
+
+bool mg::isLegal(const Board &board, Move move, const Bitboard &pinned)
+{
+   const ColorType side = board.sideToMove();
+   const ColorType oside = board.oppositeSide();
+   const Square kp = board.kingSquare(side);
+   const Square start = StartSquare(move);
+   const Square dest = DestSquare(move);
+   switch (TypeOfMove(move)) {
+      case KCastle:
+      case QCastle:
+         // squares the King crosses are checked by the move generator
+         // (and by validMove).
+         return board.checkStatus() != InCheck;
+      case EnPassant:
+      {
+         // Two pawns leave the same rank, so recompute all attacks
+         // on the King with the occupancy after the capture.
+         const Square capsq = dest - 8*Direction[side];
+         Bitboard occ(board.allOccupied);
+         occ.clear(start);
+         occ.clear(capsq);
+         occ.set(dest);
+         return !attackedAfter(board,kp,oside,occ,capsq);
       }
+      default:
+         break;
    }
-   else {
-      Square sq;
-      Bitboard pawns(board.pawn_bits[Black]);
-      pawns.shr8();
-      pawns &= ~(board.allOccupied | Attacks::rank_mask[0]);
-      Bitboard pawns1(pawns & Attacks::pawn_attacks[kp][Black]);
-      while (pawns1.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq+8,sq,Pawn);
-      }
-      pawns &= Attacks::rank_mask[2];
-      pawns.shl8();
-      pawns &= ~board.allOccupied;
-      pawns &= Attacks::pawn_attacks[kp][Black];
-      while (pawns.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq+16,sq,Pawn);
+   if (start == kp) {
+      // remove the King so sliders attack through its old square
+      Bitboard occ(board.allOccupied);
+      occ.clear(kp);
+      occ.set(dest);
+      return !attackedAfter(board,dest,oside,occ,dest);
+   }
+   if (pinned.isSet(start) &&
+       Attacks::directions[kp][start] != Attacks::directions[kp][dest]) {
+      // pinned piece leaves the line of the pin
+      return false;
+   }
+   if (board.checkStatus() == InCheck) {
+      // must capture or block a single checking piece
+      Bitboard checkers(board.calcAttacks(kp,oside));
+      if (!checkers.singleBitSet()) return false;
+      const Square source = checkers.firstOne();
+      return dest == source || Attacks::betweenSquares[kp][source].isSet(dest);
+   }
+   return true;
+}
+
+unsigned mg::filterLegal(const Board &board, Move *moves, unsigned n, const Bitboard &pinned)
+{
+   const Square kp = board.kingSquare(board.sideToMove());
+   const bool inCheck = board.checkStatus() == InCheck;
+   unsigned j = 0;
+   for (unsigned i = 0; i < n; i++) {
+      const Move m = moves[i];
+      // Unless in check, only King moves, en passant captures and
+      // moves of pinned pieces need to be tested.
+      if ((!inCheck && StartSquare(m) != kp && !pinned.isSet(StartSquare(m)) &&
+           TypeOfMove(m) != EnPassant) || isLegal(board,m,pinned)) {
+         moves[j++] = m;
       }
    }
-   return numMoves;
+   return j;
 }
 
 void mg::sortMoves(Move moves[], int scores[], unsigned n) {
@@ -1013,78 +1050,10 @@ unsigned mg::generateEvasionsNonCaptures(const Board &board, const mg::EvasionIn
          board.between(source,kp,btwn_squares);
          if (!btwn_squares.isClear()) {
             // blocking pawn moves
-            if (board.sideToMove() == White) {
-               Bitboard pawns(board.pawn_bits[White]);
-               pawns.shl8();
-               pawns &= ~board.allOccupied;
-               Bitboard pawns1(pawns);
-               pawns &= btwn_squares;
-               Square sq;
-               while (pawns.iterate(sq)) {
-                  if (!board.isPinned(board.sideToMove(), sq-8, sq)) {
-                     if (Rank<White>(sq) == 8) {
-                        // interposition is a promotion
-                        moves[num_moves++] = CreateMove(
-                           sq-8, sq, Pawn, Empty, Queen, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq-8, sq, Pawn, Empty, Rook, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq-8, sq, Pawn, Empty, Knight, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq-8, sq, Pawn, Empty, Bishop, Promotion);
-                     }
-                     else {
-                        moves[num_moves++] = CreateMove(sq-8, sq, Pawn, Empty);
-                     }
-                  }
-               }
-               pawns1 &= Attacks::rank_mask[2];
-               if (!pawns1.isClear()) {
-                  pawns1.shl8();
-                  pawns1 &= ~board.allOccupied;
-                  pawns1 &= btwn_squares;
-                  while (pawns1.iterate(sq)) {
-                     if (!board.isPinned(White, sq-16, sq))
-                        moves[num_moves++] = CreateMove(sq-16,sq,Pawn,Empty);
-                  }
-               }
-            }
-            else {
-               Bitboard pawns(board.pawn_bits[Black]);
-               pawns.shr8();
-               pawns &= ~board.allOccupied;
-               Bitboard pawns1(pawns);
-               pawns &= btwn_squares;
-               Square sq;
-               while (pawns.iterate(sq)) {
-                  if (!board.isPinned(Black, sq+8, sq)) {
-                     if (Rank<Black>(sq) == 8) {
-                        // interposition is a promotion
-                        moves[num_moves++] = CreateMove(
-                           sq+8, sq, Pawn, Empty, Queen, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq+8, sq, Pawn, Empty, Rook, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq+8, sq, Pawn, Empty, Knight, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq+8, sq, Pawn, Empty, Bishop, Promotion);
-                     }
-                     else {
-                        moves[num_moves++] = CreateMove(sq+8, sq, Pawn, Empty);
-                     }
-                  }
-               }
-               pawns1 &= Attacks::rank_mask[5];
-               if (!pawns1.isClear()) {
-                  pawns1.shr8();
-                  pawns1 &= ~board.allOccupied;
-                  pawns1 &= btwn_squares;
-                  while (pawns1.iterate(sq)) {
-                     if (!board.isPinned(board.sideToMove(), sq+16, sq))
-                        moves[num_moves++] = CreateMove(sq+16,sq,Pawn,Empty);
-                  }
-               }
-            }
+            if (board.sideToMove() == White)
+               num_moves += generatePawnInterpositions<White>(board,moves+num_moves,btwn_squares);
+            else
+               num_moves += generatePawnInterpositions<Black>(board,moves+num_moves,btwn_squares);
             // other blocking pieces
             Bitboard pieces(board.occupied[board.sideToMove()]);
             pieces &= ~board.pawn_bits[board.sideToMove()];
@@ -42,7 +42,7 @@ namespace mg {
         Square source;
 
         void init(const Board &board) {
-            king_attacks = board.calcAttacks(board.kingSquare(board.sideToMove()), board.oppositeSide());
+            king_attacks = board.checkers();
 #ifdef _DEBUG
             if (king_attacks.isClear()) {
                 assert(0);
@@ -68,6 +68,20 @@ namespace mg {
     extern unsigned generateEvasions(const Board &board, const EvasionInfo &info, Move * moves);
     extern unsigned generateEvasions(const Board &board, const EvasionInfo &info, Move * moves, const Bitboard &mask);
 
+    // Return the pieces of the side to move that are pinned to its King.
+    inline Bitboard pinnedPieces(const Board &board) {
+        return board.pinned();
+    }
+
+    // Return true if the pseudo-legal move "move" does not leave the
+    // side to move in check. "pinned" is the result of pinnedPieces().
+    extern bool isLegal(const Board &board, Move move, const Bitboard &pinned);
+
+    // Remove moves that would leave the King in check from the list
+    // "moves", preserving order. Returns the new count.
+    extern unsigned filterLegal(const Board &board, Move *moves, unsigned n,
+                                const Bitboard &pinned);
+
     extern void initialSortCaptures(Move *moves, unsigned captures);
 
     extern void sortMoves(Move moves[], int scores[], unsigned n);
@@ -89,7 +103,8 @@ class MoveGenerator
          NodeInfo *node = nullptr,
          unsigned ply = 0,
          Move pvMove = NullMove,
-         int trace = 0);
+         int trace = 0,
+         bool legal = false);
 
       // Generate the next move, in sorted order, NullMove if none left
       // "ord" is updated with the index of the move.
@@ -193,6 +208,8 @@ class MoveGenerator
       Move moves[Constants::MaxMoves];
       Move killer1,killer2;
       int master;
+      bool legal; // generate only legal moves
+      Bitboard pinned; // pinned pieces, if legal is set
 
 };
 
@@ -205,7 +222,8 @@ class RootMoveGenerator : public MoveGenerator
       RootMoveGenerator(const Board &board,
          SearchContext *context = nullptr,
          Move pvMove = NullMove,
-         int trace = 0);
+         int trace = 0,
+         bool legal = false);
 
       RootMoveGenerator(const RootMoveGenerator &mg,
                         SearchContext *s);
@@ -263,7 +281,9 @@ class RootMoveGenerator : public MoveGenerator
       }
 
       // enumerate the nodes for a "depth" ply search (for testing).
-      static uint64_t perft(Board &, int depth);
+      // If legal is true, use legal move generation, otherwise
+      // generate pseudo-legal moves and test them after doMove.
+      static uint64_t perft(Board &, int depth, bool legal = false);
 
       score_t getScore(Move m) const noexcept {
          for (auto &it : moveList) {
@@ -301,14 +321,18 @@ class RootMoveGenerator : public MoveGenerator
 class QSearchMoveGenerator 
 {
 public:
-    // Move generation is restricted to captures onto "tgts".
-    QSearchMoveGenerator(const Board &b, Move hash, const Bitboard &tgts) :
-        board(b), index(0), moveCount(0), hashMove(hash), targets(tgts), phase(0)
+    // Move generation is restricted to captures onto "tgts". If
+    // "pins" is non-null, only legal moves are generated: it must
+    // point to the pinned pieces (from mg::pinnedPieces).
+    QSearchMoveGenerator(const Board &b, Move hash, const Bitboard &tgts,
+                         const Bitboard *pins = nullptr) :
+        board(b), index(0), moveCount(0), hashMove(hash), targets(tgts), phase(0),
+        pinned(pins)
     {
     }
     
-    QSearchMoveGenerator(const Board &b, Move hash) :
-        QSearchMoveGenerator(b, hash, b.occupied[b.oppositeSide()]) 
+    QSearchMoveGenerator(const Board &b, Move hash, const Bitboard *pins = nullptr) :
+        QSearchMoveGenerator(b, hash, b.occupied[b.oppositeSide()], pins)
     {
     }
 
@@ -319,7 +343,8 @@ public:
         if (phase == 0) {
             ++phase;
             if (!IsNull(hashMove) &&
-                (IsPromotion(hashMove) || targets.isSet(DestSquare(hashMove)))) {
+                (IsPromotion(hashMove) || targets.isSet(DestSquare(hashMove))) &&
+                (!pinned || mg::isLegal(board, hashMove, *pinned))) {
                 return hashMove;
             }
         }
@@ -327,6 +352,9 @@ public:
             ++phase;
             moveCount = mg::generateCaptures(board, moves, false, targets);
             assert(moveCount <= Constants::MaxCaptures);
+            if (pinned) {
+                moveCount = mg::filterLegal(board, moves, moveCount, *pinned);
+            }
             mg::initialSortCaptures(moves, moveCount);
         }
         while (index < moveCount) {
@@ -345,15 +373,22 @@ private:
     Move hashMove;
     Bitboard targets;
     int phase;
+    const Bitboard *pinned;
 };
 
 class QSearchCheckGenerator 
 {
 public:
-    QSearchCheckGenerator(const Board &board, const Bitboard &pins):
+    // "disc" is the set of discovered check candidates. If "pinned" is
+    // non-null, only legal moves are generated.
+    QSearchCheckGenerator(const Board &board, const Bitboard &disc,
+                          const Bitboard *pinned = nullptr):
         index(0) {
-        moveCount = mg::generateChecks(board, moves, pins);
+        moveCount = mg::generateChecks(board, moves, disc);
         assert(moveCount <= Constants::MaxChecks);
+        if (pinned) {
+            moveCount = mg::filterLegal(board, moves, moveCount, *pinned);
+        }
     }
     
     virtual ~QSearchCheckGenerator() {
@@ -374,9 +409,12 @@ private:
 class ProbCutMoveGenerator 
 {
 public:
-    // Move generation is restricted to captures onto "tgts".
-    ProbCutMoveGenerator(const Board &b, Move hash, const Bitboard &tgts) :
-        board(b), index(0), moveCount(0), hashMove(hash), targets(tgts), phase(0)
+    // Move generation is restricted to captures onto "tgts". If
+    // "pins" is non-null, only legal moves are generated.
+    ProbCutMoveGenerator(const Board &b, Move hash, const Bitboard &tgts,
+                         const Bitboard *pins = nullptr) :
+        board(b), index(0), moveCount(0), hashMove(hash), targets(tgts), phase(0),
+        pinned(pins)
     {
     }
     
@@ -387,7 +425,8 @@ public:
         if (phase == 0) {
             ++phase;
             if (!IsNull(hashMove) &&
-                (IsPromotion(hashMove) || targets.isSet(DestSquare(hashMove)))) {
+                (IsPromotion(hashMove) || targets.isSet(DestSquare(hashMove))) &&
+                (!pinned || mg::isLegal(board, hashMove, *pinned))) {
                 return hashMove;
             }
         }
@@ -398,6 +437,9 @@ public:
                 moveCount = mg::generateEvasionsCaptures(board, info, moves);
             } else {
                 moveCount = mg::generateCaptures(board, moves, false, targets);
+                if (pinned) {
+                    moveCount = mg::filterLegal(board, moves, moveCount, *pinned);
+                }
             }
             assert(moveCount <= Constants::MaxCaptures);
             mg::initialSortCaptures(moves, moveCount);
@@ -418,6 +460,7 @@ private:
     Move hashMove;
     Bitboard targets;
     int phase;
+    const Bitboard *pinned;
 };
 
 inline MoveGenerator::Phase operator++(MoveGenerator::Phase &phase)
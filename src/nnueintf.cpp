@@ -7,13 +7,59 @@ ChessInterface::Iterator::value_type ChessInterface::Iterator::empty_val(nnue::I
 
 nnue::Network::AccumulatorType &ChessInterface::getAccumulator() const
     noexcept {
-    return node()->accum;
+    return *node()->accum;
 }
 
-unsigned ChessInterface::getDirtyNum() const { return node()->dirty_num; }
+void ChessInterface::computeDirty(NodeInfo *node) {
+    if (node->dirty_num < DirtyState::Pending) return;
+    const ColorType side = static_cast<ColorType>(node->dirty_num - DirtyState::Pending);
+    const Move move = node->dirty_move;
+    const Square start = StartSquare(move);
+    const Square dest = DestSquare(move);
+    unsigned num = 0;
+    switch (TypeOfMove(move)) {
+    case KCastle:
+    case QCastle: {
+        const bool kside = TypeOfMove(move) == KCastle;
+        node->dirty[num++] = DirtyState(static_cast<nnue::Square>(start),
+                                        static_cast<nnue::Square>(dest),
+                                        static_cast<nnue::Piece>(MakePiece(King,side)));
+        node->dirty[num++] = DirtyState(static_cast<nnue::Square>(kside ? start + 3 : start - 4),
+                                        static_cast<nnue::Square>(kside ? start + 1 : start - 1),
+                                        static_cast<nnue::Piece>(MakePiece(Rook,side)));
+        break;
+    }
+    case Promotion:
+        node->dirty[num++] = DirtyState(static_cast<nnue::Square>(start),
+                                        nnue::InvalidSquare,
+                                        static_cast<nnue::Piece>(MakePiece(Pawn,side)));
+        node->dirty[num++] = DirtyState(nnue::InvalidSquare,
+                                        static_cast<nnue::Square>(dest),
+                                        static_cast<nnue::Piece>(MakePiece(PromoteTo(move),side)));
+        break;
+    default:
+        node->dirty[num++] = DirtyState(static_cast<nnue::Square>(start),
+                                        static_cast<nnue::Square>(dest),
+                                        static_cast<nnue::Piece>(MakePiece(PieceMoved(move),side)));
+        break;
+    }
+    if (Capture(move) != Empty) {
+        const Square target = TypeOfMove(move) == EnPassant ? dest - 8*Direction[side] : dest;
+        node->dirty[num++] = DirtyState(static_cast<nnue::Square>(target),
+                                        nnue::InvalidSquare,
+                                        static_cast<nnue::Piece>(MakePiece(Capture(move),OppositeColor(side))));
+    }
+    node->dirty_num = num;
+}
+
+unsigned ChessInterface::getDirtyNum() const {
+    computeDirty(node());
+    return node()->dirty_num;
+}
 
 void ChessInterface::getDirtyState(size_t index, nnue::Square &from,
                                    nnue::Square &to, nnue::Piece &p) const {
+    computeDirty(node());
     const DirtyState &state = node()->dirty[index];
     from = state.from;
     to = state.to;
@@ -10,6 +10,10 @@
 struct NodeInfo;
 
 struct DirtyState {
+    // Value of NodeInfo::dirty_num, plus the side that moved, when
+    // the changes are not yet computed from NodeInfo::dirty_move.
+    static constexpr unsigned Pending = 0x100;
+
     nnue::Square from, to;
     nnue::Piece piece;
 
@@ -89,6 +93,10 @@ class ChessInterface {
     nnue::Color stm; // side to move
     int nodeIndex;
 
+    // Compute the changes made by the move leading to "node", if
+    // not already done.
+    static void computeDirty(NodeInfo *node);
+
     class Iterator {
       friend class ChessInterface;
     public:
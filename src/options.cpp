@@ -21,19 +21,21 @@ std::string Options::tbPath() const { return search.syzygy_path; }
 #endif
 
 Options::SearchOptions::SearchOptions()
-    : checks_in_qsearch(1), hash_table_size(32 * 1024 * 1024), can_resign(true),
+    : checks_in_qsearch(1), hash_table_size(32 * 1024 * 1024),
+      hash_file("arasan.hash"), can_resign(true),
       resign_threshold(-500),
 #ifdef SYZYGY_TBS
       use_tablebases(false), syzygy_path("syzygy"), syzygy_50_move_rule(true),
       syzygy_probe_depth(4),
 #endif
-      strength(100), multipv(1), ncpus(1),
+      strength(100), multipv(1), ncpus(1), abdada(false),
+      thread_spin_time(250), legal_movegen(false),
 #ifdef NNUE
       useNNUE(true), pureNNUE(false), nnueFile(""),
 #endif
       easy_plies(3), easy_threshold(200), // centipawns
 #ifdef NUMA
-      set_processor_affinity(false),
+      set_processor_affinity(false), hash_numa_policy("first_touch"),
 #endif
       move_overhead(15), minimum_search_time(10) {
 }
@@ -127,6 +129,8 @@ void Options::set_option(const std::string &name, const std::string &value) {
         setOption<int>(name, value, search.resign_threshold);
     } else if (name == "search.hash_table_size") {
         setMemoryOption(search.hash_table_size, value);
+    } else if (name == "search.hash_file") {
+        search.hash_file = value;
     }
 #ifdef SYZYGY_TBS
     else if (name == "search.use_tablebases") {
@@ -143,6 +147,8 @@ void Options::set_option(const std::string &name, const std::string &value) {
         set_strength_option(name, search.strength, value);
     } else if (name == "search.ncpus") {
         setOption<int>(name, value, search.ncpus);
+    } else if (name == "search.abdada") {
+        setOption<bool>(name, value, search.abdada);
     }
 #ifdef NNUE
     else if (name == "search.useNNUE") {
@@ -154,8 +160,20 @@ void Options::set_option(const std::string &name, const std::string &value) {
 #ifdef NUMA
     else if (name == "search.set_processor_affinity") {
         setOption<bool>(name, value, search.set_processor_affinity);
+    } else if (name == "search.hash_numa_policy") {
+        if (validHashNumaPolicy(value)) {
+            search.hash_numa_policy = value;
+        } else {
+            std::cerr << "warning: invalid value for " << name << ": " << value << std::endl;
+        }
     }
 #endif
+    else if (name == "search.thread_spin_time") {
+        setOption<int>(name, value, search.thread_spin_time);
+    }
+    else if (name == "search.legal_movegen") {
+        setOption<bool>(name, value, search.legal_movegen);
+    }
     else if (name == "search.move_overhead") {
         setOption<int>(name, value, search.move_overhead);
     } else if (name == "search.minimum_search_time") {
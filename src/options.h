@@ -36,6 +36,7 @@ class Options
 
    int checks_in_qsearch;
    size_t hash_table_size;
+   std::string hash_file; // for saving/loading hash table
    bool can_resign;
    int resign_threshold;
 #ifdef SYZYGY_TBS
@@ -47,6 +48,9 @@ class Options
    int strength; // 0 .. 100
    int multipv; // for UCI only
    int ncpus;
+   bool abdada; // defer moves being searched by other threads
+   int thread_spin_time; // max idle spin before blocking, in microseconds
+   bool legal_movegen; // generate only legal moves in the search
 #ifdef NNUE
    bool useNNUE;
    bool pureNNUE;
@@ -56,6 +60,10 @@ class Options
    int easy_threshold; // wide search width in centipawns
 #ifdef NUMA
    bool set_processor_affinity; // lock threads to processors
+   // placement of hash table memory: "first_touch", "interleave"
+   // (pages interleaved across nodes) or "stripe" (an equal part of
+   // the table on each node)
+   std::string hash_numa_policy;
 #endif
    int move_overhead; // in milliseconds
    int minimum_search_time; // in milliseconds
@@ -113,6 +121,13 @@ class Options
 
    static void setMemoryOption(size_t &value, const std::string &valueString);
 
+#ifdef NUMA
+   // true if value is a valid search.hash_numa_policy setting
+   static bool validHashNumaPolicy(const std::string &value) {
+      return value == "first_touch" || value == "interleave" || value == "stripe";
+   }
+#endif
+
    std::string tbPath() const;
 
    // sets options based on a .rc file
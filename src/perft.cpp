@@ -0,0 +1,227 @@
+// Copyright 2022 by Jon Dart. All Rights Reserved
+#include "perft.h"
+#include "globals.h"
+#include "movegen.h"
+#include "notation.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+Perft::PerftOptions::PerftOptions()
+    : threads(std::max<int>(1,globals::options.search.ncpus)),
+      hashSize(0),
+      legal(true)
+{
+}
+
+Perft::Perft(const PerftOptions &options)
+    : opts(options), hashMask(0)
+{
+    if (opts.hashSize >= sizeof(HashEntry)) {
+        // round down to a power of 2 number of entries
+        size_t entries = 1;
+        while (entries*2*sizeof(HashEntry) <= opts.hashSize) entries *= 2;
+        hashTable.reset(new HashEntry[entries]());
+        hashMask = entries-1;
+    }
+}
+
+bool Perft::probe(hash_t hash, int depth, uint64_t &nodes) const
+{
+    const HashEntry &entry = hashTable[hash & hashMask];
+    const uint64_t data = entry.data.load(std::memory_order_relaxed);
+    const uint64_t key = entry.key.load(std::memory_order_relaxed);
+    if ((key ^ data) == hash && int(data & 0xff) == depth) {
+        nodes = data >> 8;
+        return true;
+    }
+    return false;
+}
+
+void Perft::store(hash_t hash, int depth, uint64_t nodes)
+{
+    HashEntry &entry = hashTable[hash & hashMask];
+    const uint64_t data = (nodes << 8) | uint64_t(depth);
+    entry.key.store(hash ^ data, std::memory_order_relaxed);
+    entry.data.store(data, std::memory_order_relaxed);
+}
+
+uint64_t Perft::count(Board &board, int depth)
+{
+    if (depth == 0) return 1;
+    uint64_t nodes = 0ULL;
+    const bool useHash = hashTable && depth > 1;
+    if (useHash && probe(board.hashCode(),depth,nodes)) {
+        return nodes;
+    }
+    Move moves[Constants::MaxMoves];
+    MoveGenerator mg(board,nullptr,nullptr,0,NullMove,0,opts.legal);
+    const unsigned n = mg.generateAllMoves(moves,0);
+    if (opts.legal && depth == 1) {
+        // bulk count
+        return n;
+    }
+    const bool inCheck = board.checkStatus() == InCheck;
+    const BoardState state(board.state);
+    for (unsigned i = 0; i < n; i++) {
+        board.doMove(moves[i]);
+        if (opts.legal || board.wasLegal(moves[i],inCheck)) {
+            nodes += count(board,depth-1);
+        }
+        board.undoMove(moves[i],state);
+    }
+    if (useHash) {
+        store(board.hashCode(),depth,nodes);
+    }
+    return nodes;
+}
+
+Perft::Results Perft::run(const Board &board, int depth)
+{
+    Results results;
+    if (depth < 1) {
+        results.nodes = 1;
+        return results;
+    }
+    const CLOCK_TYPE startTime = getCurrentTime();
+
+    // Work items are the moves of the first two plies (or of the root
+    // only, for shallow trees), identified by the index of their root
+    // move.
+    struct WorkItem
+    {
+        unsigned root;
+        Move first, second;
+    };
+    std::vector<WorkItem> items;
+    Board tmp(board);
+    const BoardState state(tmp.state);
+    RootMoveGenerator rmg(tmp,nullptr,NullMove,0,opts.legal);
+    Move m;
+    int order;
+    while (!IsNull(m = rmg.nextMove(order))) {
+        results.divide.push_back(std::pair<Move,uint64_t>(m,0ULL));
+        const unsigned root = unsigned(results.divide.size()-1);
+        if (depth < 3) {
+            items.push_back(WorkItem{root,m,NullMove});
+            continue;
+        }
+        tmp.doMove(m);
+        const BoardState state2(tmp.state);
+        Move replies[Constants::MaxMoves];
+        MoveGenerator mg(tmp,nullptr,nullptr,0,NullMove,0,opts.legal);
+        const unsigned n = mg.generateAllMoves(replies,0);
+        const bool inCheck = tmp.checkStatus() == InCheck;
+        for (unsigned i = 0; i < n; i++) {
+            if (!opts.legal) {
+                tmp.doMove(replies[i]);
+                const bool legal = tmp.wasLegal(replies[i],inCheck);
+                tmp.undoMove(replies[i],state2);
+                if (!legal) continue;
+            }
+            items.push_back(WorkItem{root,m,replies[i]});
+        }
+        tmp.undoMove(m,state);
+    }
+
+    std::vector<std::atomic<uint64_t>> counts(results.divide.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        Board b(board);
+        const BoardState rootState(b.state);
+        for (size_t i; (i = next.fetch_add(1)) < items.size(); ) {
+            const WorkItem &item = items[i];
+            b.doMove(item.first);
+            uint64_t nodes;
+            if (IsNull(item.second)) {
+                nodes = count(b,depth-1);
+            } else {
+                const BoardState state2(b.state);
+                b.doMove(item.second);
+                nodes = count(b,depth-2);
+                b.undoMove(item.second,state2);
+            }
+            b.undoMove(item.first,rootState);
+            counts[item.root].fetch_add(nodes);
+        }
+    };
+    const int nThreads = std::max<int>(1,std::min<int>(opts.threads,int(items.size())));
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    for (size_t i = 0; i < counts.size(); i++) {
+        results.divide[i].second = counts[i].load();
+        results.nodes += results.divide[i].second;
+    }
+    results.time = getElapsedTime(startTime,getCurrentTime());
+    return results;
+}
+
+bool Perft::parseOptions(const std::vector<std::string> &args, PerftOptions &opts, int &depth)
+{
+    depth = 0;
+    for (auto it = args.begin(); it != args.end(); it++) {
+        const std::string &opt = *it;
+        if (opt == "-t" || opt == "-H") {
+            if (++it == args.end()) {
+                std::cerr << "expected value after " << opt << std::endl;
+                return false;
+            }
+            if (opt == "-H") {
+                Options::setMemoryOption(opts.hashSize,*it);
+            }
+            else if (!Options::setOption<int>(*it,opts.threads) || opts.threads < 1) {
+                std::cerr << "invalid value for -t: " << *it << std::endl;
+                return false;
+            }
+        }
+        else if (opt == "-p") {
+            // pseudo-legal generation, for comparison
+            opts.legal = false;
+        }
+        else {
+            std::stringstream num(opt);
+            if ((num >> depth).fail() || depth < 1) {
+                std::cerr << "invalid perft depth or option: " << opt << std::endl;
+                return false;
+            }
+        }
+    }
+    if (depth == 0) {
+        std::cerr << "usage: perft [-t threads] [-H hash size] [-p] <depth>" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Perft::command(const Board &board, const std::vector<std::string> &args)
+{
+    PerftOptions opts;
+    int depth;
+    if (!parseOptions(args,opts,depth)) {
+        return false;
+    }
+    Perft perft(opts);
+    Results results = perft.run(board,depth);
+    print(std::cout,board,depth,results);
+    return true;
+}
+
+void Perft::print(std::ostream &o, const Board &board, int depth, const Results &results)
+{
+    for (const auto &entry : results.divide) {
+        std::string image;
+        Notation::image(board,entry.first,Notation::OutputFormat::UCI,image);
+        o << image << ": " << entry.second << std::endl;
+    }
+    o << "perft " << depth << " = " << results.nodes << std::endl;
+    o << "Time\t: " << results.time << std::endl;
+    o << "NPS\t: " << (results.time ? 1000*results.nodes/results.time : results.nodes) << std::endl;
+}
@@ -0,0 +1,73 @@
+// Support for the "perft" command
+// Copyright 2022 by Jon Dart. All Rights Reserved.
+//
+#ifndef _PERFT_H
+#define _PERFT_H
+
+#include "board.h"
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Perft {
+public:
+    struct PerftOptions
+    {
+        int threads;
+        size_t hashSize; // in bytes, 0 for no hash table
+        bool legal; // use legal move generation (bulk counts leaf nodes)
+        PerftOptions();
+    };
+
+    struct Results
+    {
+        uint64_t nodes;
+        uint64_t time; // milliseconds
+        std::vector<std::pair<Move,uint64_t>> divide; // counts per root move
+        Results() : nodes(0ULL), time(0ULL) {}
+    };
+
+    explicit Perft(const PerftOptions &options);
+
+    virtual ~Perft() = default;
+
+    // Count the leaf nodes of a "depth" ply tree from "board".
+    // The first two plies are split among the threads.
+    Results run(const Board &board, int depth);
+
+    // Parse options for the "perft" command. Returns false and outputs
+    // a message to std::cerr on error.
+    static bool parseOptions(const std::vector<std::string> &args, PerftOptions &opts, int &depth);
+
+    // Parse options, run perft from "board" and output the results,
+    // for the "perft" command. Returns false on error.
+    static bool command(const Board &board, const std::vector<std::string> &args);
+
+    static void print(std::ostream &o, const Board &board, int depth, const Results &results);
+
+private:
+    // Perft hash entry. The key is stored xor'd with the data, so that
+    // entries can be read and written by several threads without
+    // locking: a torn entry fails the key check.
+    struct HashEntry
+    {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> data; // node count in upper 56 bits, depth in lower 8
+    };
+
+    uint64_t count(Board &board, int depth);
+
+    bool probe(hash_t hash, int depth, uint64_t &nodes) const;
+
+    void store(hash_t hash, int depth, uint64_t nodes);
+
+    PerftOptions opts;
+    std::unique_ptr<HashEntry[]> hashTable;
+    size_t hashMask;
+};
+
+#endif
@@ -16,6 +16,7 @@
 #include "movearr.h"
 #include "movegen.h"
 #include "notation.h"
+#include "perft.h"
 #include "scoring.h"
 #ifdef SYZYGY_TBS
 #include "syzygy.h"
@@ -86,12 +87,14 @@ Protocol::Protocol(const Board &board, bool traceOn, bool icsMode, bool cpus_set
       srctype(TimeLimit),
       time_limit(Constants::INFINITE_TIME),
       ply_limit(Constants::MaxPly),
+      node_limit(0),
       uci(false),
       movestogo(0),
       ponderhit(false),
       uciWaitState(false),
       cpusSet(cpus_set),
       memorySet(memory_set),
+      hashReported(false),
       debugPrefix(globals::debugPrefix)
 {
     ecoCoder = new ECO();
@@ -456,7 +459,8 @@ void Protocol::do_help() {
    std::cout << "test <file> <-t seconds> <-x # moves> <-v> <-o outfile>: "<< std::endl;
    std::cout << "   - run an EPD testsuite" << std::endl;
    std::cout << "eval <file>:     evaluate a FEN position." << std::endl;
-   std::cout << "perft <depth>:   compute perft value for a given depth" << std::endl;
+   std::cout << "perft <-t threads> <-H hash size> <-p> <depth>: " << std::endl;
+   std::cout << "   - compute perft value and divide for the current position" << std::endl;
 }
 
 
@@ -765,7 +769,7 @@ bool Protocol::processPendingInSearch(SearchController *controller, const std::s
         exit = true;
         return false;
     }
-    else if (cmd == "new" || cmd == "test" || cmd == "bench" ||
+    else if (cmd == "new" || cmd == "test" || cmd_word == "bench" ||
              cmd == "edit" || cmd == "remove" || cmd == "undo" ||
              cmd_word == "setboard" || cmd == "analyze" ||
              cmd == "go" || cmd == "exit" || cmd == "white" ||
@@ -1111,6 +1115,18 @@ Move Protocol::search(SearchController *searcher, Board &board,
                 excludes,
                 movesToSearch);
         }
+        else if (srctype == FixedNodes) {
+            searcher->setNodeLimit(node_limit);
+            move = searcher->findBestMove(board,
+                srctype,
+                Constants::INFINITE_TIME,
+                0,
+                Constants::MaxPly, false, uci,
+                stats,
+                level,
+                excludes,
+                movesToSearch);
+        }
         else {
             timeMgmt::Times times;
             if (infinite) {
@@ -1673,11 +1689,25 @@ void Protocol::processWinboardOptions(const std::string &args) {
        if (tmp != globals::options.search.set_processor_affinity) {
            searcher->recalcBindings();
        }
+    } else if (name == "NUMA hash policy") {
+       setHashNumaPolicy(value);
 #endif
     }
     else if (name == "Move overhead") {
         Options::setOption<int>(value,globals::options.search.move_overhead);
     }
+    else if (name == "ABDADA") {
+        Options::setOption<bool>(value,globals::options.search.abdada);
+    }
+    else if (name == "Hash file") {
+        Options::setOption<std::string>(value,globals::options.search.hash_file);
+    }
+    else if (name == "Save hash") {
+        saveHash("");
+    }
+    else if (name == "Load hash") {
+        loadHash("");
+    }
 #ifdef TUNE
     else {
        setTuningParam(name,value);
@@ -1690,25 +1720,59 @@ void Protocol::processWinboardOptions(const std::string &args) {
    searcher->updateSearchOptions();
 }
 
-uint64_t Protocol::perft(Board &board, int depth) {
-   if (depth == 0) return 1;
-
-   uint64_t nodes = 0ULL;
-   RootMoveGenerator mg(board);
-   Move m;
-   BoardState state = board.state;
-   int order = 0;
-   while ((m = mg.nextMove(order)) != NullMove) {
-      if (depth > 1) {
-         board.doMove(m);
-         nodes += perft(board,depth-1);
-         board.undoMove(m,state);
-      } else {
-         // skip do/undo
-         nodes++;
-      }
+#ifdef NUMA
+void Protocol::setHashNumaPolicy(const std::string &value) {
+    if (!Options::validHashNumaPolicy(value)) {
+        std::cout << debugPrefix << "invalid NUMA hash policy: " << value << std::endl;
+    }
+    else if (value != globals::options.search.hash_numa_policy) {
+        globals::options.search.hash_numa_policy = value;
+        // reallocate the table with the new policy
+        searcher->resizeHash(globals::options.search.hash_table_size);
+        reportHashAllocation();
+    }
+}
+#endif
+
+void Protocol::reportHashAllocation() {
+   std::stringstream s;
+   s << "hash table ";
+   searcher->hashTable.printAllocation(s);
+   s << ", cleared in " << searcher->getHashClearTime() << " ms";
+   if (uci) {
+      std::cout << "info string " << s.str() << std::endl;
+   } else if (doTrace) {
+      std::cout << debugPrefix << s.str() << std::endl;
    }
-   return nodes;
+   hashReported = true;
+}
+
+void Protocol::saveHash(const std::string &fileName) {
+   const std::string name(fileName.empty() ? globals::options.search.hash_file : fileName);
+   std::string err;
+   std::stringstream s;
+   if (searcher->saveHash(name,err)) {
+      s << "hash table saved to " << name;
+   } else {
+      s << "hash table save failed: " << err;
+   }
+   if (uci) std::cout << "info string ";
+   else std::cout << debugPrefix;
+   std::cout << s.str() << std::endl;
+}
+
+void Protocol::loadHash(const std::string &fileName) {
+   const std::string name(fileName.empty() ? globals::options.search.hash_file : fileName);
+   std::string err;
+   std::stringstream s;
+   if (searcher->loadHash(name,err)) {
+      s << "hash table loaded from " << name;
+   } else {
+      s << "hash table load failed: " << err;
+   }
+   if (uci) std::cout << "info string ";
+   else std::cout << debugPrefix;
+   std::cout << s.str() << std::endl;
 }
 
 void Protocol::loadgame(Board &board, std::ifstream &file) {
@@ -1795,6 +1859,10 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
 #else
             "2000" << std::endl;
 #endif
+        std::cout << "option name Hash file type string default " <<
+            globals::options.search.hash_file << std::endl;
+        std::cout << "option name Save hash type button" << std::endl;
+        std::cout << "option name Load hash type button" << std::endl;
         std::cout << "option name Ponder type check default true" << std::endl;
         std::cout << "option name Contempt type spin default 0 min -200 max 200" << std::endl;
 #ifdef SYZYGY_TBS
@@ -1821,6 +1889,8 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
         std::cout << "option name Threads type spin default " <<
             globals::options.search.ncpus << " min 1 max " <<
             Constants::MaxCPUs << std::endl;
+        std::cout << "option name ABDADA type check default " <<
+            (globals::options.search.abdada ? "true" : "false") << std::endl;
         std::cout << "option name UCI_LimitStrength type check default false" << std::endl;
         std::cout << "option name UCI_Elo type spin default " << globals::options.getRating(globals::options.search.strength) <<
             " min " << Options::MIN_RATING << " max " << Options::MAX_RATING << std::endl;
@@ -1831,6 +1901,9 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
 #ifdef NUMA
         std::cout << "option name Set processor affinity type check default " <<
            (globals::options.search.set_processor_affinity ? "true" : "false") << std::endl;
+        std::cout << "option name NUMA hash policy type combo default " <<
+           globals::options.search.hash_numa_policy <<
+           " var first_touch var interleave var stripe" << std::endl;
 #endif
         std::cout << "option name Move overhead type spin default " <<
             30 << " min 0 max 1000" << std::endl;
@@ -1855,6 +1928,12 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
                value = value.erase(0, value.find_first_not_of(' '));
                value = value.erase(value.find_last_not_of(' ') + 1);
             }
+            else {
+               // button option, no value
+               name = cmd_args.substr(nam+4);
+               name = name.erase(0 , name.find_first_not_of(' ') );
+               name = name.erase( name.find_last_not_of(' ') + 1);
+            }
         }
         if (uciOptionCompare(name,"Hash")) {
             if (!memorySet) {
@@ -1870,10 +1949,20 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
                     globals::options.search.hash_table_size = (size_t)size*1024L*1024L;
                     if (old != globals::options.search.hash_table_size) {
                        searcher->resizeHash(globals::options.search.hash_table_size);
+                       reportHashAllocation();
                     }
                 }
             }
         }
+        else if (uciOptionCompare(name,"Hash file")) {
+            Options::setOption<std::string>(value,globals::options.search.hash_file);
+        }
+        else if (uciOptionCompare(name,"Save hash")) {
+            saveHash("");
+        }
+        else if (uciOptionCompare(name,"Load hash")) {
+            loadHash("");
+        }
         else if (uciOptionCompare(name,"Ponder")) {
             easy = !(value == "true");
         }
@@ -1941,6 +2030,9 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
                 searcher->setThreadCount(globals::options.search.ncpus);
             }
         }
+        else if (uciOptionCompare(name,"ABDADA")) {
+            Options::setOption<bool>(value, globals::options.search.abdada);
+        }
         else if (uciOptionCompare(name,"UCI_LimitStrength")) {
             Options::setOption<bool>(value, uciStrengthOpts.limitStrength);
             if (uciStrengthOpts.limitStrength) {
@@ -1970,11 +2062,14 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
 #ifdef NUMA
         else if (uciOptionCompare(name,"Set processor affinity")) {
            int tmp = globals::options.search.set_processor_affinity;
-           Options::setOption<bool>(value, globals::options.search.set_processor_affinity;
+           Options::setOption<bool>(value, globals::options.search.set_processor_affinity);
            if (tmp != globals::options.search.set_processor_affinity) {
                searcher->recalcBindings();
            }
         }
+        else if (uciOptionCompare(name,"NUMA hash policy")) {
+           setHashNumaPolicy(value);
+        }
 #endif
         else if (uciOptionCompare(name,"Move overhead")) {
            Options::setOption<int>(value,globals::options.search.move_overhead);
@@ -1996,6 +2091,7 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
     }
     else if (uci && cmd == "isready") {
         globals::delayedInit();
+        if (!hashReported) reportHashAllocation();
         std::cout << "readyok" << std::endl;
     }
     else if (uci && cmd_word == "position") {
@@ -2053,8 +2149,25 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
     }
     else if (cmd_word == "bench") {
        Bench b;
-       Bench::Results res = b.bench(true);
-       std::cout << res;
+       std::stringstream s(cmd_args);
+       std::vector<std::string> args{std::istream_iterator<std::string>(s),
+                                     std::istream_iterator<std::string>()};
+       uint64_t nodes = 0;
+       if (args.empty() || (args.size() == 2 && args[0] == "-n" &&
+                            Options::setOption<uint64_t>(args[1],nodes) && nodes > 0)) {
+           b.setNodeLimit(nodes);
+           Bench::Results res = b.bench(/*verbose=*/false);
+           std::cout << res;
+       }
+       else if (args[0] == "scaling") {
+           b.scalingCommand(std::vector<std::string>(args.begin()+1,args.end()));
+       }
+       else if (args[0] == "rep") {
+           Bench::repetitionCommand(std::vector<std::string>(args.begin()+1,args.end()));
+       }
+       else {
+           std::cerr << "unrecognized bench option: " << args[0] << std::endl;
+       }
     }
     else if (cmd_word == "test") {
         std::string filename;
@@ -2102,6 +2215,25 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
                             it++;
                         }
                     }
+                    else if (*it == "-n") {
+                        if (++it == eos) {
+                            std::cerr << "Expected number after -n" << std::endl;
+                        } else {
+                            std::stringstream num(*it);
+                            num >> opts.node_limit;
+                            it++;
+                        }
+                    }
+                    else if (*it == "-p") {
+                        if (++it == eos) {
+                            std::cerr << "Expected number after -p" << std::endl;
+                        } else {
+                            std::stringstream num(*it);
+                            num >> opts.instances;
+                            opts.instances = std::clamp<int>(opts.instances,1,Constants::MaxCPUs);
+                            it++;
+                        }
+                    }
                     else if (*it == "-N") {
                         if (++it == eos) {
                             std::cerr << "Expected number after -N" << std::endl;
@@ -2148,20 +2280,17 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
         else
             std::cout << "invalid command" << std::endl;
     }
+    else if (cmd_word == "savehash") {
+        saveHash(cmd_args);
+    }
+    else if (cmd_word == "loadhash") {
+        loadHash(cmd_args);
+    }
     else if (cmd_word == "perft") {
-       if (cmd_args.length()) {
-          std::stringstream ss(cmd_args);
-          int depth;
-          if ((ss >> depth).fail()) {
-             std::cerr << "usage: perft <depth>" << std::endl;
-          } else {
-             Board b;
-             std::cout << "perft " << depth << " = " << perft(b,depth) << std::endl;
-          }
-       }
-       else {
-          std::cerr << "usage: perft <depth>" << std::endl;
-       }
+       std::stringstream s(cmd_args);
+       std::vector<std::string> args{std::istream_iterator<std::string>(s),
+                                     std::istream_iterator<std::string>()};
+       Perft::command(*main_board,args);
     }
     else if (cmd_word == "eval") {
         std::string filename;
@@ -2292,6 +2421,16 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
                     srctype = FixedDepth;
                 }
             }
+            else if (option == "nodes") {
+                if (it == eos) break;
+                uint64_t nodes;
+                if (Options::setOption<uint64_t>(*it++,nodes) && nodes > 0) {
+                    srctype = FixedNodes;
+                    node_limit = nodes;
+                } else {
+                    std::cerr << "nodes: invalid argument" << std::endl;
+                }
+            }
             else if (option == "movetime") {
                 if (it == eos) break;
                 std::stringstream s(*it++);
@@ -2445,6 +2584,7 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
         start_fen.clear();
         globals::delayedInit();
         searcher->clearHashTables();
+        if (doTrace) std::cout << debugPrefix << "hash table cleared in " << searcher->getHashClearTime() << " ms" << std::endl;
 #ifdef TUNE
         globals::tune_params.applyParams();
 #endif
@@ -2485,9 +2625,21 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
 #endif
 #ifdef NUMA
         std::cout << " option=\"Set processor affinity -check " <<
-            globals::options.search.set_processor_affinity << "\"" << std::endl;
+            globals::options.search.set_processor_affinity << "\"";
+        std::cout << " option=\"NUMA hash policy -combo ";
+        for (const char *policy : {"first_touch", "interleave", "stripe"}) {
+            if (policy != std::string("first_touch")) std::cout << " /// ";
+            if (globals::options.search.hash_numa_policy == policy) std::cout << '*';
+            std::cout << policy;
+        }
+        std::cout << "\"";
 #endif
         std::cout << " option=\"Move overhead -spin " << 30 << " 0 1000\"";
+        std::cout << " option=\"ABDADA -check " <<
+            globals::options.search.abdada << "\"";
+        std::cout << " option=\"Hash file -file " << globals::options.search.hash_file << "\"";
+        std::cout << " option=\"Save hash -button\"";
+        std::cout << " option=\"Load hash -button\"";
         std::cout << " myname=\"" << "Arasan " << Arasan_Version << "\"" << std::endl;
         // set done = 0 because it may take some time to initialize tablebases.
         std::cout << "feature done=0" << std::endl;
@@ -2715,6 +2867,7 @@ bool Protocol::do_command(const std::string &cmd, Board &board) {
                globals::options.search.hash_table_size = mb_size;
                searcher->updateSearchOptions();
                searcher->resizeHash(globals::options.search.hash_table_size);
+               reportHashAllocation();
            }
         }
         else {
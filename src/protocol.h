@@ -170,8 +170,19 @@ private:
     // Process options for Winboard
     void processWinboardOptions(const std::string &args);
 
-    // Execute a perft test and return node count
-    uint64_t perft(Board &board, int depth);
+    // Report hash table size and page type (huge pages or not)
+    void reportHashAllocation();
+
+#ifdef NUMA
+    // Set the NUMA placement policy for the hash table, and
+    // reallocate the table if it changed
+    void setHashNumaPolicy(const std::string &value);
+#endif
+
+    // Save or load the hash table (file name defaults to the
+    // search.hash_file option), and report the result
+    void saveHash(const std::string &fileName);
+    void loadHash(const std::string &fileName);
 
     // Set the board position from a file
     void loadgame(Board &board, std::ifstream &file);
@@ -238,6 +249,7 @@ private:
     SearchType srctype;
     int time_limit;
     int ply_limit;
+    uint64_t node_limit; // for FixedNodes searches
     std::string start_fen;
 
     bool uci;
@@ -248,6 +260,7 @@ private:
     std::string test_file;
     bool cpusSet; // true if cmd line specifies -c
     bool memorySet; // true if cmd line specifies -H
+    bool hashReported; // true if hash allocation has been output
     std::string &debugPrefix;
     std::mutex inputMtx;
 
@@ -1736,6 +1736,11 @@ score_t Scoring::evalu8(const Board &board, bool useCache) {
        positionalScore<Black>(board, pawnEntry, blackKPEntry, whiteKPEntry,
                               ai,
                               bScores, wScores);
+       // share the attack maps with the search (SEE, move generation)
+       board.setAttackedSquares(White,ai.allAttacks[White]);
+       board.setAttackedSquares(Black,ai.allAttacks[Black]);
+       assert(ai.allAttacks[White] == board.allAttacks(White));
+       assert(ai.allAttacks[Black] == board.allAttacks(Black));
        // now that we have attack info, calculate threat scores
        threatScore<White>(board, ai, wScores);
        threatScore<Black>(board, ai, bScores);
@@ -2401,7 +2406,7 @@ score_t Scoring::evalu8NNUE(const Board &board, NodeInfo *node) {
           assert(0);
       }
 #endif
-      return static_cast<score_t>(globals::network.evaluate(node->accum));
+      return static_cast<score_t>(globals::network.evaluate(*node->accum));
    }
    else {
       return static_cast<score_t>(nnue::Evaluator<ChessInterface>::fullEvaluate(globals::network,intf));
@@ -68,6 +68,12 @@ class Scoring
 
     void clearHashTables();
 
+    // Fetch the pawn hash entry for pawnHash into cache, in advance
+    // of an evaluation.
+    void prefetchPawnEntry(hash_t pawnHash) const {
+        PREFETCH(&pawnHashTable[pawnHash % PAWN_HASH_SIZE]);
+    }
+
     score_t outpost(const Board &board, Square sq, ColorType side) const;
 
     int outpost_defenders(const Board &board,
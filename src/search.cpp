@@ -14,6 +14,7 @@
 #include "trace.h"
 
 #include <algorithm>
+#include <climits>
 #include <cmath>
 #include <cstddef>
 #include <iomanip>
@@ -138,6 +139,7 @@ SearchController::SearchController()
       time_limit(0),
       time_target(0),
       xtra_time(0),
+      node_limit(0),
       bonus_time(0),
       fail_high_root_extend(false),
       fail_low_root_extend(false),
@@ -151,7 +153,6 @@ SearchController::SearchController()
       is_searching(false),
       stopped(false),
       typeOfSearch(TimeLimit),
-      time_check_counter(0),
 #ifdef SMP_STATS
       sample_counter(0),
 #endif
@@ -163,15 +164,23 @@ SearchController::SearchController()
       tb_root_probes(0),
       tb_root_hits(0),
       tb_probe_in_search(true),
-      monitorThread(0),
+      timerActive(false),
+      timerBusy(false),
+      timerExit(false),
+      timerInterval(5),
+      monitorPending(false),
+      completedDepth(0),
 #ifdef SYZYGY_TBS
       tb_hit(0), tb_dtz(0), tb_score(Constants::INVALID_SCORE),
 #endif
       initialValue(Constants::INVALID_SCORE),
       mg(NULL),
-      elapsed_time(0)
+      elapsed_time(0),
+      helper_start_ns(0),
+      hashClearTime(0)
 #ifdef SMP_STATS
-      , samples(0), threads(0)
+      , samples(0), threads(0), depth_assignments(0), depth_contention(0),
+      depth_assign_ns(0)
 #endif
 {
 
@@ -182,14 +191,39 @@ SearchController::SearchController()
 
     ThreadInfo *ti = pool->mainThread();
     ti->state = ThreadInfo::Working;
-    hashTable.initHash((size_t)(globals::options.search.hash_table_size));
+#ifdef NUMA
+    hashTable.setTopology(&pool->topo);
+#endif
+    hashTable.allocHash((size_t)(globals::options.search.hash_table_size));
+    clearHash();
+    timerThread = std::thread(&SearchController::timerLoop,this);
 }
 
 SearchController::~SearchController() {
+   {
+      std::unique_lock<std::mutex> lock(timerMtx);
+      timerExit = true;
+   }
+   timerCv.notify_all();
+   timerThread.join();
    delete pool;
    hashTable.freeHash();
 }
 
+SearchStack::SearchStack()
+{
+    Move *pv = pvs;
+    for (int ply = 0; ply < Size; ply++) {
+        nodes[ply].pv = pv;
+        pv += pvCapacity(ply);
+        assert(pv <= pvs + PvBufferSize);
+        nodes[ply].quiets = quiets[ply];
+#ifdef NNUE
+        nodes[ply].accum = &accums[ply];
+#endif
+    }
+}
+
 void Search::init() {
     for (int d = 0; d < 64; d++) {
         for (int moves = 0; moves < 64; moves++) {
@@ -250,8 +284,13 @@ Move SearchController::findBestMove(
    const MoveSet &moves_to_exclude,
    const MoveSet &moves_to_include)
 {
+    entryTime = getCurrentTime();
+    helper_start_ns.store(0,std::memory_order_relaxed);
     typeOfSearch = srcType;
     initialBoard = board;
+    // search threads copy initialBoard: share its history rather
+    // than copying it to each thread
+    initialBoard.shareHistory();
     time_limit = time_target = search_time_limit;
     exclude = moves_to_exclude;
     include = moves_to_include;
@@ -262,9 +301,10 @@ Move SearchController::findBestMove(
     searchHistoryBoostFactor = searchHistoryReductionFactor = 0.0;
     maxBoostFactor = -1.0;
     maxBoostDepth = 0;
-    search_counts.fill(0);
-    search_counts[0] = globals::options.search.ncpus;
-    if (srcType == FixedTime || srcType == TimeLimit) {
+    for (auto &count : search_counts) count.store(0,std::memory_order_relaxed);
+    search_counts[0].store(pool->size(),std::memory_order_relaxed);
+    searchingTable.clear();
+    if (srcType == FixedTime || srcType == TimeLimit || srcType == FixedNodes) {
         ply_limit = Constants::MaxPly-1;
     }
     else {
@@ -278,27 +318,23 @@ Move SearchController::findBestMove(
     stats = &stat_buf;
 #ifdef SMP_STATS
     samples = threads = 0L;
+    depth_assignments = depth_contention = depth_assign_ns = 0;
 #endif
     elapsed_time = 0ULL;
+    completedDepth = 0;
+    monitorPending = false;
 
-    timeCheckInterval = 4096/NODE_ACCUM_THRESHOLD;
-    // reduce time check interval if time limit is very short (<1 sec)
-    if (srcType == TimeLimit) {
-       if (time_limit < 100) {
-          timeCheckInterval = 1024/NODE_ACCUM_THRESHOLD;
-       } else if (time_limit < 1000) {
-          timeCheckInterval = 2048/NODE_ACCUM_THRESHOLD;
-       }
+    // check more often if the time limit is very short (<1 sec)
+    timerInterval = 5;
+    if ((srcType == TimeLimit || srcType == FixedTime) && time_limit < 1000) {
+       timerInterval = 1;
     }
     tb_probe_in_search = true;
     computerSide = board.sideToMove();
 
 #ifdef NUMA
-    if (pool->rebindMask.test(0)) {
-       // rebind main thread
-       pool->bind(0);
-       pool->rebindMask.reset(0);
-    }
+    // rebind main thread if needed
+    pool->rebind(0);
 #endif
 
     stats->clear();
@@ -306,8 +342,8 @@ Move SearchController::findBestMove(
     // Positions are stored in the hashtable with an "age" to identify
     // which search they came from. "Newer" positions can replace
     // "older" ones. Update the age here since we are starting a
-    // new search.
-    age = (age + 1) % 256;
+    // new search. Age 0 is reserved for permanent entries.
+    age = age % HashEntry::MAX_AGE + 1;
 
     // propagate controller variables to searches
     pool->forEachSearch<&Search::setVariablesFromController>();
@@ -332,7 +368,8 @@ Move SearchController::findBestMove(
     }
    rootSearch = pool->rootSearch();
    // Generate the ply 0 moves here:
-   mg = new RootMoveGenerator(board,&(rootSearch->context),NullMove,debugOut());
+   mg = new RootMoveGenerator(board,&(rootSearch->context),NullMove,debugOut(),
+                              globals::options.search.legal_movegen);
    if (mg->moveCount() == 0) {
       // Checkmate or statemate
       if (board.inCheck()) {
@@ -369,12 +406,12 @@ Move SearchController::findBestMove(
       }
    }
 
-   time_check_counter = timeCheckInterval;
-
    score_t value = Constants::INVALID_SCORE;
 #ifdef SYZYGY_TBS
    tb_hit = 0;
-   updateSearchOptions();
+   // update the searches' copy of the options (but keep this
+   // controller's thread count)
+   pool->forEachSearch<&Search::setSearchOptions>();
    tb_score = Constants::INVALID_SCORE;
    tb_root_probes = tb_root_hits = 0;
    if (globals::options.search.use_tablebases) {
@@ -395,7 +432,7 @@ Move SearchController::findBestMove(
            stats->tb_value = tb_score;
            // do not probe in the search
            tb_probe_in_search = false;
-           updateSearchOptions();
+           pool->forEachSearch<&Search::setSearchOptions>();
            if (debugOut()) {
                std::cout << globals::debugPrefix << board << " root tb hit, score=";
                Scoring::printScore(tb_score,std::cout);
@@ -424,13 +461,12 @@ Move SearchController::findBestMove(
    stats->value = stats->display_value = value;
 
    // Start all searches
+   startTimer();
    pool->unblockAll();
 
    // Start searching in the main thread
-   NodeInfo *rootStack = new NodeInfo[Search::SearchStackSize];
-   rootSearch->init(rootStack,pool->mainThread());
+   rootSearch->init(pool->mainThread());
    Move best = rootSearch->ply0_search();
-   delete [] rootStack;
    // Mark thread 0 complete.
    pool->setCompleted(0);
 
@@ -438,6 +474,7 @@ Move SearchController::findBestMove(
 
    // Wait for all threads to complete
    pool->waitAll();
+   stopTimer();
 
    // We are finished with the move generator - can delete
    delete mg;
@@ -468,6 +505,17 @@ Move SearchController::findBestMove(
       Scoring::printScore(stats->value,std::cout);
       std::cout << " fail high=" << (int)stats->failHigh << " fail low=" << stats->failLow;
       std::cout << " pv=" << stats->best_line_image << std::endl;
+      if (pool->size() > 1) {
+         std::cout << globals::debugPrefix << "helper start latency: " <<
+            getHelperStartLatency() << " us" << std::endl;
+      }
+#ifdef SMP_STATS
+      if (pool->size() > 1) {
+         std::cout << globals::debugPrefix;
+         printDepthAssignStats(std::cout);
+         std::cout << std::endl;
+      }
+#endif
    }
 
    // search done (all threads), set status and report statistics
@@ -519,8 +567,27 @@ Move SearchController::findBestMove(
             (int)((100.0*(float)stats->hash_hits)/((float)stats->hash_searches)) <<
             " percent).";
       std::cout << std::endl;
+      std::cout << stats->hash_prefetches << " hash prefetches, " <<
+         stats->hash_prefetch_hits << " used";
+      if (stats->hash_prefetches != 0)
+         std::cout << " (" <<
+            (int)((100.0*(float)stats->hash_prefetch_hits)/((float)stats->hash_prefetches)) <<
+            " percent).";
+      std::cout << std::endl;
       std::cout << "hash table is " << std::setprecision(2) <<
           1.0F*hashTable.pctFull()/10.0F << "% full." << std::endl;
+#ifdef NUMA
+      if (hashTable.getNumaPolicy() != Hash::NumaPolicy::FirstTouch &&
+          stats->hash_searches != 0) {
+         std::cout << "hash probes by node:";
+         for (unsigned node = 0; node < hashTable.getNumaNodes(); node++) {
+            std::cout << ' ' << node << ": " << stats->hash_node_probes[node] <<
+               " (" << (int)((100.0*stats->hash_node_probes[node])/stats->hash_searches) << "%)";
+         }
+         std::cout << ", local " <<
+            (int)((100.0*stats->hash_local_probes)/stats->hash_searches) << "%." << std::endl;
+      }
+#endif
 #endif
 #ifdef MOVE_ORDER_STATS
       std::cout << "move ordering: ";
@@ -581,7 +648,113 @@ void SearchController::clearHashTables()
 {
     age = 0;
     pool->forEachSearch<&Search::clearHashTables>();
-    hashTable.clearHash();
+    clearHash();
+}
+
+void SearchController::clearHash()
+{
+    // Each thread clears (and so first touches) a part of the table.
+    // This is faster for large tables, and on NUMA systems spreads
+    // the table's pages across nodes.
+    const CLOCK_TYPE start = getCurrentTime();
+    const unsigned n = pool->size();
+    pool->forEachThread([this,n](unsigned index) {
+        hashTable.clearSlice(index,n);
+    });
+    hashTable.clearDone();
+    hashClearTime = ::getElapsedTime(start,getCurrentTime());
+}
+
+bool SearchController::timeUp() const {
+    // Do not allow time-based termination if the search has not
+    // completed even one iteration, since we may be failing low and
+    // have no move
+    if (completedDepth > 0) {
+       if (typeOfSearch == FixedTime) {
+          return elapsed_time >= time_target;
+       }
+       else if (typeOfSearch == TimeLimit) {
+          return elapsed_time > getTimeLimit();
+       }
+    }
+    return false;
+}
+
+void SearchController::timerLoop() {
+    std::unique_lock<std::mutex> lock(timerMtx);
+    while (!timerExit) {
+        timerCv.wait(lock,[this]{ return timerExit || timerActive; });
+        timerBusy = timerActive;
+        while (timerActive && !timerExit) {
+            lock.unlock();
+            timerCheck();
+            lock.lock();
+            timerCv.wait_for(lock,std::chrono::milliseconds(timerInterval),
+                             [this]{ return timerExit || !timerActive; });
+        }
+        timerBusy = false;
+        timerCv.notify_all();
+    }
+}
+
+void SearchController::timerCheck() {
+    if (stopped) {
+        terminateNow();
+    }
+    elapsed_time = ::getElapsedTime(startTime,getCurrentTime());
+    if (timeUp()) {
+        terminateNow();
+    }
+    // hand off input polling and output to the main search thread
+    monitorPending.store(true,std::memory_order_relaxed);
+}
+
+void SearchController::runMonitor(Statistics &mainStats) {
+    monitorPending.store(false,std::memory_order_relaxed);
+    updateGlobalStats(mainStats);
+    if (monitor_function && monitor_function(this,*stats)) {
+        if (debugOut()) {
+            std::cout << globals::debugPrefix << "terminating due to program or user input" << std::endl;
+        }
+        terminateNow();
+    }
+    else if (uci) {
+        const CLOCK_TYPE current_time = getCurrentTime();
+        if (::getElapsedTime(last_time,current_time) >= 3000) {
+            const uint64_t total_nodes = totalNodes();
+            std::cout << "info";
+            if (elapsed_time>300) std::cout << " nps " <<
+                                      (long)((1000L*total_nodes)/elapsed_time);
+            std::cout << " nodes " << total_nodes << " hashfull " << hashTable.pctFull() << std::endl;
+            last_time = current_time;
+        }
+    }
+}
+
+void SearchController::startTimer() {
+    {
+        std::unique_lock<std::mutex> lock(timerMtx);
+        timerActive = true;
+    }
+    timerCv.notify_all();
+}
+
+void SearchController::stopTimer() {
+    std::unique_lock<std::mutex> lock(timerMtx);
+    timerActive = false;
+    timerCv.notify_all();
+    // wait for any timer processing (including the monitor function)
+    // to complete
+    timerCv.wait(lock,[this]{ return !timerBusy; });
+}
+
+void SearchController::recordHelperStart() {
+    const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        getCurrentTime() - entryTime).count();
+    uint64_t prev = helper_start_ns.load(std::memory_order_relaxed);
+    while (ns > prev &&
+           !helper_start_ns.compare_exchange_weak(prev,ns,std::memory_order_relaxed)) {
+    }
 }
 
 void SearchController::stopAllThreads() {
@@ -615,8 +788,20 @@ void SearchController::uciSendInfos(const Board &board, Move move, int move_inde
    }
 }
 
+bool SearchController::loadHash(const std::string &fileName, std::string &err) {
+   unsigned savedAge;
+   if (!hashTable.load(fileName, savedAge, err)) {
+      return false;
+   }
+   // continue the age sequence of the saved table
+   age = savedAge;
+   return true;
+}
+
 void SearchController::resizeHash(size_t newSize) {
-   hashTable.resizeHash(newSize);
+   hashTable.freeHash();
+   hashTable.allocHash(newSize);
+   clearHash();
 }
 
 void SearchController::outOfBoundsTimeAdjust() {
@@ -710,75 +895,70 @@ void SearchController::applySearchHistoryFactors() {
 Search::Search(SearchController *c, ThreadInfo *threadInfo)
    :controller(c),
     iterationDepth(0),
+    rootLineCount(0),
     terminate(0),
     nodeAccumulator(0),
+    searchStack(new SearchStack()),
     node(nullptr),
     ti(threadInfo),
     computerSide(White),
     contempt(0),
     age(0),
     talkLevel(c->getTalkLevel())
+#ifdef SEARCH_STATS
+    , prefetchHash(0ULL)
+#endif
 {
     // Note: context was cleared in its constructor
     setSearchOptions();
     random_engine.seed(getRandomSeed());
 }
 
-int Search::checkTime() {
-    if (controller->stopped) {
-        controller->terminateNow();
-    }
-    if (terminate) {
-       if (debugOut()) std::cout << globals::debugPrefix << "check time, already terminated" << std::endl;
-       return 1; // already stopped search
-    }
+Search::~Search()
+{
+    delete searchStack;
+}
 
-    CLOCK_TYPE current_time = getCurrentTime();
-    controller->elapsed_time = getElapsedTime(controller->startTime,current_time);
+#ifdef NUMA
+void Search::forEachAllocation(const std::function<void(const void *,size_t)> &fn) const
+{
+    fn(this,sizeof(*this));
+    fn(searchStack,sizeof(*searchStack));
+    context.forEachAllocation(fn);
+}
+#endif
 
-    // Do not allow time-based termination if the search has not
-    // completed even one iteration, since we may be failing low and
-    // have no move
-    if (controller->stats->completedDepth > 0) {
-       if (controller->typeOfSearch == FixedTime) {
-          if (controller->elapsed_time >= controller->time_target) {
-             return 1;
-          }
-       }
-       else if (controller->typeOfSearch == TimeLimit) {
-          if (controller->elapsed_time > controller->getTimeLimit()) {
-             if (debugOut()) {
-                std::cout << globals::debugPrefix << "terminating, max time reached" << std::endl;
-             }
-             return 1;
-          }
-       }
+#if defined(NUMA) && defined(SEARCH_STATS)
+FORCEINLINE void Search::countHashProbe(hash_t hash) {
+    const int node = controller->hashTable.nodeOf(hash);
+    if (node >= 0) {
+        stats.hash_node_probes[node]++;
+        if (node == ti->node) stats.hash_local_probes++;
     }
+}
+#endif
 
-    int val = 0;
-    // The following code is always only executed by one of the threads
-    if (controller->monitor_function && controller->isMonitorThread(ti->index)) {
-        if (controller->monitor_function(controller,stats)) {
-            if (debugOut()) {
-                std::cout << globals::debugPrefix << "terminating due to program or user input" << std::endl;
-            }
-            val = 1;
-        } else {
-            controller->updateGlobalStats(stats);
-            if (controller->uci && getElapsedTime(controller->last_time,current_time) >= 3000) {
-                const uint64_t total_nodes = controller->totalNodes();
-                std::cout << "info";
-                if (controller->elapsed_time>300) std::cout << " nps " <<
-                                                      (long)((1000L*total_nodes)/controller->elapsed_time);
-                std::cout << " nodes " << total_nodes << " hashfull " << controller->hashTable.pctFull() << std::endl;
-                controller->last_time = current_time;
-            }
-        }
+FORCEINLINE void Search::prefetch(const Board &board, Move move) {
+    // The child's probe normally uses repetition count 0.
+    const hash_t childHash = board.hashCode(move) ^ rep_codes[0];
+    controller->hashTable.prefetch(childHash);
+#ifdef SEARCH_STATS
+    stats.hash_prefetches++;
+    prefetchHash = childHash;
+#endif
+    // pawn hash entry changes only if pawn structure changes
+    if (PieceMoved(move) == Pawn || Capture(move) == Pawn) {
+        scoring.prefetchPawnEntry(board.pawnHash(move));
     }
-    if (val) {
-        controller->terminateNow();
+}
+
+int Search::checkTime() {
+    if (terminate) {
+       if (debugOut()) std::cout << globals::debugPrefix << "check time, already terminated" << std::endl;
+       return 1; // already stopped search
     }
-    return val;
+    controller->elapsed_time = getElapsedTime(controller->startTime,getCurrentTime());
+    return controller->timeUp();
 }
 
 void Search::showStatus(const Board &board, Move best, bool faillow,
@@ -902,20 +1082,20 @@ void Search::setTalkLevelFromController() {
 }
 
 void Search::updateStats(const Board &board, NodeInfo *node, int iteration_depth,
-                         score_t score)
+                         score_t score, Statistics &s)
 {
-    assert(stats.multipv_count < Statistics::MAX_PV);
-    stats.value = score;
-    stats.depth = iteration_depth;
-    stats.display_value = stats.value;
+    assert(s.multipv_count < Statistics::MAX_PV);
+    s.value = score;
+    s.depth = iteration_depth;
+    s.display_value = s.value;
 #ifdef SYZYGY_TBS
     // Correct if necessary the display value, used for score
     // output and resign decisions, based on the tb information:
-    if (stats.tb_value != Constants::INVALID_SCORE) {
-       stats.display_value = tbScoreAdjust(board,
-                                           stats.value,
+    if (s.tb_value != Constants::INVALID_SCORE) {
+       s.display_value = tbScoreAdjust(board,
+                                           s.value,
                                            1,
-                                           stats.tb_value);
+                                           s.tb_value);
     }
 #endif
     // note: retain previous best line if we do not have one here
@@ -931,14 +1111,14 @@ void Search::updateStats(const Board &board, NodeInfo *node, int iteration_depth
     node->best = node->pv[0];                     // ensure "best" is non-null
     assert(!IsNull(node->best));
     Board board_copy(board);
-    stats.best_line[0] = NullMove;
+    s.best_line[0] = NullMove;
     int i = 0;
-    stats.best_line_image.clear();
+    s.best_line_image.clear();
     std::stringstream sstr;
     const Move *moves = node->pv;
     while (i < node->pv_length && i<Constants::MaxPly-1 && !IsNull(moves[i])) {
        Move move = moves[i];
-       stats.best_line[i] = move;
+       s.best_line[i] = move;
        assert(legalMove(board_copy,move));
        if (i!=0) {
           sstr << ' ';
@@ -966,7 +1146,7 @@ void Search::updateStats(const Board &board, NodeInfo *node, int iteration_depth
           if (result != HashEntry::NoHit) {
              Move hashMove = entry.bestMove(board_copy);
              if (!IsNull(hashMove)) {
-                stats.best_line[i] = hashMove;
+                s.best_line[i] = hashMove;
                 if (i!=0) sstr << ' ';
                 Notation::image(board_copy,hashMove,
                                 controller->uci ? Notation::OutputFormat::UCI : Notation::OutputFormat::SAN,sstr);
@@ -976,8 +1156,8 @@ void Search::updateStats(const Board &board, NodeInfo *node, int iteration_depth
           }
        }
     }
-    stats.best_line[i] = NullMove;
-    stats.best_line_image = sstr.str();
+    s.best_line[i] = NullMove;
+    s.best_line_image = sstr.str();
 }
 
 void Search::suboptimal(RootMoveGenerator &mg,Move &m, score_t &val) {
@@ -1033,298 +1213,283 @@ Move Search::ply0_search()
    // which will have the ranked, sorted, filtered move list.
    RootMoveGenerator mg(*(controller->mg),&context);
    stats.multipv_limit = std::min<int>(mg.moveCount(),globals::options.search.multipv);
+   const bool multiPV = stats.multipv_limit > 1;
    iterationDepth = 0;
    for (int nominalDepth = 1;(iterationDepth = controller->nextSearchDepth(iterationDepth,ti->index,
                                                        controller->ply_limit)) <= controller->ply_limit &&
             !terminate; ++nominalDepth) {
-      MoveSet excluded(controller->exclude);
-      for (stats.multipv_count = 0;
-           stats.multipv_count < stats.multipv_limit && !terminate;
-           stats.multipv_count++) {
-         score_t lo_window, hi_window;
-         score_t aspirationWindow = ASPIRATION_WINDOW[0];
-
-         if (srcOpts.multipv > 1) {
-             stats.clearSearchState();
-             if (nominalDepth > 1) {
-                 // set value to previous iteration's value
-                 value = stats.multi_pvs[stats.multipv_count].display_value;
-             } else {
-                 value = controller->initialValue;
-             }
-         }
-         if (stats.multipv_count) {
-            // Exclude the previous best move from the current
-            // search, so we will select a different one.
-            excluded.emplace(stats.multi_pvs[stats.multipv_count-1].best);
+      score_t lo_window, hi_window;
+      score_t aspirationWindow = ASPIRATION_WINDOW[0];
+
+      if (iterationDepth <= 1) {
+         lo_window = -Constants::MATE;
+         hi_window = Constants::MATE;
+      } else if (multiPV) {
+         // All lines are found in one pass, with the score of the
+         // Nth best line as the lower bound for the other moves (see
+         // updateRootLines). The aspiration window is only a lower
+         // bound, below the previous iteration's Nth best score.
+         lo_window = -Constants::MATE;
+         hi_window = Constants::MATE;
+         if (stats.multipv_count == stats.multipv_limit &&
+             iterationDepth > MoveGenerator::EASY_PLIES) {
+            const score_t nth = stats.multi_pvs[stats.multipv_limit-1].value;
+            if (!Scoring::mateScore(nth)) {
+               lo_window = std::max<score_t>(-Constants::MATE,nth - aspirationWindow);
+            }
          }
-         if (iterationDepth <= 1) {
-            lo_window = -Constants::MATE;
-            hi_window = Constants::MATE;
-         } else if (iterationDepth <= MoveGenerator::EASY_PLIES) {
-            lo_window = std::max<score_t>(-Constants::MATE,value - WIDE_WINDOW);
-            hi_window = std::min<score_t>(Constants::MATE,value + WIDE_WINDOW + aspirationWindow/2);
-         } else {
-            lo_window = std::max<score_t>(-Constants::MATE,value - aspirationWindow/2);
-            hi_window = std::min<score_t>(Constants::MATE,value + aspirationWindow/2);
+      } else if (iterationDepth <= MoveGenerator::EASY_PLIES) {
+         lo_window = std::max<score_t>(-Constants::MATE,value - WIDE_WINDOW);
+         hi_window = std::min<score_t>(Constants::MATE,value + WIDE_WINDOW + aspirationWindow/2);
+      } else {
+         lo_window = std::max<score_t>(-Constants::MATE,value - aspirationWindow/2);
+         hi_window = std::min<score_t>(Constants::MATE,value + aspirationWindow/2);
+      }
+      if (mainThread() && debugOut() && controller->background) {
+          std::cout << globals::debugPrefix;
+          std::cout << iterationDepth << ". move=";
+          MoveImage(node->best,std::cout); std::cout << " score=";
+          Scoring::printScore(node->best_score,std::cout);
+          std::cout << " terminate=" << terminate << std::endl;
+      }
+      int fails = 0;
+      int faillows = 0, failhighs = 0;
+      do {
+         stats.failHigh = stats.failLow = false;
+#ifdef _TRACE
+         if (mainThread()) {
+            std::cout << "iteration " << iterationDepth << " window = [";
+            Scoring::printScore(lo_window,std::cout);
+            std::cout << ',';
+            Scoring::printScore(hi_window,std::cout);
+            std::cout << ']' << std::endl;
          }
-         if (mainThread() && debugOut() && controller->background) {
-             std::cout << globals::debugPrefix;
-             if (srcOpts.multipv > 1) {
-                 std::cout << " multipv=" << stats.multipv_count << ": ";
+#endif
+         value = ply0_search(mg, lo_window, hi_window, iterationDepth,
+                             DEPTH_INCREMENT*iterationDepth,
+                             controller->exclude);
+         if (multiPV) {
+             // Update the lines only if the iteration completed and
+             // found all of them (or had no lower bound), else leave
+             // the previous iteration's lines intact.
+             if (!terminate && (rootLineCount == stats.multipv_limit ||
+                                lo_window == -Constants::MATE)) {
+                 value = updateMultiPVStats();
              }
-             std::cout << iterationDepth << ". move=";
-             MoveImage(node->best,std::cout); std::cout << " score=";
-             Scoring::printScore(node->best_score,std::cout);
-             std::cout << " terminate=" << terminate << std::endl;
          }
-         int fails = 0;
-         int faillows = 0, failhighs = 0;
-         do {
-            stats.failHigh = stats.failLow = false;
-#ifdef _TRACE
-            if (mainThread()) {
-               std::cout << "iteration " << iterationDepth << " window = [";
-               Scoring::printScore(lo_window,std::cout);
-               std::cout << ',';
-               Scoring::printScore(hi_window,std::cout);
-               std::cout << ']' << std::endl;
-            }
-#endif
-            value = ply0_search(mg, lo_window, hi_window, iterationDepth,
-                                DEPTH_INCREMENT*iterationDepth,
-                                excluded);
-            // If we did not even search one move in this iteration,
-            // leave the search stats intact (with the previous
-            // iteration's pv and score).
-            if (!terminate || stats.mvleft != stats.mvtot) {
-                updateStats(board, node, iterationDepth, value);
-            }
+         // If we did not even search one move in this iteration,
+         // leave the search stats intact (with the previous
+         // iteration's pv and score).
+         else if (!terminate || stats.mvleft != stats.mvtot) {
+             updateStats(board, node, iterationDepth, value);
+         }
 #ifdef _TRACE
-            if (mainThread()) {
-               std::cout << "iteration " << iterationDepth << " raw result: ";
-               Scoring::printScore(stats.value,std::cout);
-               std::cout << " corrected result: ";
-               Scoring::printScore(stats.display_value,std::cout);
-               std::cout << std::endl;
-            }
+         if (mainThread()) {
+            std::cout << "iteration " << iterationDepth << " raw result: ";
+            Scoring::printScore(stats.value,std::cout);
+            std::cout << " corrected result: ";
+            Scoring::printScore(stats.display_value,std::cout);
+            std::cout << std::endl;
+         }
 #endif
-            StateType &state = stats.state;
-            if (!terminate && (state == Checkmate || state == Stalemate)) {
-                std::cout << globals::debugPrefix << "terminating due to checkmate or statemate, state="
-                          << (int)state << std::endl;
-                controller->terminateNow();
-                break;
-            }
-            if (controller->elapsed_time > 200) {
-               controller->timeCheckInterval = int((20L*stats.num_nodes)/(controller->elapsed_time*NODE_ACCUM_THRESHOLD));
-               if ((int)controller->time_limit - (int)controller->elapsed_time < 100) {
-                  controller->timeCheckInterval /= 2;
-               }
-               if (mainThread() && debugOut()) {
-                  std::cout << globals::debugPrefix << "time check interval=" << controller->timeCheckInterval << " elapsed_time=" << controller->elapsed_time << " target=" << controller->getTimeLimit() << std::endl;
-               }
-            }
-            stats.failHigh = value >= hi_window && (hi_window < Constants::MATE-nominalDepth-1);
-            stats.failLow = value <= lo_window  && (lo_window > nominalDepth-Constants::MATE);
-            if (stats.failLow) {
-                faillows++;
-            }
-            else if (stats.failHigh) {
-                failhighs++;
-            }
-            // store root search history entry
-            if (mainThread()) {
-                controller->rootSearchHistory[iterationDepth-1] = SearchController::SearchHistory(
-                    node->best, stats.display_value);
-            }
-            // Peform any temporary adjustment of the time allocation based
-            // on search status (fail high/low). Note: all threads call this;
-            // adjustment is based on the current best search thread.
-            controller->outOfBoundsTimeAdjust();
-            // Show status (if main thread) and adjust aspiration
-            // window as needed
-            if (stats.failHigh) {
-                if (mainThread()) {
-                    if (stats.multipv_limit == 1) {
-                        showStatus(board, node->best, stats.failLow, stats.failHigh);
-                    }
-                    if (debugOut()) {
-                        std::cout << globals::debugPrefix << "ply 0 fail high, re-searching ... value=";
-                        Scoring::printScore(value,std::cout);
-                        std::cout << " fails=" << fails+1 << std::endl;
-                    }
-#ifdef _TRACE
-                    std::cout << globals::debugPrefix << "ply 0 high cutoff, re-searching ... value=";
-                    Scoring::printScore(value,std::cout);
-                    std::cout << " fails=" << fails+1 << std::endl;
+         StateType &state = stats.state;
+         if (!terminate && (state == Checkmate || state == Stalemate)) {
+             std::cout << globals::debugPrefix << "terminating due to checkmate or statemate, state="
+                       << (int)state << std::endl;
+             controller->terminateNow();
+             break;
+         }
+         if (multiPV) {
+             // fail low if fewer than N moves scored above the lower bound
+             stats.failHigh = false;
+             stats.failLow = !terminate && rootLineCount < stats.multipv_limit &&
+                 lo_window > -Constants::MATE;
+         } else {
+             stats.failHigh = value >= hi_window && (hi_window < Constants::MATE-nominalDepth-1);
+             stats.failLow = value <= lo_window  && (lo_window > nominalDepth-Constants::MATE);
+         }
+         if (stats.failLow) {
+             faillows++;
+         }
+         else if (stats.failHigh) {
+             failhighs++;
+         }
+         // store root search history entry
+         if (mainThread()) {
+             controller->rootSearchHistory[iterationDepth-1] = SearchController::SearchHistory(
+                 node->best, stats.display_value);
+         }
+         // Peform any temporary adjustment of the time allocation based
+         // on search status (fail high/low). Note: all threads call this;
+         // adjustment is based on the current best search thread.
+         controller->outOfBoundsTimeAdjust();
+         // Show status (if main thread) and adjust aspiration
+         // window as needed
+         if (stats.failHigh) {
+             if (mainThread()) {
+                 if (stats.multipv_limit == 1) {
+                     showStatus(board, node->best, stats.failLow, stats.failHigh);
+                 }
+                 if (debugOut()) {
+                     std::cout << globals::debugPrefix << "ply 0 fail high, re-searching ... value=";
+                     Scoring::printScore(value,std::cout);
+                     std::cout << " fails=" << fails+1 << std::endl;
+                 }
+#ifdef _TRACE
+                 std::cout << globals::debugPrefix << "ply 0 high cutoff, re-searching ... value=";
+                 Scoring::printScore(value,std::cout);
+                 std::cout << " fails=" << fails+1 << std::endl;
 #endif
-                }
-                if (fails+1 >= ASPIRATION_WINDOW_STEPS) {
-                    aspirationWindow = Constants::MATE;
-                }
-                else {
-                    aspirationWindow = ASPIRATION_WINDOW[++fails];
-                }
-                if (aspirationWindow == Constants::MATE) {
-                    hi_window = Constants::MATE - nominalDepth - 1;
-                } else {
-                    if (iterationDepth <= MoveGenerator::EASY_PLIES) {
-                        aspirationWindow += 2*WIDE_WINDOW;
-                    }
-                    hi_window = std::min<score_t>(Constants::MATE - nominalDepth - 1,
-                                                  lo_window + aspirationWindow);
-                }
-            }
-            else if (stats.failLow) {
-                if (mainThread()) {
-                    if (stats.multipv_limit == 1) {
-                        showStatus(board, node->best, stats.failLow, stats.failHigh);
-                    }
-                    if (debugOut()) {
-                        std::cout << globals::debugPrefix << "ply 0 fail low, re-searching ... value=";
-                        Scoring::printScore(value,std::cout);
-                        std::cout << " fails=" << fails+1 << std::endl;
-                    }
-#ifdef _TRACE
-                    std::cout << globals::debugPrefix << "ply 0 fail low, re-searching ... value=";
-                    Scoring::printScore(value,std::cout);
-                    std::cout << " fails=" << fails+1 << std::endl;
+             }
+             if (fails+1 >= ASPIRATION_WINDOW_STEPS) {
+                 aspirationWindow = Constants::MATE;
+             }
+             else {
+                 aspirationWindow = ASPIRATION_WINDOW[++fails];
+             }
+             if (aspirationWindow == Constants::MATE) {
+                 hi_window = Constants::MATE - nominalDepth - 1;
+             } else {
+                 if (iterationDepth <= MoveGenerator::EASY_PLIES) {
+                     aspirationWindow += 2*WIDE_WINDOW;
+                 }
+                 hi_window = std::min<score_t>(Constants::MATE - nominalDepth - 1,
+                                               lo_window + aspirationWindow);
+             }
+         }
+         else if (stats.failLow) {
+             if (mainThread()) {
+                 if (stats.multipv_limit == 1) {
+                     showStatus(board, node->best, stats.failLow, stats.failHigh);
+                 }
+                 if (debugOut()) {
+                     std::cout << globals::debugPrefix << "ply 0 fail low, re-searching ... value=";
+                     Scoring::printScore(value,std::cout);
+                     std::cout << " fails=" << fails+1 << std::endl;
+                 }
+#ifdef _TRACE
+                 std::cout << globals::debugPrefix << "ply 0 fail low, re-searching ... value=";
+                 Scoring::printScore(value,std::cout);
+                 std::cout << " fails=" << fails+1 << std::endl;
 #endif
-                }
-                // continue loop with lower bound
-                if (fails+1 >= ASPIRATION_WINDOW_STEPS) {
-                    // TBD: Sometimes we can fail low after a bunch of fail highs. Allow the
-                    // search to continue, but set the lower bound to the bottom of the range.
-                    if (mainThread() && debugOut()) {
-                        std::cout << globals::debugPrefix << "too many aspiration window steps, setting window to max width" << std::endl;
-                    }
-                    aspirationWindow = Constants::MATE;
-                }
-                else if (Scoring::mateScore(value)) {
-                    // We got a mate score so don't bother doing any
-                    // more aspiration steps, just widen to the max.
-                    aspirationWindow = Constants::MATE;
-                }
-                else {
-                    aspirationWindow = ASPIRATION_WINDOW[++fails];
-                }
-                if (aspirationWindow == Constants::MATE) {
-                    // We can miss shallow mates but then find them in
-                    // later iterations. Set the window to -Mate1 so we
-                    // will never fail low and not get a pv.
-                    lo_window = 1-Constants::MATE;
-                } else {
-                    if (iterationDepth <= MoveGenerator::EASY_PLIES) {
-                        aspirationWindow += 2*WIDE_WINDOW;
-                    }
-                    lo_window = std::max<score_t>(nominalDepth-Constants::MATE,hi_window - aspirationWindow);
-                }
-            }
-            // check time after adjustments have been made. Do not
-            // allow time-based exit without one completed iteration though.
-            if (!terminate) {
-                if (checkTime()) {
-                    if (debugOut()) {
-                        std::cout << globals::debugPrefix << "time up" << std::endl;
-                    }
-                    controller->terminateNow();
-                }
-            }
-         } while (!terminate && (stats.failLow || stats.failHigh));
-         // Search value should now be in bounds (unless we are terminating)
-
-         // Check for forced move, but only at depth 2 (so we get a
-         // ponder move if possible).
-         // Do not terminate here if a resign score is returned
-         // (search deeper to get an accurate score). Do not exit
-         // in analysis mode.
-         if (!terminate && controller->typeOfSearch != FixedDepth &&
-             !(controller->background || (controller->typeOfSearch == FixedTime && controller->time_target == Constants::INFINITE_TIME)) &&
-             mg.moveCount() == 1 &&
-             iterationDepth >= 2 &&
-             !(srcOpts.can_resign && stats.display_value <= srcOpts.resign_threshold)) {
-             if (mainThread() && debugOut()) {
-                 std::cout << globals::debugPrefix << "single legal move, terminating" << std::endl;
              }
-             controller->terminateNow();
+             // continue loop with lower bound
+             if (multiPV) {
+                 // re-search with no lower bound
+                 aspirationWindow = Constants::MATE;
+             }
+             else if (fails+1 >= ASPIRATION_WINDOW_STEPS) {
+                 // TBD: Sometimes we can fail low after a bunch of fail highs. Allow the
+                 // search to continue, but set the lower bound to the bottom of the range.
+                 if (mainThread() && debugOut()) {
+                     std::cout << globals::debugPrefix << "too many aspiration window steps, setting window to max width" << std::endl;
+                 }
+                 aspirationWindow = Constants::MATE;
+             }
+             else if (Scoring::mateScore(value)) {
+                 // We got a mate score so don't bother doing any
+                 // more aspiration steps, just widen to the max.
+                 aspirationWindow = Constants::MATE;
+             }
+             else {
+                 aspirationWindow = ASPIRATION_WINDOW[++fails];
+             }
+             if (multiPV) {
+                 lo_window = -Constants::MATE;
+             } else if (aspirationWindow == Constants::MATE) {
+                 // We can miss shallow mates but then find them in
+                 // later iterations. Set the window to -Mate1 so we
+                 // will never fail low and not get a pv.
+                 lo_window = 1-Constants::MATE;
+             } else {
+                 if (iterationDepth <= MoveGenerator::EASY_PLIES) {
+                     aspirationWindow += 2*WIDE_WINDOW;
+                 }
+                 lo_window = std::max<score_t>(nominalDepth-Constants::MATE,hi_window - aspirationWindow);
+             }
          }
+         // check time after adjustments have been made. Do not
+         // allow time-based exit without one completed iteration though.
          if (!terminate) {
-            if (mainThread()) {
-                // Peform any adjustment of the time allocation based
-                // on search status and history
-                controller->historyBasedTimeAdjust(stats);
-                controller->applySearchHistoryFactors();
-                /*
-                if (debugOut() && (controller->searchHistoryBoostFactor != 0 || controller->searchHistoryReductionFactor !=0)) {
-                    std::cout << globals::debugPrefix << "searchHistoryBoostFactor=" << controller->searchHistoryBoostFactor <<
-                        " searchHistoryReductionFactor=" << controller->searchHistoryReductionFactor << std::endl;
-                }
-                */
-            }
-            stats.completedDepth = iterationDepth;
-            if (srcOpts.multipv > 1) {
-               // Accumulate multiple pvs until we are ready to output
-               // them.
-               stats.multi_pvs[stats.multipv_count] = Statistics::MultiPVEntry(stats);
-            }
+             if (checkTime()) {
+                 if (debugOut()) {
+                     std::cout << globals::debugPrefix << "time up" << std::endl;
+                 }
+                 controller->terminateNow();
+             }
+         }
+      } while (!terminate && (stats.failLow || stats.failHigh));
+      // Search value should now be in bounds (unless we are terminating)
+
+      // Check for forced move, but only at depth 2 (so we get a
+      // ponder move if possible).
+      // Do not terminate here if a resign score is returned
+      // (search deeper to get an accurate score). Do not exit
+      // in analysis mode.
+      if (!terminate && controller->typeOfSearch != FixedDepth &&
+          !(controller->background || (controller->typeOfSearch == FixedTime && controller->time_target == Constants::INFINITE_TIME)) &&
+          mg.moveCount() == 1 &&
+          iterationDepth >= 2 &&
+          !(srcOpts.can_resign && stats.display_value <= srcOpts.resign_threshold)) {
+          if (mainThread() && debugOut()) {
+              std::cout << globals::debugPrefix << "single legal move, terminating" << std::endl;
+          }
+          controller->terminateNow();
+      }
+      if (!terminate) {
+         if (mainThread()) {
+             // Peform any adjustment of the time allocation based
+             // on search status and history
+             controller->historyBasedTimeAdjust(stats);
+             controller->applySearchHistoryFactors();
+             /*
+             if (debugOut() && (controller->searchHistoryBoostFactor != 0 || controller->searchHistoryReductionFactor !=0)) {
+                 std::cout << globals::debugPrefix << "searchHistoryBoostFactor=" << controller->searchHistoryBoostFactor <<
+                     " searchHistoryReductionFactor=" << controller->searchHistoryReductionFactor << std::endl;
+             }
+             */
+         }
+         stats.completedDepth = iterationDepth;
 #ifdef _TRACE
-            if (mainThread()) {
-               std::cout << iterationDepth << " ply search result: ";
-               MoveImage(node->best,std::cout);
-               std::cout << " value = ";
-               Scoring::printScore(value,std::cout);
-               std::cout << std::endl;
-            }
+         if (mainThread()) {
+            std::cout << iterationDepth << " ply search result: ";
+            MoveImage(node->best,std::cout);
+            std::cout << " value = ";
+            Scoring::printScore(value,std::cout);
+            std::cout << std::endl;
+         }
 #endif
-            if (!controller->uci || controller->typeOfSearch == TimeLimit) {
-                // Exit in case of forced checkmate.
-                // Note: use nominalDepth for bound, in case we skipped an iteration
-                if (value <= nominalDepth - Constants::MATE && !IsNull(stats.best_line[0])) {
-                    // We're either checkmated or we certainly will be, so
-                    // quit searching.
-                    if (mainThread() && debugOut()) std::cout << globals::debugPrefix << "terminating, low score" << std::endl;
+         if (!controller->uci || controller->typeOfSearch == TimeLimit) {
+             // Exit in case of forced checkmate.
+             // Note: use nominalDepth for bound, in case we skipped an iteration
+             if (value <= nominalDepth - Constants::MATE && !IsNull(stats.best_line[0])) {
+                 // We're either checkmated or we certainly will be, so
+                 // quit searching.
+                 if (mainThread() && debugOut()) std::cout << globals::debugPrefix << "terminating, low score" << std::endl;
 #ifdef _TRACE
-                    std::cout << "terminating, low score" << std::endl;
+                 std::cout << "terminating, low score" << std::endl;
 #endif
-                    controller->terminateNow();
-               }
-               else if (value >= Constants::MATE - nominalDepth - 1 && iterationDepth>=2) {
-                   // found a forced mate, terminate
-                   if (mainThread() && debugOut()) {
-                       std::cout << globals::debugPrefix << "terminating, high score" << std::endl;
-                   }
+                 controller->terminateNow();
+            }
+            else if (value >= Constants::MATE - nominalDepth - 1 && iterationDepth>=2) {
+                // found a forced mate, terminate
+                if (mainThread() && debugOut()) {
+                    std::cout << globals::debugPrefix << "terminating, high score" << std::endl;
+                }
 #ifdef _TRACE
-                   if (mainThread()) {
-                       std::cout << "terminating, high score" << std::endl;
-                       std::cout << "nominalDepth=" << nominalDepth << " value=" << value << " mate threshold=" << Constants::MATE - nominalDepth - 1 << std::endl;
-                   }
+                if (mainThread()) {
+                    std::cout << "terminating, high score" << std::endl;
+                    std::cout << "nominalDepth=" << nominalDepth << " value=" << value << " mate threshold=" << Constants::MATE - nominalDepth - 1 << std::endl;
+                }
 #endif
-                   controller->terminateNow();
-               }
+                controller->terminateNow();
             }
          }
-      } // end multi-pv loop
-      if (stats.multipv_limit>1) {
-          // keep lines in score order
-          stats.sortMultiPVs();
       }
       if (mainThread()) {
          showStatus(board, node->best, false, false);
       }
    } // end depth iteration loop
-   // Make sure we have an active monitor thread
-   controller->pool->lock();
-   if (controller->monitor_function && controller->isMonitorThread(ti->index)) {
-       for (unsigned i = 0; i < controller->pool->size(); ++i) {
-          if (i != ti->index && !controller->pool->isCompletedNoLock(i)) {
-              // appoint this the monitor thread
-              controller->setMonitorThread(i);
-              break;
-          }
-       }
-   }
-   controller->pool->unlock();
    if (mainThread() && debugOut()) {
        if (iterationDepth >= controller->ply_limit) {
            std::cout << globals::debugPrefix << "exiting search due to max depth" << std::endl;
@@ -1358,7 +1523,6 @@ score_t Search::ply0_search(RootMoveGenerator &mg, score_t alpha, score_t beta,
     // implements alpha/beta search for the top most ply.  We use
     // the negascout algorithm.
 
-    --controller->time_check_counter;
     nodeAccumulator++;
 
     int in_check = 0;
@@ -1369,13 +1533,21 @@ score_t Search::ply0_search(RootMoveGenerator &mg, score_t alpha, score_t beta,
     BoardState save_state = board.state;
 
     score_t try_score = alpha;
+    const bool multiPV = stats.multipv_limit > 1;
     //
     // Re-sort the ply 0 moves and re-init move generator.
     if (iterationDepth>1) {
-       mg.reorder(node->best,node->best_score,iterationDepth,false);
+       if (multiPV) {
+          // order by the previous iteration's scores, so the current
+          // best lines are searched first
+          mg.reorderByScore();
+       } else {
+          mg.reorder(node->best,node->best_score,iterationDepth,false);
+       }
     } else {
        mg.reset();
     }
+    rootLineCount = 0;
     stats.mvtot = stats.mvleft = mg.moveCount();
 
     // if in N-variation mode, exclude any moves we have searched already
@@ -1497,12 +1669,15 @@ score_t Search::ply0_search(RootMoveGenerator &mg, score_t alpha, score_t beta,
         }
 #endif
         board.undoMove(move,save_state);
-        if (wide) {
+        if (wide || multiPV) {
             mg.setScore(move_index,try_score);
         }
         // We have now resolved the fail-high if there is one.
         if (try_score > node->best_score && !terminate) {
-           if (updateRootMove(board,node,move,try_score,move_index)) {
+           if (multiPV && try_score < node->beta) {
+              updateRootLines(board,move,try_score);
+           }
+           else if (updateRootMove(board,node,move,try_score,move_index)) {
               // beta cutoff
               // ensure we send UCI output .. even in case of quick
               // termination due to checkmate or whatever
@@ -1540,7 +1715,10 @@ score_t Search::ply0_search(RootMoveGenerator &mg, score_t alpha, score_t beta,
                         std::cout << globals::debugPrefix << "index=" << move_index << " waiting for " << thisWait << " ms." << std::endl;
                     }
                     std::this_thread::sleep_for(std::chrono::milliseconds(thisWait));
-                    // check for input and update elapsed time
+                    if (mainThread() && controller->monitorPending) {
+                        controller->runMonitor(stats);
+                    }
+                    // update elapsed time
                     checkTime();
                 }
             }
@@ -1596,6 +1774,47 @@ score_t Search::ply0_search(RootMoveGenerator &mg, score_t alpha, score_t beta,
     return node->best_score;
 }
 
+void Search::updateRootLines(const Board &board, Move move, score_t score)
+{
+    // Get the PV and stats for this move's line
+    // Note: the live stats are not modified until updateMultiPVStats,
+    // so an interrupted iteration does not leave a partial result there.
+    updatePV(board,node,(node+1),move,0);
+    Statistics lineStats(stats);
+    updateStats(board,node,iterationDepth,score,lineStats);
+    // Insert the line in score order, dropping the lowest-scoring
+    // line if the list is full.
+    unsigned i = std::min<unsigned>(rootLineCount,stats.multipv_limit-1);
+    for (; i > 0 && rootLines[i-1].value < score; --i) {
+        rootLines[i] = rootLines[i-1];
+    }
+    rootLines[i] = Statistics::MultiPVEntry(lineStats);
+    if (rootLineCount < stats.multipv_limit) {
+        ++rootLineCount;
+    }
+    node->best = rootLines[0].best;
+    if (rootLineCount == stats.multipv_limit) {
+        // Other moves only need to be searched accurately if they
+        // score higher than the Nth best line.
+        node->best_score = rootLines[rootLineCount-1].value;
+    }
+}
+
+score_t Search::updateMultiPVStats()
+{
+    for (unsigned i = 0; i < rootLineCount; i++) {
+        stats.multi_pvs[i] = rootLines[i];
+        stats.multi_pvs[i].completedDepth = iterationDepth;
+    }
+    stats.multipv_count = rootLineCount;
+    if (rootLineCount) {
+        // sets the main stats from the best line
+        stats.sortMultiPVs();
+        node->best = stats.multi_pvs[0].best;
+    }
+    return stats.value;
+}
+
 void SearchController::updateGlobalStats(const Statistics &mainStats) {
     *stats = mainStats;
     // Make sure the root probe is counted
@@ -1607,6 +1826,11 @@ void SearchController::updateGlobalStats(const Statistics &mainStats) {
     stats->num_qnodes = stats->reg_nodes = stats->moves_searched = stats->static_null_pruning =
        stats->razored = stats->reduced = (uint64_t)0;
     stats->hash_hits = stats->hash_searches = stats->futility_pruning = stats->null_cuts = (uint64_t)0;
+    stats->hash_prefetches = stats->hash_prefetch_hits = (uint64_t)0;
+#ifdef NUMA
+    stats->hash_node_probes.fill((uint64_t)0);
+    stats->hash_local_probes = (uint64_t)0;
+#endif
     stats->history_pruning = stats->lmp = stats->see_pruning = (uint64_t)0;
     stats->check_extensions = stats->capture_extensions =
     stats->pawn_extensions = stats->singular_extensions = 0L;
@@ -1645,18 +1869,27 @@ void SearchController::updateGlobalStats(const Statistics &mainStats) {
        stats->see_pruning += s.see_pruning;
        stats->hash_hits += s.hash_hits;
        stats->hash_searches += s.hash_searches;
+       stats->hash_prefetches += s.hash_prefetches;
+       stats->hash_prefetch_hits += s.hash_prefetch_hits;
+#ifdef NUMA
+       for (unsigned node = 0; node < Constants::MaxNumaNodes; node++) {
+          stats->hash_node_probes[node] += s.hash_node_probes[node];
+       }
+       stats->hash_local_probes += s.hash_local_probes;
+#endif
 #endif
 #ifdef MOVE_ORDER_STATS
        stats->move_order_count += s.move_order_count;
        for (int i = 0; i < 4; i++) stats->move_order[i] += s.move_order[i];
 #endif
     }
+    completedDepth = stats->completedDepth.load();
 }
 
 Statistics *SearchController::getBestThreadStats(bool trace) const
 {
     Statistics * best = stats;
-    for (int thread = 1; thread < globals::options.search.ncpus; thread++) {
+    for (unsigned thread = 1; thread < pool->size(); thread++) {
         if (pool->data[thread]->work == nullptr) continue;
         Statistics &threadStats = pool->data[thread]->work->stats;
         if (trace) {
@@ -1683,11 +1916,17 @@ Statistics *SearchController::getBestThreadStats(bool trace) const
 unsigned SearchController::nextSearchDepth(unsigned current_depth, unsigned thread_id,
     unsigned max_depth)
 {
+#ifdef SMP_STATS
+    const CLOCK_TYPE start = std::chrono::high_resolution_clock::now();
+    // count at the chosen depth, if it was used in choosing
+    unsigned seen = UINT_MAX;
+#endif
     // Vary the search depth by thread, to make it less likely threads are searching
-    // the same positions.
+    // the same positions. The per-depth counts are atomic and not locked, so
+    // concurrent callers may see slightly stale counts; this only affects how
+    // evenly threads are distributed over depths.
     unsigned d = current_depth+1;
-    const unsigned ncpus = unsigned(globals::options.search.ncpus);
-    std::unique_lock<std::mutex> lock(search_count_mtx);
+    const unsigned ncpus = pool->size();
     if (thread_id > 0) {
         if (current_depth == 0) {
             if (d < max_depth) d += ((thread_id+1) % 2 == 0);
@@ -1696,7 +1935,11 @@ unsigned SearchController::nextSearchDepth(unsigned current_depth, unsigned thre
             unsigned inc = 1;
             while (inc < 8 && d < max_depth) {
                 unsigned threshold = ncpus/(1<<inc);
-                if (threshold == 0 || search_counts[d] < threshold) {
+                const unsigned count = search_counts[d].load(std::memory_order_relaxed);
+                if (threshold == 0 || count < threshold) {
+#ifdef SMP_STATS
+                    seen = count;
+#endif
                     break;
                 } else {
                     ++d;
@@ -1706,12 +1949,33 @@ unsigned SearchController::nextSearchDepth(unsigned current_depth, unsigned thre
         }
     }
     if (d<Constants::MaxPly) {
-        search_counts[current_depth]--;
-        search_counts[d]++;
+        search_counts[current_depth].fetch_sub(1,std::memory_order_relaxed);
+#ifdef SMP_STATS
+        // contended if another thread changed the count since we read it
+        if (search_counts[d].fetch_add(1,std::memory_order_relaxed) != seen &&
+            seen != UINT_MAX) {
+            depth_contention.fetch_add(1,std::memory_order_relaxed);
+        }
+#else
+        search_counts[d].fetch_add(1,std::memory_order_relaxed);
+#endif
     }
+#ifdef SMP_STATS
+    depth_assignments.fetch_add(1,std::memory_order_relaxed);
+    depth_assign_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now()-start).count(),std::memory_order_relaxed);
+#endif
     return d;
 }
 
+#ifdef SMP_STATS
+void SearchController::printDepthAssignStats(std::ostream &o) const
+{
+    const uint64_t n = depth_assignments.load();
+    o << "depth assignments=" << n << " contended=" << depth_contention.load() <<
+        " avg time=" << (n ? depth_assign_ns.load()/n : 0) << " ns";
+}
+#endif
+
 #ifdef _TRACE
 static void traceHash(char type, NodeInfo *node, score_t hashValue, const HashEntry &hashEntry)
 {
@@ -1735,13 +1999,14 @@ score_t Search::quiesce(int ply,int depth)
 #ifdef SMP_STATS
       --controller->sample_counter;
 #endif
-      if (--controller->time_check_counter <= 0) {
-         controller->time_check_counter = controller->timeCheckInterval;
-         if (checkTime()) {
-            if (debugOut()) {
-                std::cout << globals::debugPrefix << "terminating, time up" << std::endl;
-            }
-            controller->terminateNow();   // signal all searches to end
+      if (mainThread()) {
+         // only the main thread checks the node limit, since the
+         // check sums the node counts of all threads
+         if (controller->nodeLimitReached()) {
+            controller->terminateNow();
+         }
+         if (controller->monitorPending) {
+            controller->runMonitor(stats);
          }
       }
    }
@@ -1793,6 +2058,10 @@ score_t Search::quiesce(int ply,int depth)
                                                                   tt_depth,age,hashEntry);
 #ifdef SEARCH_STATS
    stats.hash_searches++;
+   if (hash == prefetchHash) stats.hash_prefetch_hits++;
+#ifdef NUMA
+   countHashProbe(hash);
+#endif
 #endif
    bool hashHit = (result != HashEntry::NoHit);
    if (hashHit) {
@@ -1841,7 +2110,7 @@ score_t Search::quiesce(int ply,int depth)
 #endif
        assert(board.anyAttacks(board.kingSquare(board.sideToMove()),board.oppositeSide()));
        score_t try_score;
-       MoveGenerator mg(board, &context, node, ply, hashMove, mainThread());
+       MoveGenerator mg(board, &context, node, ply, hashMove, mainThread(), srcOpts.legal_movegen);
        Move move;
        BoardState state = board.state;
        node->num_legal = 0;
@@ -1880,9 +2149,10 @@ score_t Search::quiesce(int ply,int depth)
 #endif
                continue;
            }
+           prefetch(board,move);
            node->last_move = move;
            board.doMove(move,node);
-           if (!board.wasLegal(move,true)) {
+           if (!srcOpts.legal_movegen && !board.wasLegal(move,true)) {
                board.undoMove(move,state);
                continue;
            }
@@ -2006,7 +2276,11 @@ score_t Search::quiesce(int ply,int depth)
        BoardState state(board.state);
        const ColorType oside = board.oppositeSide();
        Bitboard disc(board.getPinned(board.kingSquare(oside),board.sideToMove(),board.sideToMove()));
-       QSearchMoveGenerator mg(board,hashMove);
+       Bitboard pinned;
+       if (srcOpts.legal_movegen) {
+           pinned = mg::pinnedPieces(board);
+       }
+       QSearchMoveGenerator mg(board,hashMove,srcOpts.legal_movegen ? &pinned : nullptr);
        Move move;
        while (!IsNull(move=mg.nextMove())) {
            if (Capture(move) == King) {
@@ -2054,9 +2328,10 @@ score_t Search::quiesce(int ply,int depth)
                }
            }
 
+           prefetch(board,move);
            node->last_move = move;
            board.doMove(move,node);
-           if (!board.wasLegal(move)) {
+           if (!srcOpts.legal_movegen && !board.wasLegal(move)) {
                board.undoMove(move,state);
                continue;
            }
@@ -2098,7 +2373,7 @@ score_t Search::quiesce(int ply,int depth)
        }
        // Do checks in qsearch
        if (depth >= 1-srcOpts.checks_in_qsearch) {
-           QSearchCheckGenerator mg(board,disc);
+           QSearchCheckGenerator mg(board,disc,srcOpts.legal_movegen ? &pinned : nullptr);
            Move move;
            while (!IsNull(move = mg.nextCheck())) {
                if (MovesEqual(move,hashMove)) continue;
@@ -2120,7 +2395,7 @@ score_t Search::quiesce(int ply,int depth)
 #endif
                    continue;
                }
-               else if (board.isPinned(board.sideToMove(),move)) {
+               else if (!srcOpts.legal_movegen && board.isPinned(board.sideToMove(),move)) {
                    // Move generator only produces pseudo-legal checking
                    // moves, and in the next ply we will only consider
                    // evasions. So need to ensure here that in making a
@@ -2426,13 +2701,14 @@ score_t Search::search()
            controller->sample_counter = SAMPLE_INTERVAL;
         }
 #endif
-        if (--controller->time_check_counter <= 0) {
-            controller->time_check_counter = controller->timeCheckInterval;
-            if (checkTime()) {
-               if (debugOut()) {
-                   std::cout << globals::debugPrefix << "terminating, time up" << std::endl;
-               }
-               controller->terminateNow();   // signal all searches to end
+        if (mainThread()) {
+            // only the main thread checks the node limit, since the
+            // check sums the node counts of all threads
+            if (controller->nodeLimitReached()) {
+                controller->terminateNow();
+            }
+            if (controller->monitorPending) {
+                controller->runMonitor(stats);
             }
         }
     }
@@ -2485,6 +2761,10 @@ score_t Search::search()
                                                  depth,age,hashEntry);
 #ifdef SEARCH_STATS
        stats.hash_searches++;
+       if (board.hashCode(rep_count) == prefetchHash) stats.hash_prefetch_hits++;
+#ifdef NUMA
+       countHashProbe(board.hashCode(rep_count));
+#endif
 #endif
        hashHit = result != HashEntry::NoHit;
     }
@@ -2509,7 +2789,7 @@ score_t Search::search()
               // parent node will consider this a new best line
               hashMove = hashEntry.bestMove(board);
               if (!IsNull(hashMove)) {
-                  node->pv[ply] = hashMove;
+                  node->pv[0] = hashMove;
                   node->pv_length = 1;
               }
 #ifdef _DEBUG
@@ -2792,7 +3072,12 @@ score_t Search::search()
             NodeState nstate(node);
             Move move;
             // skip pawn captures because they will be below threshold
-            ProbCutMoveGenerator mg(board, hashMove, board.occupied[board.oppositeSide()] & ~board.pawn_bits[board.oppositeSide()]);
+            Bitboard pinned;
+            if (srcOpts.legal_movegen) {
+                pinned = mg::pinnedPieces(board);
+            }
+            ProbCutMoveGenerator mg(board, hashMove, board.occupied[board.oppositeSide()] & ~board.pawn_bits[board.oppositeSide()],
+                                    srcOpts.legal_movegen ? &pinned : nullptr);
             while (!IsNull(move = mg.nextMove())) {
                 if (Capture(move)==King) {
 #ifdef _TRACE
@@ -2813,7 +3098,7 @@ score_t Search::search()
 #endif
                     SetPhase(move,MoveGenerator::WINNING_CAPTURE_PHASE);
                     board.doMove(move,node);
-                    if (!board.wasLegal(move)) {
+                    if (!srcOpts.legal_movegen && !board.wasLegal(move)) {
                         board.undoMove(move,state);
                         continue;
                     }
@@ -2930,9 +3215,14 @@ score_t Search::search()
             !Scoring::mateScore(hashValue) &&
             hashEntry.depth() >= depth - 3*DEPTH_INCREMENT) {
             // Verify hash move legal
-            board.doMove(hashMove,node);
-            const bool legal = board.wasLegal(hashMove);
-            board.undoMove(hashMove,state);
+            bool legal;
+            if (srcOpts.legal_movegen) {
+                legal = mg::isLegal(board,hashMove,mg::pinnedPieces(board));
+            } else {
+                board.doMove(hashMove,node);
+                legal = board.wasLegal(hashMove);
+                board.undoMove(hashMove,state);
+            }
             if (!legal) {
                 hashMove = NullMove;
             } else {
@@ -2999,8 +3289,16 @@ score_t Search::search()
             }
         }
 #endif
-        MoveGenerator mg(board, &context, node, ply, hashMove, mainThread());
+        MoveGenerator mg(board, &context, node, ply, hashMove, mainThread(), srcOpts.legal_movegen);
         score_t try_score;
+        // Moves deferred because another thread is searching them
+        // (ABDADA). These are searched after all other moves.
+        const bool deferMoves = srcOpts.abdada &&
+            depth >= SearchingTable::MIN_DEPTH && controller->pool->size() > 1;
+        static constexpr int MAX_DEFERRED = 32;
+        Move deferred[MAX_DEFERRED];
+        int deferredIndex[MAX_DEFERRED];
+        int deferredCount = 0, deferredNext = -1;
         //
         // Now we are ready to loop through the moves from this position
         //
@@ -3010,9 +3308,28 @@ score_t Search::search()
         while (!node->cutoff && !terminate) {
             score_t hibound = node->num_legal == 0 ? node->beta : node->best_score +1;
             Move move;
-            move = in_check ? mg.nextEvasion(move_index) : mg.nextMove(move_index);
-            if (IsNull(move)) break;
-            if (IsUsed(move) || MovesEqual(move,node->excluded)) continue;
+            if (deferredNext < 0) {
+                move = in_check ? mg.nextEvasion(move_index) : mg.nextMove(move_index);
+                if (IsNull(move)) {
+                    if (deferredCount == 0) break;
+                    // search the deferred moves
+                    deferredNext = 0;
+                }
+                else if (IsUsed(move) || MovesEqual(move,node->excluded)) {
+                    continue;
+                }
+                else if (deferMoves && node->num_legal && deferredCount < MAX_DEFERRED &&
+                         controller->searchingTable.isSearching(board.hashCode(move))) {
+                    deferredIndex[deferredCount] = move_index;
+                    deferred[deferredCount++] = move;
+                    continue;
+                }
+            }
+            if (deferredNext >= 0) {
+                if (deferredNext == deferredCount) break;
+                move_index = deferredIndex[deferredNext];
+                move = deferred[deferredNext++];
+            }
 #ifdef SEARCH_STATS
             ++stats.moves_searched;
 #endif
@@ -3046,6 +3363,7 @@ score_t Search::search()
             int extension = 0, reduction = 0, newDepth = depth - DEPTH_INCREMENT;
             node->swap = Constants::INVALID_SCORE;
             if (singularExtend && GetPhase(move) == MoveGenerator::HASH_MOVE_PHASE) {
+                prefetch(board,move);
                 extension = DEPTH_INCREMENT;
                 newDepth += extension;
 #ifdef SEARCH_STATS
@@ -3056,12 +3374,13 @@ score_t Search::search()
                 if (prune(board, node, in_check_after_move, move_index, improving, move)) {
                     continue;
                 }
+                prefetch(board,move);
                 extension = extend(board, node, in_check_after_move, move);
                 newDepth += extension;
                 reduction = reduce(board, node, move_index, improving, newDepth, move);
             }
             board.doMove(move,node);
-            if (!board.wasLegal(move,in_check)) {
+            if (!srcOpts.legal_movegen && !board.wasLegal(move,in_check)) {
                   assert(board.anyAttacks(board.kingSquare(board.oppositeSide()),board.sideToMove()));
 #ifdef _TRACE
                if (mainThread()) {
@@ -3072,6 +3391,7 @@ score_t Search::search()
                continue;
             }
             setCheckStatus(board, in_check_after_move);
+            if (deferMoves) controller->searchingTable.startSearch(board.hashCode());
 #ifdef SEARCH_STATS
             if (reduction) ++stats.reduced;
 #endif
@@ -3089,6 +3409,7 @@ score_t Search::search()
                     indent(ply); std::cout << "Illegal move" << std::endl;
                 }
 #endif
+                if (deferMoves) controller->searchingTable.finishSearch(board.hashCode());
                 board.undoMove(move,state);
                 continue;
             }
@@ -3125,6 +3446,7 @@ score_t Search::search()
                else
                  try_score=-quiesce(-hibound,-node->best_score,ply+1,0);
             }
+            if (deferMoves) controller->searchingTable.finishSearch(board.hashCode());
             board.undoMove(move,state);
 #ifdef _TRACE
             if (mainThread()) {
@@ -3350,9 +3672,9 @@ void Search::updatePV(const Board &board, NodeInfo *node, NodeInfo *fromNode, Mo
 #ifndef _MSC_VER
 #pragma GCC diagnostic pop
 #endif
-    node->pv[ply] = move;
+    node->pv[0] = move;
     if (fromNode->pv_length) {
-        memcpy((void*)(node->pv+ply+1),(void*)(fromNode->pv+ply+1),
+        memcpy((void*)(node->pv+1),(void*)(fromNode->pv),
             sizeof(Move)*fromNode->pv_length);
     }
     node->pv_length = fromNode->pv_length+1;
@@ -3363,8 +3685,8 @@ void Search::updatePV(const Board &board, NodeInfo *node, NodeInfo *fromNode, Mo
     }
 #endif
     Board board_copy(board);
-    for (int i = ply; i < node->pv_length+ply; i++) {
-        assert(i<Constants::MaxPly);
+    for (int i = 0; i < node->pv_length; i++) {
+        assert(i+ply<Constants::MaxPly);
 #ifdef _TRACE
         if (mainThread()) {
             MoveImage(node->pv[i],std::cout);
@@ -3385,9 +3707,9 @@ void Search::updatePV(const Board &board, NodeInfo *node, NodeInfo *fromNode, Mo
 // Initialize a Search instance to prepare it for searching in a
 // particular thread. This is called from the thread in which the
 // search will execute.
-void Search::init(NodeInfo *nodeStack, ThreadInfo *slave_ti) {
+void Search::init(ThreadInfo *slave_ti) {
     this->board = controller->initialBoard;
-    node = nodeStack;
+    node = searchStack->base();
     assert(node);
     nodeAccumulator = 0;
     ti = slave_ti;
@@ -18,58 +18,75 @@ extern "C" {
 #include <memory.h>
 #include <time.h>
 }
+#include <array>
 #include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 #include <random>
+#include <thread>
 
 class MoveGenerator;
 
-// Per-node info, part of search history stack
+// Per-ply search state. This holds only the frequently accessed
+// fields. The PV, quiet move list and NNUE accumulator for each ply
+// are kept in separate arrays (see SearchStack).
 struct NodeInfo {
-    NodeInfo() : best_score(Constants::INVALID_SCORE),
-                 alpha(Constants::INVALID_SCORE),
+    NodeInfo() : alpha(Constants::INVALID_SCORE),
                  beta(Constants::INVALID_SCORE),
-                 cutoff(0),
-                 num_quiets(0),
-                 num_legal(0),
-                 flags(0),
+                 best_score(Constants::INVALID_SCORE),
+                 eval(Constants::INVALID_SCORE),
+                 staticEval(Constants::INVALID_SCORE),
                  best(NullMove),
                  last_move(NullMove),
                  excluded(NullMove),
-                 eval(Constants::INVALID_SCORE),
-                 staticEval(Constants::INVALID_SCORE),
+                 flags(0),
+                 cutoff(0),
+                 num_legal(0),
+                 num_quiets(0),
+                 ply(0),
+                 depth(0),
+                 swap(Constants::INVALID_SCORE),
                  pv_length(0),
 #ifdef MOVE_ORDER_STATS
                  best_count(0),
 #endif
-                 ply(0),
-                 depth(0),
-                 swap(Constants::INVALID_SCORE)
+                 pv(nullptr),
+                 quiets(nullptr)
+#ifdef NNUE
+                 , accum(nullptr)
+#endif
         {
         }
-    score_t best_score;
     score_t alpha, beta;
-    int cutoff;
-    int num_quiets;
-    int num_legal;
-    int flags;
+    score_t best_score;
+    score_t eval, staticEval;
     Move best;
     Move last_move;
     Move excluded;
-    score_t eval, staticEval;
-    Move pv[Constants::MaxPly];
+    int flags;
+    int cutoff;
+    int num_legal;
+    int num_quiets;
+    int ply, depth;
+    score_t swap;
     int pv_length;
-    Move quiets[Constants::MaxMoves];
 #ifdef MOVE_ORDER_STATS
     int best_count;
 #endif
-    int ply, depth;
-    score_t swap;
+    // PV starting at this ply: pv[0] is the move made at this ply
+    Move *pv;
+    Move *quiets;
 #ifdef NNUE
-    nnue::Network::AccumulatorType accum;
+    nnue::Network::AccumulatorType *accum;
+    // Changes from the previous ply's position. Board::doMove records
+    // only the move: the changes are computed when an incremental
+    // update needs them (dirty_num is DirtyState::Pending+side until
+    // then).
     std::array<DirtyState, 3> dirty;
     unsigned dirty_num;
+    Move dirty_move;
 #endif
 
     int PV() const {
@@ -84,12 +101,44 @@ struct NodeInfo {
     }
 #ifdef NNUE
     void clearNNUEState() {
-        accum.setEmpty();
+        accum->setEmpty();
         dirty_num = 0;
     }
 #endif
 };
 
+// Stack of NodeInfo records used by one search thread, one per ply,
+// together with the per-ply arrays they reference.
+class SearchStack {
+public:
+    static constexpr int Size = Constants::MaxPly + 10;
+
+    SearchStack();
+
+    // node for ply 0
+    NodeInfo *base() noexcept {
+        return nodes;
+    }
+
+private:
+    // PV capacity needed at a given ply. The PV at ply p holds at
+    // most MaxPly-p moves, so the PV buffer is triangular.
+    static constexpr int pvCapacity(int ply) {
+        return ply < Constants::MaxPly - 1 ? Constants::MaxPly - ply : 1;
+    }
+
+    // sum of pvCapacity(ply) over the stack
+    static constexpr int PvBufferSize =
+        Constants::MaxPly*(Constants::MaxPly+1)/2 + Size - Constants::MaxPly;
+
+    NodeInfo nodes[Size];
+    Move pvs[PvBufferSize];
+    Move quiets[Size][Constants::MaxMoves];
+#ifdef NNUE
+    nnue::Network::AccumulatorType accums[Size];
+#endif
+};
+
 // Helper class to save/restore key node parameters
 class NodeState
 {
@@ -115,9 +164,9 @@ public:
         n->cutoff = 0;
         n->num_quiets = n->num_legal = 0;
         n->best = n->last_move = NullMove;
-        (n+1)->pv[ply+1] = NullMove;
+        (n+1)->pv[0] = NullMove;
         (n+1)->pv_length = 0;
-        n->pv[ply] = NullMove;
+        n->pv[0] = NullMove;
         n->pv_length = 0;
 #ifdef MOVE_ORDER_STATS
         n->best_count = 0;
@@ -140,7 +189,7 @@ private:
 // Winboard or "info " for UCI.
 enum class TalkLevel { Silent, Test, Whisper, Debug };
 
-enum SearchType { FixedDepth, TimeLimit, FixedTime };
+enum SearchType { FixedDepth, TimeLimit, FixedTime, FixedNodes };
 
 class SearchController;
 
@@ -153,12 +202,12 @@ public:
 
     Search(SearchController *c, ThreadInfo *ti);
 
-    virtual ~Search() = default;
+    virtual ~Search();
 
     // one-time startup initialization
     static void init();
 
-    void init(NodeInfo *nodeStack, ThreadInfo *child_ti);
+    void init(ThreadInfo *child_ti);
 
     score_t search(score_t alpha, score_t beta,
                    int ply, int depth, int flags = 0, Move exclude = NullMove) {
@@ -195,6 +244,13 @@ public:
 
     virtual void clearHashTables();
 
+#ifdef NUMA
+    // Apply fn to each block of memory owned by this instance:
+    // the instance itself (including the Scoring hash tables), the
+    // node stack, and the history tables.
+    void forEachAllocation(const std::function<void(const void *,size_t)> &fn) const;
+#endif
+
     // We maintain a local copy of the search options, to reduce
     // the need for each thread to query global memory. This
     // forces a reload of that cache from the global options:
@@ -223,10 +279,6 @@ public:
         return talkLevel == TalkLevel::Debug;
     }
 
-    constexpr static int SearchStackSize = Constants::MaxPly + 10;
-
-    using NodeStack = NodeInfo[SearchStackSize];
-
 protected:
 
     enum SearchFlags { IID=1, VERIFY=2, EXACT=4, PROBCUT=8 };
@@ -253,6 +305,15 @@ protected:
 
     void storeHash(hash_t hash, Move hash_move, int depth);
 
+    // Prefetch hash table data for the position after "move" (call
+    // before the move is made).
+    void prefetch(const Board &board, Move move);
+
+#if defined(NUMA) && defined(SEARCH_STATS)
+    // Count a hash probe by the node holding its bucket
+    void countHashProbe(hash_t hash);
+#endif
+
     int updateRootMove(const Board &board,
                        NodeInfo *node, Move move, score_t score, int move_index);
 
@@ -262,6 +323,14 @@ protected:
 
     void updatePV(const Board &board,NodeInfo *node,NodeInfo *fromNode,Move move, int ply);
 
+    // MultiPV: add a root move scoring above the Nth best line to
+    // the list of best lines for this iteration
+    void updateRootLines(const Board &board, Move move, score_t score);
+
+    // MultiPV: copy the completed iteration's lines to the stats.
+    // Returns the best line's score.
+    score_t updateMultiPVStats();
+
     int checkTime();
 
     void showStatus(const Board &board, Move best, bool faillow, bool failhigh);
@@ -282,7 +351,7 @@ protected:
         node->ply = ply;
         node->depth = depth;
         node->cutoff = 0;
-        node->pv[ply] = node->last_move = NullMove;
+        node->pv[0] = node->last_move = NullMove;
         node->pv_length = 0;
     }
 
@@ -294,7 +363,7 @@ protected:
         node->alpha = node->best_score = alpha;
         node->beta = beta;
         node->best = NullMove;
-        node->pv[ply] = NullMove;
+        node->pv[0] = NullMove;
         node->pv_length = 0;
     }
 
@@ -309,8 +378,14 @@ protected:
 
     void setTalkLevelFromController();
 
+    void updateStats(const Board &board, NodeInfo *node,int iteration_depth,
+		     score_t score) {
+        updateStats(board,node,iteration_depth,score,stats);
+    }
+
+    // Set the score, depth and PV of "s" from the search state
     void updateStats(const Board &, NodeInfo *node,int iteration_depth,
-		     score_t score);
+		     score_t score, Statistics &s);
 
     void suboptimal(RootMoveGenerator &mg, Move &m, score_t &val);
 
@@ -324,10 +399,18 @@ protected:
     Board board;
     Statistics stats;
     int iterationDepth;
+    // MultiPV: best lines in the current iteration, in score order
+    std::array<Statistics::MultiPVEntry,Statistics::MAX_PV> rootLines;
+    unsigned rootLineCount;
     SearchContext context;
-    int terminate;
+    // set by SearchController::terminateNow, possibly from another
+    // thread
+    std::atomic<int> terminate;
     int nodeAccumulator;
-    NodeInfo *node; // pointer into node stack (external to class)
+    // Node stack, allocated once and reused for every search done
+    // by this instance
+    SearchStack *searchStack;
+    NodeInfo *node; // pointer into node stack
     Scoring scoring;
     ThreadInfo *ti; // thread now running this search
     // The following variables are maintained as local copies of
@@ -339,6 +422,47 @@ protected:
     int age;
     TalkLevel talkLevel; // copy of controller's talkLevel
     std::mt19937_64 random_engine;
+#ifdef SEARCH_STATS
+    hash_t prefetchHash; // hash code of the last prefetched position
+#endif
+};
+
+// Table of positions currently being searched by some thread, used
+// to implement "simplified ABDADA" (see
+// http://www.tckerrigan.com/Chess/Parallel_Search/Simplified_ABDADA/).
+// A thread defers a move whose resulting position is in the table,
+// and searches it after the rest of the moves. Access is lock-free:
+// races and collisions only cause unneeded or missed deferrals.
+class SearchingTable {
+public:
+    // Minimum depth at which positions are recorded or moves deferred
+    static constexpr int MIN_DEPTH = 3*DEPTH_INCREMENT;
+
+    SearchingTable() {
+        clear();
+    }
+
+    void clear() {
+        for (auto &entry : table) entry.store(0,std::memory_order_relaxed);
+    }
+
+    bool isSearching(hash_t hash) const {
+        return table[hash & MASK].load(std::memory_order_relaxed) == hash;
+    }
+
+    void startSearch(hash_t hash) {
+        table[hash & MASK].store(hash,std::memory_order_relaxed);
+    }
+
+    void finishSearch(hash_t hash) {
+        table[hash & MASK].compare_exchange_strong(hash,0,std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t SIZE = 32768; // must be a power of 2
+    static constexpr hash_t MASK = SIZE-1;
+
+    std::array<std::atomic<hash_t>,SIZE> table;
 };
 
 class SearchController {
@@ -431,6 +555,21 @@ public:
 
     void resizeHash(size_t newSize);
 
+    // Save the main hash table to a file. Returns false and sets err
+    // on failure.
+    bool saveHash(const std::string &fileName, std::string &err) const {
+        return hashTable.save(fileName, age, err);
+    }
+
+    // Restore the main hash table from a file written by saveHash.
+    // Returns false and sets err on failure.
+    bool loadHash(const std::string &fileName, std::string &err);
+
+    // Time in milliseconds taken by the last hash table clear
+    uint64_t getHashClearTime() const noexcept {
+        return hashClearTime;
+    }
+
     void stopAllThreads();
 
     void clearStopFlags();
@@ -457,6 +596,12 @@ public:
         applySearchHistoryFactors();
     }
 
+    // Set the node limit for FixedNodes searches. This is the total
+    // across all threads.
+    void setNodeLimit(uint64_t nodes) {
+        node_limit = nodes;
+    }
+
     void setContempt(score_t contempt);
 
     score_t getContempt() const noexcept {
@@ -486,6 +631,9 @@ public:
 
     Hash hashTable;
 
+    // positions being searched, shared by all threads
+    SearchingTable searchingTable;
+
     score_t drawScore(const Board &board, const Statistics *stats = nullptr) {
       // if we know the opponent's rating (which will be the case if playing
       // on ICC in xboard mode), or if the user has set a contempt value
@@ -508,6 +656,16 @@ public:
        return elapsed_time;
     }
 
+    // Called by each helper thread when it starts searching. Records
+    // the time since findBestMove was entered.
+    void recordHelperStart();
+
+    // Time in microseconds from entry to findBestMove until the last
+    // helper thread started searching (0 if there are no helpers).
+    uint64_t getHelperStartLatency() const {
+       return helper_start_ns/1000;
+    }
+
 #ifdef SMP_STATS
 	double getCpuPercentage() const {
       if (samples)
@@ -515,6 +673,9 @@ public:
       else
          return 0.0;
    }
+
+   // Output statistics for assigning search depths to threads
+   void printDepthAssignStats(std::ostream &) const;
 #endif
 
    void updateGlobalStats(const Statistics &);
@@ -525,6 +686,14 @@ public:
       return pool->totalNodes();
    }
 
+   // True if a FixedNodes search has used its node budget. As with
+   // time limits, at least one iteration must be completed. Called
+   // from the main search thread.
+   bool nodeLimitReached() const {
+      return typeOfSearch == FixedNodes && completedDepth > 0 &&
+         totalNodes() >= node_limit;
+   }
+
    uint64_t totalHits() const {
       return pool->totalHits();
    }
@@ -546,13 +715,9 @@ public:
        return pool->isCompleted(0);
    }
 
-   bool isMonitorThread(unsigned id) const noexcept {
-       return id == monitorThread;
-   }
-
-   void setMonitorThread(unsigned id) {
-       monitorThread = id;
-   }
+   // True if the time limit has been reached. Time is checked only
+   // after at least one iteration is completed.
+   bool timeUp() const;
 
    const Statistics &getGlobalStats() const noexcept {
        return *stats;
@@ -579,6 +744,9 @@ private:
     // check console input
     int check_input(const Board &);
 
+    // Clear the main hash table, using all threads in the pool
+    void clearHash();
+
     unsigned nextSearchDepth(unsigned current_depth, unsigned thread_id,
         unsigned max_depth);
 
@@ -587,11 +755,15 @@ private:
     TalkLevel talkLevel;
     // time limit is nominal time limit in centiseconds
     // time target is actual time to search in centiseconds
-    uint64_t time_limit, time_target;
+    // (the time variables are atomic because they are read by the
+    // timer thread and may change during the search)
+    std::atomic<uint64_t> time_limit, time_target;
     // Max amount of time we can add if score is dropping:
-    uint64_t xtra_time;
+    std::atomic<uint64_t> xtra_time;
+    // node limit, for FixedNodes searches
+    uint64_t node_limit;
     std::atomic<int64_t> bonus_time;
-    bool fail_high_root_extend, fail_low_root_extend, fail_high_root;
+    std::atomic<bool> fail_high_root_extend, fail_low_root_extend, fail_high_root;
     // Factors to use to adjust time up/down based on search history:
     double searchHistoryBoostFactor, searchHistoryReductionFactor, maxBoostFactor;
     int maxBoostDepth;
@@ -599,11 +771,9 @@ private:
     std::atomic<bool> background;
     std::atomic<bool> is_searching;
     // flag for UCI. When set the search will terminate at the
-    // next time check interval:
-    bool stopped;
-    SearchType typeOfSearch;
-    int time_check_counter;
-    int timeCheckInterval;
+    // next timer check:
+    std::atomic<bool> stopped;
+    std::atomic<SearchType> typeOfSearch;
 #ifdef SMP_STATS
     int sample_counter;
 #endif
@@ -616,7 +786,36 @@ private:
     Search *rootSearch;
     int tb_root_probes, tb_root_hits;
     bool tb_probe_in_search;
-    unsigned monitorThread;
+
+    // The timer thread checks time limits while a search is in
+    // progress, and idles between searches. It does not do any
+    // output or access the stats: instead it sets monitorPending,
+    // and the main search thread then polls for input via the monitor
+    // function and outputs periodic UCI info (see runMonitor).
+    std::thread timerThread;
+    std::mutex timerMtx;
+    std::condition_variable timerCv;
+    bool timerActive; // search in progress
+    bool timerBusy; // timer thread is processing a search
+    bool timerExit;
+    unsigned timerInterval; // in milliseconds
+    std::atomic<bool> monitorPending;
+    // completed depth of the search, for time checks
+    std::atomic<unsigned> completedDepth;
+
+    void timerLoop();
+
+    // Periodic checks, called from the timer thread
+    void timerCheck();
+
+    // Poll for input and do periodic output. Called from the main
+    // search thread when monitorPending is set.
+    void runMonitor(Statistics &mainStats);
+
+    void startTimer();
+
+    // Stop the timer and wait until it is idle
+    void stopTimer();
 
     MoveSet include;
     MoveSet exclude;
@@ -646,12 +845,18 @@ private:
     score_t initialValue;
     RootMoveGenerator *mg;
 
-    uint64_t elapsed_time; // in milliseconds
-    std::array <unsigned, Constants::MaxPly> search_counts;
-    std::mutex search_count_mtx;
+    std::atomic<uint64_t> elapsed_time; // in milliseconds
+    CLOCK_TYPE entryTime; // time findBestMove was called
+    std::atomic<uint64_t> helper_start_ns; // see recordHelperStart
+    uint64_t hashClearTime; // in milliseconds
+    // number of threads searching each depth (see nextSearchDepth)
+    std::array <std::atomic<unsigned>, Constants::MaxPly> search_counts;
 
 #ifdef SMP_STATS
     uint64_t samples, threads;
+    // depth assignment calls, calls that raced with another thread,
+    // and total time spent in nextSearchDepth
+    std::atomic<uint64_t> depth_assignments, depth_contention, depth_assign_ns;
 #endif
 
 };
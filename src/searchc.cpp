@@ -43,6 +43,15 @@ void SearchContext::clear() {
                 }
 }
 
+#ifdef NUMA
+void SearchContext::forEachAllocation(const std::function<void(const void *,size_t)> &fn) const {
+    fn(history,sizeof(*history));
+    fn(counterMoves,sizeof(*counterMoves));
+    fn(counterMoveHistory,sizeof(*counterMoveHistory));
+    fn(fuMoveHistory,sizeof(*fuMoveHistory));
+}
+#endif
+
 void SearchContext::clearKiller() {
     for (int i = 0; i < Constants::MaxPly + 2; i++) {
         killers1[i] = killers2[i] = NullMove;
@@ -1,4 +1,4 @@
-// Copyright 2006-2008, 2016-2019 by Jon Dart. All Rights Reserved.
+// Copyright 2006-2008, 2016-2019, 2022 by Jon Dart. All Rights Reserved.
 
 #ifndef _SEARCHC_H
 #define _SEARCHC_H
@@ -8,6 +8,9 @@
 #include "chess.h"
 
 #include <array>
+#ifdef NUMA
+#include <functional>
+#endif
 #include <limits>
 
 struct NodeInfo;
@@ -25,6 +28,11 @@ public:
 
     void clearKiller();
 
+#ifdef NUMA
+    // Apply fn to each block of memory allocated by this object
+    void forEachAllocation(const std::function<void(const void *,size_t)> &fn) const;
+#endif
+
     void setKiller(const Move & move,unsigned ply)
     {
         if (!MovesEqual(move,killers1[ply])) {
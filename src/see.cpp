@@ -72,7 +72,12 @@ score_t see( const Board &board, Move move ) {
    Square attack_square = StartSquare(move);
    Piece on_square = (TypeOfMove(move) == EnPassant) ? 
        MakePiece(Pawn,oside) : board[square];
-   Bitboard opp_attacks(board.calcAttacks(square,oside));
+   Bitboard opp_attacks;
+   // If the opponent's attacked squares are cached, use them to
+   // detect an undefended piece without computing its attackers.
+   if (!board.hasAttackedSquares(oside) || board.attackedSquares(oside).isSet(square)) {
+      opp_attacks = board.calcAttacks(square,oside);
+   }
    if (opp_attacks.isClear()) {
        // piece is undefended
 #ifdef ATTACK_TRACE
@@ -190,7 +195,12 @@ score_t seeSign( const Board &board, Move move, score_t threshold ) {
    Square attack_square = StartSquare(move);
    Piece on_square = (TypeOfMove(move) == EnPassant) ? 
        MakePiece(Pawn,oside) : board[square];
-   Bitboard opp_attacks(board.calcAttacks(square,oside));
+   Bitboard opp_attacks;
+   // If the opponent's attacked squares are cached, use them to
+   // detect an undefended piece without computing its attackers.
+   if (!board.hasAttackedSquares(oside) || board.attackedSquares(oside).isSet(square)) {
+      opp_attacks = board.calcAttacks(square,oside);
+   }
    if (opp_attacks.isClear()) {
        // piece is undefended
 #ifdef ATTACK_TRACE
@@ -64,6 +64,12 @@ Statistics::Statistics(const Statistics &s)
       see_pruning = s.see_pruning;
       hash_hits = s.hash_hits;
       hash_searches = s.hash_searches;
+      hash_prefetches = s.hash_prefetches;
+      hash_prefetch_hits = s.hash_prefetch_hits;
+#ifdef NUMA
+      hash_node_probes = s.hash_node_probes;
+      hash_local_probes = s.hash_local_probes;
+#endif
 #endif
       num_nodes = s.num_nodes.load();
 #ifdef MOVE_ORDER_STATS
@@ -126,6 +132,12 @@ Statistics & Statistics::operator = (const Statistics &s)
       see_pruning = s.see_pruning;
       hash_hits = s.hash_hits;
       hash_searches = s.hash_searches;
+      hash_prefetches = s.hash_prefetches;
+      hash_prefetch_hits = s.hash_prefetch_hits;
+#ifdef NUMA
+      hash_node_probes = s.hash_node_probes;
+      hash_local_probes = s.hash_local_probes;
+#endif
 #endif
       num_nodes = s.num_nodes.load();
 #ifdef MOVE_ORDER_STATS
@@ -147,6 +159,11 @@ void Statistics::clear()
    num_qnodes = reg_nodes = moves_searched = static_null_pruning =
        razored = reduced = singular_searches = (uint64_t)0;
    hash_hits = hash_searches = futility_pruning = null_cuts = (uint64_t)0;
+   hash_prefetches = hash_prefetch_hits = (uint64_t)0;
+#ifdef NUMA
+   hash_node_probes.fill((uint64_t)0);
+   hash_local_probes = (uint64_t)0;
+#endif
    history_pruning = lmp = see_pruning = (uint64_t)0;
    check_extensions = capture_extensions =
      pawn_extensions = singular_extensions = 0L;
@@ -58,6 +58,14 @@ struct Statistics
    uint64_t see_pruning;
    uint64_t hash_hits;
    uint64_t hash_searches;
+   uint64_t hash_prefetches; // prefetches of child hash buckets
+   uint64_t hash_prefetch_hits; // prefetches followed by a probe of that bucket
+#ifdef NUMA
+   // hash probes by the node holding the bucket, and probes of a
+   // bucket on the searching thread's own node
+   std::array<uint64_t,Constants::MaxNumaNodes> hash_node_probes;
+   uint64_t hash_local_probes;
+#endif
 #endif
    // atomic because may need to be read during a search:
    std::atomic<uint64_t> num_nodes;
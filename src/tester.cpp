@@ -5,7 +5,10 @@
 #include "globals.h"
 #include "notation.h"
 
+#include <atomic>
 #include <iomanip>
+#include <mutex>
+#include <thread>
 
 using namespace std::placeholders;
 
@@ -18,6 +21,11 @@ void Tester::do_test(SearchController *searcher, const std::string &test_file, c
         type = FixedDepth;
         time_limit = Constants::INFINITE_TIME;
     }
+    else if (opts.node_limit) {
+        type = FixedNodes;
+        time_limit = Constants::INFINITE_TIME;
+        depth_limit = Constants::MaxPly;
+    }
     else {
         type = FixedTime;
         depth_limit = Constants::MaxPly;
@@ -29,7 +37,6 @@ void Tester::do_test(SearchController *searcher, const std::string &test_file, c
 
     globals::delayedInit();
 
-    Board board;
     std::ifstream pos_file( test_file.c_str(), std::ios::in);
     if (!pos_file) {
         std::cout << "Failed to open EPD file." << std::endl;
@@ -37,171 +44,23 @@ void Tester::do_test(SearchController *searcher, const std::string &test_file, c
     }
     TestTotals testTotals;
 
-    std::string buf;
-    while (!pos_file.eof()) {
-        std::getline(pos_file,buf);
-        if (!pos_file) {
-            std::cout << "Error reading EPD file." << std::endl;
-            return;
-        }
-        // Try to parse this line as an EPD command.
-        std::stringstream stream(buf);
-        std::string id, comment;
-        EPDRecord epd_rec;
-        if (!ChessIO::readEPDRecord(stream,board,epd_rec)) break;
-        if (epd_rec.hasError()) {
-            std::cerr << "error in EPD record ";
-            if (id.length()>0) std::cerr << id;
-            std::cerr << ": ";
-            std::cerr << epd_rec.getError();
-            std::cerr << std::endl;
-        }
-        else {
-            TestStatus testStats;
-            int illegal=0;
-            id = "";
-            for (unsigned i = 0; i < epd_rec.getSize(); i++) {
-                std::string key, val;
-                epd_rec.getData(i,key,val);
-                if (key == "bm" || key == "am") {
-                    Move m;
-                    std::stringstream s(val);
-                    while (!s.eof()) {
-                        std::string moveStr;
-                        // skips spaces
-                        s >> moveStr;
-                        if (s.bad() || s.fail() || !moveStr.length()) {
-                            std::cerr << "error reading solution move " << val << std::endl;
-                            break;
-                        }
-                        m = Notation::value(board,board.sideToMove(),Notation::InputFormat::SAN,moveStr);
-                        if (IsNull(m)) {
-                            ++illegal;
-                        } else {
-                            testStats.solution_moves.push_back(m);
-                        }
-                        testStats.avoid = (key == "am");
-                    }
-                }
-                else if (key == "id") {
-                    id = val;
-                }
-                else if (key == "c0") {
-                    comment = val;
-                }
-            }
-            if (illegal) {
-                std::cerr << "illegal or invalid solution move(s) for EPD record ";
-                if (id.length()>0) std::cerr << id;
-                std::cerr << std::endl;
-                continue;
-            }
-            else if (testStats.solution_moves.size() == 0) {
-                std::cerr << "no solution move(s) for EPD record ";
-                if (id.length()>0) std::cerr << id;
-                std::cerr << std::endl;
-                continue;
-            }
-            std::cout << id << ' ';
-            if (comment.length()) std::cout << comment << ' ';
-            if (testStats.avoid) {
-                std::cout << "am ";
-            }
-            else {
-                std::cout << "bm";
-            }
-            for (Move m : testStats.solution_moves) {
-                std::cout << ' ';
-                Notation::image(board,m,Notation::OutputFormat::SAN,std::cout);
-            }
-            std::cout << std::endl;
-            MoveSet excludes;
-            testTotals.total_tests++;
-            Statistics stats;
-            auto old_post = searcher->registerPostFunction(
-                std::bind(&Tester::post_test,this,_1,searcher,std::cref(opts),std::ref(testStats)));
-            auto old_monitor = searcher->registerMonitorFunction(
-                std::bind(&Tester::monitor,this,_1,_2,std::cref(opts),std::ref(testStats)));
-            for (int index = 0; index < opts.moves_to_search; index++) {
-                searcher->clearHashTables();
-                stats.clear();
-
-                MoveSet includes;
-                Move result = searcher->findBestMove(board,
-                                  type,
-                                  time_limit, 0, depth_limit,
-                                  0, 0, stats,
-                                  opts.verbose ? TalkLevel::Test : TalkLevel::Silent,
-                                  excludes, includes);
-                // ensure stats and search history are updated with latest results
-                post_test(stats, searcher, opts, testStats);
-                if (excludes.size())
-                    std::cout << "result(" << excludes.size()+1 << "):";
-                else
-                    std::cout << "result:";
-                std::cout << '\t';
-                Notation::image(board,result,Notation::OutputFormat::SAN,std::cout);
-                std::cout << "\tscore: ";
-                Scoring::printScore(stats.display_value,std::cout);
-                std::cout <<  '\t';
-                globals::gameMoves->removeAll();
-
-                if (IsNull(result)) break;
-                testTotals.total_time += searcher->getElapsedTime();
-                testTotals.total_nodes += stats.num_nodes;
-                excludes.insert(result);
-                bool correct = testStats.solution_time >=0 &&
-                    solution_match(testStats.solution_moves,
-                                   result,testStats.avoid);
-                if (index == 0) {
-                    // only put solutions in summary at end if they are
-                    // made on the first search attempt.
-                    testTotals.solution_times.push_back((int)testStats.solution_time);
-                    if (correct) {
-                        testTotals.total_correct++;
-                    }
-                }
-                std::ios_base::fmtflags original_flags = std::cout.flags();
-                std::cout << std::setprecision(4);
-                if (correct) {
-                    std::cout << "\t++ solved in " << (float)testStats.solution_time/1000.0 <<
-                        " sec. (";
-                    print_nodes(testStats.solution_nodes,std::cout);
-                }
-                else {
-                    std::cout << "\t** not solved in " <<
-                        (float)searcher->getElapsedTime()/1000.0 << " secs. (";
-                    print_nodes(stats.num_nodes,std::cout);
-                }
-                std::cout << " nodes)" << std::endl;
-                std::cout.flags(original_flags);
-                std::cout << stats.best_line_image << std::endl;
-                const auto &sp = testStats.search_progress;
-                if (index == 0 && correct) {
-                    auto it = std::find_if(sp.rbegin(),sp.rend(),
-                                           [this,&testStats](const TestStatus::SearchProgress &s) -> bool {
-                                               return solution_match(testStats.solution_moves,
-                                                                     s.move,
-                                                                     testStats.avoid);});
-                    if (it != sp.rend()) {
-                        testTotals.time_to_find_total += it->time;
-                        testTotals.depth_to_find_total += it->depth;
-                        testTotals.nodes_to_find_total += it->num_nodes;
-                    }
-                }
-            }
-            searcher->registerPostFunction(old_post);
-            searcher->registerMonitorFunction(old_monitor);
+    if (opts.instances > 1) {
+        std::vector<TestCase> tests;
+        for (;;) {
+            TestCase test;
+            bool valid;
+            if (!read_test(pos_file,test,valid)) break;
+            if (valid) tests.push_back(test);
         }
-
-        int c;
-        while (!pos_file.eof()) {
-            c = pos_file.get();
-            if (!isspace(c) && c != '\n') {
-                if (!pos_file.eof()) {
-                    pos_file.putback(c);
-                }
-                break;
+        run_parallel(tests,opts,type,time_limit,depth_limit,testTotals);
+    }
+    else {
+        for (;;) {
+            TestCase test;
+            bool valid;
+            if (!read_test(pos_file,test,valid)) break;
+            if (valid) {
+                run_test(searcher,test,opts,type,time_limit,depth_limit,std::cout,testTotals);
             }
         }
     }
@@ -251,6 +110,261 @@ void Tester::do_test(SearchController *searcher, const std::string &test_file, c
     globals::options = tmp;
 }
 
+bool Tester::read_test(std::istream &pos_file, TestCase &test, bool &valid)
+{
+    valid = false;
+    if (pos_file.eof()) return false;
+    std::string buf;
+    std::getline(pos_file,buf);
+    if (!pos_file) {
+        std::cout << "Error reading EPD file." << std::endl;
+        return false;
+    }
+    // Try to parse this line as an EPD command.
+    std::stringstream stream(buf);
+    EPDRecord epd_rec;
+    Board &board = test.board;
+    TestStatus &testStats = test.testStats;
+    std::string &id = test.id;
+    if (!ChessIO::readEPDRecord(stream,board,epd_rec)) return false;
+    if (epd_rec.hasError()) {
+        std::cerr << "error in EPD record ";
+        if (id.length()>0) std::cerr << id;
+        std::cerr << ": ";
+        std::cerr << epd_rec.getError();
+        std::cerr << std::endl;
+    }
+    else {
+        int illegal=0;
+        for (unsigned i = 0; i < epd_rec.getSize(); i++) {
+            std::string key, val;
+            epd_rec.getData(i,key,val);
+            if (key == "bm" || key == "am") {
+                Move m;
+                std::stringstream s(val);
+                while (!s.eof()) {
+                    std::string moveStr;
+                    // skips spaces
+                    s >> moveStr;
+                    if (s.bad() || s.fail() || !moveStr.length()) {
+                        std::cerr << "error reading solution move " << val << std::endl;
+                        break;
+                    }
+                    m = Notation::value(board,board.sideToMove(),Notation::InputFormat::SAN,moveStr);
+                    if (IsNull(m)) {
+                        ++illegal;
+                    } else {
+                        testStats.solution_moves.push_back(m);
+                    }
+                    testStats.avoid = (key == "am");
+                }
+            }
+            else if (key == "id") {
+                id = val;
+            }
+            else if (key == "c0") {
+                test.comment = val;
+            }
+        }
+        if (illegal) {
+            std::cerr << "illegal or invalid solution move(s) for EPD record ";
+            if (id.length()>0) std::cerr << id;
+            std::cerr << std::endl;
+        }
+        else if (testStats.solution_moves.size() == 0) {
+            std::cerr << "no solution move(s) for EPD record ";
+            if (id.length()>0) std::cerr << id;
+            std::cerr << std::endl;
+        }
+        else {
+            valid = true;
+        }
+    }
+
+    int c;
+    while (!pos_file.eof()) {
+        c = pos_file.get();
+        if (!isspace(c) && c != '\n') {
+            if (!pos_file.eof()) {
+                pos_file.putback(c);
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+void Tester::run_test(SearchController *searcher, TestCase &test,
+                      const TestOptions &opts, SearchType type,
+                      int time_limit, int depth_limit,
+                      std::ostream &out, TestTotals &testTotals)
+{
+    const Board &board = test.board;
+    TestStatus &testStats = test.testStats;
+    out << test.id << ' ';
+    if (test.comment.length()) out << test.comment << ' ';
+    if (testStats.avoid) {
+        out << "am ";
+    }
+    else {
+        out << "bm";
+    }
+    for (Move m : testStats.solution_moves) {
+        out << ' ';
+        Notation::image(board,m,Notation::OutputFormat::SAN,out);
+    }
+    out << std::endl;
+    MoveSet excludes;
+    testTotals.total_tests++;
+    Statistics stats;
+    auto old_post = searcher->registerPostFunction(
+        std::bind(&Tester::post_test,this,_1,searcher,std::cref(opts),std::ref(testStats)));
+    auto old_monitor = searcher->registerMonitorFunction(
+        std::bind(&Tester::monitor,this,_1,_2,std::cref(opts),std::ref(testStats)));
+    for (int index = 0; index < opts.moves_to_search; index++) {
+        searcher->clearHashTables();
+        stats.clear();
+
+        MoveSet includes;
+        searcher->setNodeLimit(opts.node_limit);
+        Move result = searcher->findBestMove(board,
+                                             type,
+                                             time_limit, 0, depth_limit,
+                                             0, 0, stats,
+                                             opts.verbose ? TalkLevel::Test : TalkLevel::Silent,
+                                             excludes, includes);
+        // ensure stats and search history are updated with latest results
+        post_test(stats, searcher, opts, testStats);
+        if (excludes.size())
+            out << "result(" << excludes.size()+1 << "):";
+        else
+            out << "result:";
+        out << '\t';
+        Notation::image(board,result,Notation::OutputFormat::SAN,out);
+        out << "\tscore: ";
+        Scoring::printScore(stats.display_value,out);
+        out <<  '\t';
+        if (opts.instances == 1) {
+            globals::gameMoves->removeAll();
+        }
+
+        if (IsNull(result)) break;
+        testTotals.total_time += searcher->getElapsedTime();
+        testTotals.total_nodes += stats.num_nodes;
+        excludes.insert(result);
+        bool correct = testStats.solution_time >=0 &&
+            solution_match(testStats.solution_moves,
+                           result,testStats.avoid);
+        if (index == 0) {
+            // only put solutions in summary at end if they are
+            // made on the first search attempt.
+            testTotals.solution_times.push_back((int)testStats.solution_time);
+            if (correct) {
+                testTotals.total_correct++;
+            }
+        }
+        std::ios_base::fmtflags original_flags = out.flags();
+        out << std::setprecision(4);
+        if (correct) {
+            out << "\t++ solved in " << (float)testStats.solution_time/1000.0 <<
+                " sec. (";
+            print_nodes(testStats.solution_nodes,out);
+        }
+        else {
+            out << "\t** not solved in " <<
+                (float)searcher->getElapsedTime()/1000.0 << " secs. (";
+            print_nodes(stats.num_nodes,out);
+        }
+        out << " nodes)" << std::endl;
+        out.flags(original_flags);
+        out << stats.best_line_image << std::endl;
+        const auto &sp = testStats.search_progress;
+        if (index == 0 && correct) {
+            auto it = std::find_if(sp.rbegin(),sp.rend(),
+                                   [this,&testStats](const TestStatus::SearchProgress &s) -> bool {
+                                       return solution_match(testStats.solution_moves,
+                                                             s.move,
+                                                             testStats.avoid);});
+            if (it != sp.rend()) {
+                testTotals.time_to_find_total += it->time;
+                testTotals.depth_to_find_total += it->depth;
+                testTotals.nodes_to_find_total += it->num_nodes;
+            }
+        }
+    }
+    searcher->registerPostFunction(old_post);
+    searcher->registerMonitorFunction(old_monitor);
+}
+
+void Tester::run_parallel(std::vector<TestCase> &tests,
+                          const TestOptions &opts, SearchType type,
+                          int time_limit, int depth_limit,
+                          TestTotals &testTotals)
+{
+    const unsigned instances = std::min<unsigned>(opts.instances,
+                                                  std::max<size_t>(1,tests.size()));
+    // Divide the threads and hash memory among the instances.
+    // Controllers are created here because their initialization
+    // reads the global options.
+    Options tmp(globals::options);
+    const int cores = std::max<int>(1,globals::options.search.ncpus/instances);
+    globals::options.search.ncpus = cores;
+    globals::options.search.hash_table_size /= instances;
+    std::vector<SearchController *> searchers;
+    for (unsigned i = 0; i < instances; i++) {
+        SearchController *s = new SearchController();
+        s->updateSearchOptions();
+        s->setThreadCount(cores);
+        searchers.push_back(s);
+    }
+    globals::options.search.ncpus = tmp.search.ncpus;
+    globals::options.search.hash_table_size = tmp.search.hash_table_size;
+
+    // per-position output and totals, merged in EPD file order
+    std::vector<std::string> outputs(tests.size());
+    std::vector<TestTotals> totals(tests.size());
+    std::vector<bool> done(tests.size(),false);
+    std::atomic<size_t> next(0);
+    size_t nextOutput = 0;
+    std::mutex outputLock;
+
+    auto worker = [&](SearchController *searcher) {
+        for (size_t i; (i = next.fetch_add(1)) < tests.size(); ) {
+            std::stringstream out;
+            run_test(searcher,tests[i],opts,type,time_limit,depth_limit,out,totals[i]);
+            std::unique_lock<std::mutex> lock(outputLock);
+            outputs[i] = out.str();
+            done[i] = true;
+            for (; nextOutput < tests.size() && done[nextOutput]; ++nextOutput) {
+                std::cout << outputs[nextOutput] << std::flush;
+                testTotals.add(totals[nextOutput]);
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (SearchController *s : searchers) {
+        threads.push_back(std::thread(worker,s));
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    for (SearchController *s : searchers) {
+        delete s;
+    }
+}
+
+void Tester::TestTotals::add(const TestTotals &t)
+{
+    total_nodes += t.total_nodes;
+    total_correct += t.total_correct;
+    total_tests += t.total_tests;
+    total_time += t.total_time;
+    solution_times.insert(solution_times.end(),t.solution_times.begin(),t.solution_times.end());
+    nodes_to_find_total += t.nodes_to_find_total;
+    depth_to_find_total += t.depth_to_find_total;
+    time_to_find_total += t.time_to_find_total;
+}
+
 bool Tester::solution_match(const std::vector<Move> &solution_moves,
                             Move result, bool avoid) const noexcept {
     bool match = false;
@@ -22,6 +22,8 @@ public:
         int time_limit;
         int early_exit_plies;
         int moves_to_search;
+        uint64_t node_limit; // if non-zero, search a fixed number of nodes
+        int instances; // number of positions searched concurrently
         bool verbose;
         
         TestOptions() :
@@ -29,6 +31,8 @@ public:
             time_limit(Constants::INFINITE_TIME),
             early_exit_plies(Constants::MaxPly),
             moves_to_search(1),
+            node_limit(0),
+            instances(1),
             verbose(false) {
         }
     };
@@ -99,8 +103,39 @@ private:
             time_to_find_total(0ULL)
             {
             }
+
+        // add results from another run
+        void add(const TestTotals &t);
     };
 
+    // One position from the EPD file, with its solution
+    struct TestCase
+    {
+        Board board;
+        std::string id, comment;
+        TestStatus testStats;
+    };
+
+    // Read the next position from the EPD file. Returns false at
+    // end of file or on a read error. "valid" is set false if the
+    // position has errors and should be skipped.
+    bool read_test(std::istream &pos_file, TestCase &test, bool &valid);
+
+    // Search one position, output results to "out" and add them
+    // to the totals.
+    void run_test(SearchController *searcher, TestCase &test,
+                  const TestOptions &opts, SearchType type,
+                  int time_limit, int depth_limit,
+                  std::ostream &out, TestTotals &testTotals);
+
+    // Search positions concurrently, with opts.instances search
+    // controllers, each with its share of the threads and hash
+    // table. Output is in the same order as the EPD file.
+    void run_parallel(std::vector<TestCase> &tests,
+                      const TestOptions &opts, SearchType type,
+                      int time_limit, int depth_limit,
+                      TestTotals &testTotals);
+
     bool solution_match(const std::vector<Move> &solution_moves,
                         Move result, bool avoid) const noexcept;
 
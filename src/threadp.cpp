@@ -1,4 +1,4 @@
-// Copyright 2005-2010, 2012, 2013, 2016-2019, 2021 by Jon Dart. All Rights Reserved.
+// Copyright 2005-2010, 2012, 2013, 2016-2019, 2021-2022 by Jon Dart. All Rights Reserved.
 
 #include "threadp.h"
 #include "search.h"
@@ -11,7 +11,7 @@
 #endif
 
 #ifdef NUMA
-bitset<Constants::MaxCPUs> ThreadPool::rebindMask;
+std::bitset<Constants::MaxCPUs> ThreadPool::rebindMask;
 #endif
 
 //#define _THREAD_TRACE
@@ -33,6 +33,16 @@ void log(const std::string &s,int param) {
 #endif
 
 void ThreadPool::idle_loop(ThreadInfo *ti) {
+    ThreadPool *pool = ti->pool;
+    // The Search instance is allocated by the thread that uses it,
+    // after binding (if NUMA), so that its memory is local.
+#ifdef NUMA
+    {
+        std::unique_lock<std::mutex> lock(pool->poolLock);
+        pool->rebind(ti->index);
+    }
+#endif
+    ti->work = new Search(pool->getController(),ti);
     while (ti->state != ThreadInfo::Terminating) {
 #ifdef _THREAD_TRACE
         {
@@ -41,24 +51,16 @@ void ThreadPool::idle_loop(ThreadInfo *ti) {
             log(s.str());
         }
 #endif
-        ThreadPool *pool = ti->pool;
         {
             std::unique_lock<std::mutex> lock(pool->poolLock);
+            // shutDown may have set the Terminating state
+            if (ti->state == ThreadInfo::Terminating) break;
             ti->state = ThreadInfo::Idle;
 #ifdef NUMA
-            if (rebindMask.test(ti->index)) {
-                if (pool->bind(ti->index)) {
-                    cerr << "Warning: bind to CPU failed for thread " << ti->index << endl;
-                }
-                rebindMask.reset(ti->index);
-            }
+            pool->rebind(ti->index);
 #endif
         }
-        int result;
-        if ((result = ti->wait()) != 0) {
-            if (result == -1) continue; // was interrupted
-            else break;
-        }
+        waitForWork(ti);
 #ifdef _THREAD_TRACE
         log("unblocked",ti->index);
 #endif
@@ -69,15 +71,20 @@ void ThreadPool::idle_loop(ThreadInfo *ti) {
         if (ti->state == ThreadInfo::Terminating) {
             break;
         }
+        if (pool->task) {
+            // execute a non-search task
+            (*pool->task)(ti->index);
+            pool->setCompleted(ti->index);
+            continue;
+        }
         assert(ti->work);
         {
             std::unique_lock<std::mutex> lock(pool->poolLock);
             pool->activeMask |= (1ULL << ti->index);
             ti->state = ThreadInfo::Working;
         }
-        // allocate stack on which search will be done
-        NodeInfo *searchStack = new NodeInfo[Search::SearchStackSize];
-        ti->work->init(searchStack, ti);
+        pool->controller->recordHelperStart();
+        ti->work->init(ti);
 #ifdef _THREAD_TRACE
         {
             std::ostringstream s;
@@ -88,7 +95,6 @@ void ThreadPool::idle_loop(ThreadInfo *ti) {
         ti->work->ply0_search();
         {
             std::unique_lock<std::mutex> lock(pool->poolLock);
-            delete [] searchStack;
             // Mark thread completed
             pool->completedMask.set(ti->index);
 #ifdef _THREAD_TRACE
@@ -110,6 +116,71 @@ void ThreadPool::idle_loop(ThreadInfo *ti) {
     }
 }
 
+void ThreadPool::waitForWork(ThreadInfo *ti)
+{
+    ThreadPool *pool = ti->pool;
+    auto ready = [ti,pool]() {
+        return ti->state == ThreadInfo::Terminating ||
+            (!ti->retired && pool->generation.load() != ti->generation);
+    };
+    const CLOCK_TYPE start = getCurrentTime();
+    auto idleTime = [&start]() -> uint64_t {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            getCurrentTime() - start).count();
+    };
+    const unsigned maxSpin = static_cast<unsigned>(
+        std::max<int>(0,globals::options.search.thread_spin_time));
+    const unsigned spinTime = std::min<unsigned>(ti->spinTime,maxSpin);
+    while (!ready() && idleTime() < spinTime) {
+        std::this_thread::yield();
+    }
+    if (!ready()) {
+        ti->sleeping.store(true);
+        // Re-check after setting the flag: unblockAll may have run
+        // before it was set, in which case it did not signal this
+        // thread. If it cleared the flag, though, a signal has been
+        // or will be sent, and the wait consumes it.
+        if (!ready() || !ti->sleeping.exchange(false)) {
+            ti->wait();
+        }
+    }
+    // Adapt the spin time: keep spinning the full time if work
+    // arrived within it, otherwise back off.
+    if (idleTime() <= maxSpin) {
+        ti->spinTime = maxSpin;
+    } else {
+        ti->spinTime /= 2;
+    }
+    ti->generation = pool->generation.load();
+}
+
+#ifdef NUMA
+int ThreadPool::bind(int index) {
+    ThreadInfo *ti = data[index];
+    int result = topo.bind(ti);
+    ti->node = result ? -1 : topo.nodeOf(ti);
+    // Move the thread's search state along with it. This has no
+    // effect when the Search is first allocated after binding.
+    if (!result && ti->work) {
+        ti->work->forEachAllocation([this,ti](const void *p, size_t size) {
+            if (topo.bindMemory(ti,p,size)) {
+                std::cerr << "Warning: memory bind failed for thread " << ti->index << std::endl;
+            }
+        });
+    }
+    return result;
+}
+
+void ThreadPool::rebind(int index) {
+    if (rebindMask.test(index)) {
+        if (bind(index)) {
+            std::cerr << "Warning: bind to CPU failed for thread " << index << std::endl;
+        }
+        rebindMask.reset(index);
+    }
+}
+#endif
+
 void ThreadPool::waitAll()
 {
     if (nThreads>1) {
@@ -126,6 +197,16 @@ void ThreadPool::waitAll()
     }
 }
 
+void ThreadPool::forEachThread(const std::function<void(unsigned)> &fn)
+{
+    task = &fn;
+    unblockAll();
+    fn(0);
+    setCompleted(0);
+    waitAll();
+    task = nullptr;
+}
+
 #ifdef _WIN32
 static DWORD WINAPI parkingLot(void *x)
 #else
@@ -133,9 +214,6 @@ static void * CDECL parkingLot(void *x)
 #endif
 {
    ThreadInfo *ti = (ThreadInfo*)x;
-   if (ti->index) {
-      ti->work = new Search(ti->pool->getController(),ti);
-   }
    ThreadPool::idle_loop(ti);
    // Free Search instance
    delete ti->work;
@@ -158,6 +236,10 @@ void ThreadInfo::start() {
 
 ThreadInfo::ThreadInfo(ThreadPool *p, unsigned i)
  : state(Starting),
+   sleeping(false),
+   retired(false),
+   generation(p->generation.load()),
+   spinTime(static_cast<unsigned>(std::max<int>(0,globals::options.search.thread_spin_time))),
 #ifdef _WIN32
    thread_id(nullptr),
    work(nullptr),
@@ -165,6 +247,9 @@ ThreadInfo::ThreadInfo(ThreadPool *p, unsigned i)
    work(nullptr),
 #endif
    pool(p),
+#ifdef NUMA
+   node(-1),
+#endif
    index(i)
 {
 #ifdef _THREAD_TRACE
@@ -193,7 +278,7 @@ ThreadInfo::ThreadInfo(ThreadPool *p, unsigned i)
 }
 
 ThreadPool::ThreadPool(SearchController *ctrl, unsigned n) :
-    controller(ctrl), nThreads(n) {
+    task(nullptr), controller(ctrl), generation(0ULL), nThreads(n), nAllocated(n) {
 
    data.fill(nullptr);
 #ifndef _WIN32
@@ -218,19 +303,14 @@ ThreadPool::ThreadPool(SearchController *ctrl, unsigned n) :
 #endif
       ThreadInfo *p = data[i] = new ThreadInfo(this,i);
       if (i==0) {
-         p->work = new Search(controller,p);
-         p->work->ti = p;
 #ifdef NUMA
-         // bind main thread
-         if (bind(0)) {
-             cerr << "Warning: bind to CPU failed for thread 0" << endl;
-         }
+         // bind main thread, before allocating its Search instance
+         rebind(0);
 #endif
+         p->work = new Search(controller,p);
+         p->work->ti = p;
       }
-      else {
-         // defer search creation until thread starts
-         //p->work = new Search(controller,p);
-      }
+      // else search creation is deferred until the thread starts
    }
    // Thread 0 (main thread) is always active:
    activeMask.set(0);
@@ -238,14 +318,14 @@ ThreadPool::ThreadPool(SearchController *ctrl, unsigned n) :
        availableMask.set(i);
    }
    // Wait for all threads to start up
-   while (n >1) {
-       unsigned cnt = 0;
-       for (unsigned i = 1; i < n; i++) {
-           if (data[i]->state == ThreadInfo::Idle) {
-             ++cnt;
-           }
+   waitForStartup();
+}
+
+void ThreadPool::waitForStartup() const {
+   for (unsigned i = 1; i < nAllocated; i++) {
+       while (data[i]->state == ThreadInfo::Starting) {
+           std::this_thread::yield();
        }
-       if (cnt==n-1) break;
    }
 }
 
@@ -259,28 +339,29 @@ ThreadPool::~ThreadPool() {
 }
 
 void ThreadPool::shutDown() {
-    std::unique_lock<std::mutex> lock(poolLock);
-    ThreadInfo *p;
-    // note: do not terminate thread 0 (main thread) in this loop
-    for (unsigned i = 1; i < nThreads; i++) {
-        p = data[i];
-        // All threads should be idle when this function is called.
-        if (p->state == ThreadInfo::Idle) {
-          // Set the thread to the terminating state that will force thread
-          // procedure exit
-          p->state = ThreadInfo::Terminating;
-          // unblock the thread
-          p->signal();
-       }
-       // wait for the thread to terminate
+    {
+        std::unique_lock<std::mutex> lock(poolLock);
+        // note: do not terminate thread 0 (main thread) in this loop
+        for (unsigned i = 1; i < nAllocated; i++) {
+            // All threads should be idle when this function is called.
+            // Set the thread to the terminating state that will force
+            // thread procedure exit, and unblock the thread.
+            data[i]->state = ThreadInfo::Terminating;
+            data[i]->signal();
+        }
+    }
+    for (unsigned i = 1; i < nAllocated; i++) {
+        ThreadInfo *p = data[i];
+        // wait for the thread to terminate
 #ifdef _WIN32
-       WaitForSingleObject(p->thread_id,INFINITE);
+        WaitForSingleObject(p->thread_id,INFINITE);
 #else
-       void *value_ptr;
-       pthread_join(p->thread_id,&value_ptr);
+        void *value_ptr;
+        pthread_join(p->thread_id,&value_ptr);
 #endif
-       // Free thread data
-       delete p;
+        // Free thread data
+        delete p;
+        data[i] = nullptr;
     }
     // now free main thread data
     delete data[0]->work;
@@ -289,37 +370,36 @@ void ThreadPool::shutDown() {
 
 void ThreadPool::resize(unsigned n) {
     if (n >= 1 && n < Constants::MaxCPUs && n != nThreads) {
-        std::unique_lock<std::mutex> lock(poolLock);
+        {
+            std::unique_lock<std::mutex> lock(poolLock);
 #ifdef NUMA
-        topo.recalc();
+            // bindings depend on the thread count, so recompute them
+            // and rebind all threads
+            topo.recalc();
+            rebindMask.set();
 #endif
-        if (n>nThreads) {
-            // growing
-            while (n > nThreads) {
-               data[nThreads] = new ThreadInfo(this,nThreads);
-               nThreads++;
+            // shrinking: retire threads that are no longer needed.
+            // They remain idle until reactivated or shut down.
+            for (unsigned i = n; i < nThreads; i++) {
+                data[i]->retired = true;
             }
-        }
-        else {
-            // shrinking
-            while (n < nThreads) {
-                ThreadInfo *p = data[nThreads-1];
-                p->state = ThreadInfo::Terminating;
-                if (p->state == ThreadInfo::Idle) {
-                    p->signal(); // unblock thread & exit thread proc
-                    // wait for thread exit
-#ifdef _WIN32
-                    WaitForSingleObject(p->thread_id,INFINITE);
-#else
-                    void *value_ptr;
-                    pthread_join(p->thread_id,&value_ptr);
-#endif
-                }
-                delete p;
-                data[nThreads] = nullptr;
-                --nThreads;
+            // growing: reactivate retired threads first. Update the
+            // generation first so a previous search is not mistaken
+            // for new work.
+            for (unsigned i = nThreads; i < std::min<unsigned>(n,nAllocated); i++) {
+                data[i]->generation = generation.load();
+                data[i]->retired = false;
+            }
+            // then create more threads if needed
+            while (n > nAllocated) {
+                data[nAllocated] = new ThreadInfo(this,nAllocated);
+                nAllocated++;
             }
+            nThreads = n;
         }
+        // new threads must not be assigned work before they reach
+        // the idle loop (and have allocated their Search instances)
+        waitForStartup();
     }
     assert(nThreads == n);
     for (size_t i = 0; i < Constants::MaxCPUs; i++) {
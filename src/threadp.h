@@ -28,8 +28,22 @@ struct ThreadInfo : public ThreadControl {
    virtual ~ThreadInfo();
    void start();
    std::atomic<State> state;
+   // true if the thread is blocked (or about to block) waiting
+   // for work, and so must be signalled to wake it
+   std::atomic<bool> sleeping;
+   // true if the pool has been shrunk so that this thread is no
+   // longer used (see ThreadPool::resize)
+   std::atomic<bool> retired;
+   // last pool generation seen by this thread
+   std::atomic<uint64_t> generation;
+   // current limit on idle spinning, in microseconds
+   unsigned spinTime;
    Search *work;
    ThreadPool *pool;
+#ifdef NUMA
+   // NUMA node the thread is bound to, or -1 if not bound to one node
+   int node;
+#endif
    THREAD thread_id;
    unsigned index;
    int operator == (const ThreadInfo &ti) const {
@@ -55,13 +69,17 @@ public:
 
    int activeCount() const;
 
-   // resize the thread pool
+   // Resize the thread pool. Threads removed by shrinking the pool
+   // are retired rather than destroyed, and are reused, along with
+   // their Search instances, if the pool grows again.
    void resize(unsigned n);
 
+   // Apply fn to the Search instance of every thread, including
+   // retired threads, so that these stay up to date.
    template <void (Search::*fn)()>
       void forEachSearch() {
       std::unique_lock<std::mutex> lock(poolLock);
-      for (unsigned i = 0; i < nThreads; i++) {
+      for (unsigned i = 0; i < nAllocated; i++) {
           if (data[i] && data[i]->work) {
               std::mem_fn(fn)(data[i]->work);
           }
@@ -70,14 +88,27 @@ public:
 
    void unblockAll() {
       completedMask = 0ULL;
-      // No need to unblock thread 0: that is the main thread
+      // clear any stale completion signal
+      reset();
+      // Threads that are spinning in the idle loop will see the
+      // generation change. Only threads that are blocked need to be
+      // signalled. No need to unblock thread 0: that is the main thread.
+      generation.fetch_add(1);
       for (unsigned i = 1; i < nThreads; i++) {
-         data[i]->signal();
+         if (data[i]->sleeping.exchange(false)) {
+            data[i]->signal();
+         }
       }
    }
 
    void waitAll();
 
+   // Execute fn(index) on every thread in the pool, including the
+   // calling (main) thread as index 0, and wait for all to complete.
+   // Used for work other than search, such as clearing the hash table.
+   // Must not be called while a search is in progress.
+   void forEachThread(const std::function<void(unsigned)> &fn);
+
    SearchController *getController() const {
      return controller;
    }
@@ -91,9 +122,13 @@ public:
    }
 
 #ifdef NUMA
-   int bind(int index) {
-     return topo.bind(data[index]);
-   }
+   // Bind the thread to its processing unit(s), and its Search
+   // instance's memory to the corresponding node(s).
+   int bind(int index);
+
+   // Bind the thread if its binding has been recalculated (see
+   // recalcBindings).
+   void rebind(int index);
 
    void recalcBindings() {
      topo.recalc();
@@ -137,6 +172,11 @@ public:
    }
 
 private:
+   // Wait until new work is posted (see unblockAll) or the thread
+   // is terminating. Spins for up to the thread's spin time, then
+   // blocks.
+   static void waitForWork(ThreadInfo *ti);
+
    // Note: does not lock
    bool allCompleted() const {
        return completedMask.count() == nThreads;
@@ -144,10 +184,19 @@ private:
 
    void shutDown();
 
+   // Wait until all threads have entered the idle loop
+   void waitForStartup() const;
+
    // lock for the class.
    std::mutex poolLock;
+   // non-search task to execute, if any (see forEachThread)
+   const std::function<void(unsigned)> *task;
    SearchController *controller;
+   // incremented each time work is posted to the threads
+   std::atomic<uint64_t> generation;
    unsigned nThreads;
+   // number of threads created, including retired threads
+   unsigned nAllocated;
    std::array<ThreadInfo *,Constants::MaxCPUs> data;
 
    // mask of thread status - 0 if idle, 1 if active
@@ -1,4 +1,4 @@
-// Copyright 2016, 2018 by Jon Dart. All Rights Reserved.
+// Copyright 2016, 2018, 2022 by Jon Dart. All Rights Reserved.
 #include "topo.h"
 
 #include <iostream>
@@ -6,15 +6,16 @@
 #include <sstream>
 
 #include "globals.h"
+#include "threadp.h"
 
 Topology::Topology()
 {
     int ret = init();
     if (ret) {
-        cout << "error initializing topology" << std::endl;
+        std::cout << "error initializing topology" << std::endl;
     }
     else {
-        cout << description() << endl;
+        std::cout << description() << std::endl;
         computeSet();
     }
 }
@@ -39,6 +40,42 @@ int Topology::bind(ThreadInfo *thread)
     return hwloc_set_thread_cpubind(topo,thread->thread_id,cpuset[thread->index],HWLOC_CPUBIND_THREAD | HWLOC_CPUBIND_STRICT);
 }
 
+int Topology::bindMemory(const ThreadInfo *thread, const void *addr, size_t size)
+{
+    return hwloc_set_area_membind(topo,addr,size,cpuset[thread->index],HWLOC_MEMBIND_BIND,HWLOC_MEMBIND_MIGRATE);
+}
+
+unsigned Topology::nodeCount() const
+{
+    int n = hwloc_get_nbobjs_by_type(topo, HWLOC_OBJ_NUMANODE);
+    return n > 0 ? unsigned(n) : 1;
+}
+
+int Topology::nodeOf(const ThreadInfo *thread) const
+{
+    hwloc_obj_t node = nullptr;
+    while ((node = hwloc_get_next_obj_by_type(topo, HWLOC_OBJ_NUMANODE, node)) != nullptr) {
+        if (hwloc_bitmap_isincluded(cpuset[thread->index],node->cpuset)) {
+            return int(node->logical_index);
+        }
+    }
+    return -1;
+}
+
+int Topology::interleaveMemory(const void *addr, size_t size)
+{
+    return hwloc_set_area_membind(topo,addr,size,hwloc_topology_get_topology_nodeset(topo),
+                                  HWLOC_MEMBIND_INTERLEAVE,HWLOC_MEMBIND_BYNODESET | HWLOC_MEMBIND_MIGRATE);
+}
+
+int Topology::bindMemoryToNode(const void *addr, size_t size, unsigned index)
+{
+    hwloc_obj_t node = hwloc_get_obj_by_type(topo, HWLOC_OBJ_NUMANODE, index);
+    if (node == nullptr) return -1;
+    return hwloc_set_area_membind(topo,addr,size,node->nodeset,
+                                  HWLOC_MEMBIND_BIND,HWLOC_MEMBIND_BYNODESET | HWLOC_MEMBIND_MIGRATE);
+}
+
 void Topology::recalc() {
     cleanup();
     init();
@@ -47,13 +84,13 @@ void Topology::recalc() {
 
 int Topology::computeSet()
 {
-    const int n = options.search.ncpus;
+    const int n = globals::options.search.ncpus;
 
-    if (options.search.set_processor_affinity) {
+    if (globals::options.search.set_processor_affinity) {
         hwloc_obj_t root = hwloc_get_root_obj(topo);
         int result = hwloc_distrib(topo, &root, 1, cpuset, n,  std::numeric_limits<int>::max(), static_cast<unsigned long>(0));
         if (result) {
-            cerr << "hwloc_distrib failed" << endl;
+            std::cerr << "hwloc_distrib failed" << std::endl;
             return -1;
         }
         // hwloc_distrib may return a range of cpus on which threads can be
@@ -73,7 +110,7 @@ int Topology::computeSet()
             int first = hwloc_bitmap_first(allowed_group);
             int last = hwloc_bitmap_last(allowed_group);
             if (first == -1 || last == -1) {
-                cerr << "no avaialable CPUS" << endl;
+                std::cerr << "no avaialable CPUS" << std::endl;
                 return -1;
             }
             for (int j = first; j < last; j++) {
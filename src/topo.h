@@ -1,4 +1,4 @@
-// Copyright 2016, 2018 by Jon Dart. All Rights Reserved.
+// Copyright 2016, 2018, 2022 by Jon Dart. All Rights Reserved.
 #ifndef _TOPO_H
 #define _TOPO_H
 
@@ -28,6 +28,26 @@ public:
     // Returns 0 on success.
     int bind(ThreadInfo *);
 
+    // Bind a memory area to the node(s) of the processing unit(s)
+    // assigned to the specified thread, migrating any pages already
+    // allocated. Returns 0 on success.
+    int bindMemory(const ThreadInfo *, const void *addr, size_t size);
+
+    // Number of NUMA nodes
+    unsigned nodeCount() const;
+
+    // Logical index of the node whose processing units the thread
+    // is bound to, or -1 if it may run on more than one node.
+    int nodeOf(const ThreadInfo *) const;
+
+    // Interleave the pages of a memory area across all nodes.
+    // Returns 0 on success.
+    int interleaveMemory(const void *addr, size_t size);
+
+    // Bind a memory area to the node with the given logical index.
+    // Returns 0 on success.
+    int bindMemoryToNode(const void *addr, size_t size, unsigned node);
+
     // Recalculate topology. Called after thread pool is resized.
     void recalc();
 
@@ -100,6 +100,7 @@ inline uint64_t getRandomSeed() {
 
 #ifdef _MSC_VER
 
+#include <xmmintrin.h>
 #define CACHE_ALIGN __declspec(align(128))
 #define FORCEINLINE __forceinline
 #define ALIGNED_MALLOC(ptr, type, size, alignment) ptr = (type*)_aligned_malloc(size, alignment)
@@ -150,6 +151,13 @@ inline uint64_t getRandomSeed() {
 #define ALIGN_VAR(n)
 #endif
 
+// Prefetch a memory location into cache (hint only, never faults)
+#ifdef _MSC_VER
+#define PREFETCH(addr) _mm_prefetch((const char*)(addr),_MM_HINT_T0)
+#else
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#endif
+
 #if _BYTE_ORDER == _BIG_ENDIAN
 FORCEINLINE uint64_t swapEndian64(const uint8_t *input) {
   return bswap64((uint64_t*)input);
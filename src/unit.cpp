@@ -7,6 +7,7 @@
 #include "legal.h"
 #include "movegen.h"
 #include "options.h"
+#include "perft.h"
 #include "movearr.h"
 #include "notation.h"
 #include "chessio.h"
@@ -19,7 +20,9 @@
 #endif
 #include <algorithm>
 #include <cctype>
+#include <functional>
 #include <iostream>
+#include <random>
 #include <regex>
 #include <set>
 #include <string>
@@ -1053,6 +1056,30 @@ static int testHash() {
         std::cerr << "testHash case 6: expected valid move" << std::endl;
     }
 
+    // a position whose partial key is 0 must not match empty entries,
+    // and storing it repeatedly must not change the fill count
+    {
+        Hash emptyTable;
+        emptyTable.initHash(4000);
+        const hash_t zeroKey = 0x0000123456789abcULL;
+        HashEntry he5;
+        if (emptyTable.searchHash(zeroKey, HashEntry::QSEARCH_NO_CHECK_DEPTH, 1, he5) != HashEntry::NoHit) {
+            ++errs;
+            std::cerr << "testHash case 7: hit on empty table" << std::endl;
+        }
+        for (int i = 0; i < 3; i++) {
+            emptyTable.storeHash(zeroKey,1,1,HashEntry::LowerBound,score_t(i),score_t(0),0,NullMove);
+        }
+        if (emptyTable.searchHash(zeroKey, 1, 1, he5) != HashEntry::LowerBound || he5.getValue() != 2) {
+            ++errs;
+            std::cerr << "testHash case 7: entry not found" << std::endl;
+        }
+        if (emptyTable.pctFull() != (int)(1000.0/emptyTable.getHashSize())) {
+            ++errs;
+            std::cerr << "testHash case 7: wrong fill count" << std::endl;
+        }
+    }
+
     globals::options.learning.position_learning = tmp;
     return errs;
 }
@@ -1099,6 +1126,263 @@ static int testRep()
     return errs;
 }
 
+static int testSharedHistory()
+{
+    // Repetition detection must give the same results when part of
+    // the history is shared (by shareHistory or when the board's
+    // own history fills up), for copies of the board, and after
+    // undoing moves made before the history was shared.
+    const std::string fen("8/B2nk3/8/8/3K4/7B/8/8 w - - 0 2");
+    const std::array <std::string,4> moves = {"Ke4","Kf7","Kd4","Ke7"};
+
+    int errs = 0;
+    Board start;
+    if (!BoardIO::readFEN(start, fen)) {
+       std::cerr << "testSharedHistory: error in FEN: " << fen << std::endl;
+       return ++errs;
+    }
+    Move cycle[4];
+    {
+       Board tmp(start);
+       for (unsigned i = 0; i < moves.size(); i++) {
+          cycle[i] = Notation::value(tmp,tmp.sideToMove(),
+                                     Notation::InputFormat::SAN,moves[i]);
+          if (IsNull(cycle[i])) {
+             std::cerr << "testSharedHistory: error in move parsing" << std::endl;
+             return ++errs;
+          }
+          tmp.doMove(cycle[i]);
+       }
+    }
+    for (int share = 0; share <= 8; share++) {
+       Board board(start), ref(start);
+       for (int ply = 0; ply < 10; ply++) {
+          if (ply == share) board.shareHistory();
+          board.doMove(cycle[ply % 4]);
+          ref.doMove(cycle[ply % 4]);
+          const Board copy(board);
+          if (board.repCount(3) != ref.repCount(3) ||
+              copy.repCount(3) != ref.repCount(3) ||
+              copy.anyRep() != ref.anyRep()) {
+             std::cerr << "testSharedHistory: repetition count incorrect (share at " << share << ", ply " << ply << ")" << std::endl;
+             ++errs;
+          }
+       }
+    }
+    // More moves than fit in the board's own history, then undo
+    // them all.
+    Board board(start);
+    std::vector<BoardState> states;
+    const int plies = 600;
+    for (int ply = 0; ply < plies; ply++) {
+       states.push_back(board.state);
+       board.doMove(cycle[ply % 4]);
+    }
+    if (board.repCount(3) != 3) {
+       std::cerr << "testSharedHistory: repCount incorrect after " << plies << " plies" << std::endl;
+       ++errs;
+    }
+    for (int ply = plies-1; ply >= 0; ply--) {
+       board.undoMove(cycle[ply % 4],states[ply]);
+       const int expected = std::min<int>(3,(ply+3)/4);
+       if ((ply % 4) == 0 && board.repCount(3) != expected) {
+          std::cerr << "testSharedHistory: repCount incorrect after undo to ply " << ply << std::endl;
+          ++errs;
+          break;
+       }
+    }
+    return errs;
+}
+
+static int testRepFilter()
+{
+    // repCount must agree with a scan of the full history when the
+    // repetition filter is used, across irreversible moves, null
+    // moves, undo, sharing of the history and board copies.
+    static const std::array<std::string,3> fens = {
+        "8/8/p2p3p/3k2p1/PP6/3K1P1P/8/8 b - - 0 1",
+        "6k1/6pp/p3R3/2p5/Pr6/1P4P1/1P2KP2/8 w - - 0 1",
+        "8/8/4b3/4k3/7P/3R1K2/3pr3/8 b - - 0 1"
+    };
+    int errs = 0;
+    std::mt19937 rng(17);
+    for (const std::string &fen : fens) {
+       Board board;
+       if (!BoardIO::readFEN(board, fen)) {
+          std::cerr << "testRepFilter: error in FEN: " << fen << std::endl;
+          return ++errs;
+       }
+       // reference history: hash codes, and states for undo
+       std::vector<hash_t> hashes(1,board.hashCode());
+       std::vector<std::pair<Move,BoardState>> made;
+       for (int step = 0; step < 2000 && !errs; step++) {
+          const unsigned r = rng() % 16;
+          if (r < 3 && !made.empty()) {
+             const std::pair<Move,BoardState> &last = made.back();
+             if (IsNull(last.first)) {
+                board.undoNull(last.second);
+             } else {
+                board.undoMove(last.first,last.second);
+             }
+             made.pop_back();
+             hashes.pop_back();
+          }
+          else if (r == 3) {
+             board.shareHistory();
+          }
+          else if (r == 4) {
+             // continue with a copy
+             Board copy(board);
+             board = copy;
+          }
+          else if (r == 5 && board.checkStatus() != InCheck) {
+             made.push_back(std::pair<Move,BoardState>(NullMove,board.state));
+             board.doNull();
+             hashes.push_back(board.hashCode());
+          }
+          else {
+             Move moves[Constants::MaxMoves];
+             MoveGenerator mg(board,nullptr,nullptr,0,NullMove,0,true);
+             const unsigned n = mg.generateAllMoves(moves,0);
+             if (n == 0) break;
+             // mostly reversible moves, so that positions repeat
+             Move move = moves[rng() % n];
+             for (unsigned tries = 0; tries < 4 && (PieceMoved(move) == Pawn || Capture(move) != Empty); tries++) {
+                move = moves[rng() % n];
+             }
+             made.push_back(std::pair<Move,BoardState>(move,board.state));
+             board.doMove(move);
+             hashes.push_back(board.hashCode());
+          }
+          const int window = std::min<int>(board.state.movesFromNull,board.state.moveCount);
+          for (int target = 1; target <= 3; target++) {
+             int expected = 0;
+             for (int k = 2; k <= window && k < (int)hashes.size() && expected < target; k += 2) {
+                if (hashes[hashes.size()-1-k] == hashes.back()) ++expected;
+             }
+             if (board.repCount(target) != expected) {
+                std::cerr << "testRepFilter: repCount incorrect for " << fen << " at step " << step << std::endl;
+                ++errs;
+                break;
+             }
+          }
+       }
+    }
+    // Shuffle knights long enough to saturate the filter counts, then
+    // undo: the saturated counts must not give a false negative.
+    Board board;
+    static const std::array<std::string,4> shuffle = {"g1f3","g8f6","f3g1","f6g8"};
+    std::vector<std::pair<Move,BoardState>> made;
+    for (int i = 0; i < 1200 && !errs; i++) {
+       const Move move = Notation::value(board,board.sideToMove(),Notation::InputFormat::UCI,shuffle[i%4]);
+       made.push_back(std::pair<Move,BoardState>(move,board.state));
+       board.doMove(move);
+       if (i % 100 == 99) board.shareHistory();
+    }
+    while (made.size() > 8 && !errs) {
+       board.undoMove(made.back().first,made.back().second);
+       made.pop_back();
+       // each position occurred 4 and 8 plies earlier
+       if (board.repCount(2) != 2) {
+          std::cerr << "testRepFilter: repCount incorrect after undo, ply " << made.size() << std::endl;
+          ++errs;
+       }
+    }
+    return errs;
+}
+
+static int testHashCodes()
+{
+    // Board::hashCode(Move) and Board::pawnHash(Move) should predict
+    // the hash codes after the move is made.
+    static const std::array<std::string,5> fens = {
+        "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1",
+        "r3k2r/7b/8/8/8/8/1B4BQ/R3K2R b KQkq - 0 1",
+        "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+        "rnbqkbnr/ppp1pppp/8/8/3pP3/2P5/PP1P1PPP/RNBQKBNR b KQkq e3 0 1",
+        "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1"
+    };
+    int errs = 0;
+    for (const std::string &fen : fens) {
+        Board board;
+        if (!BoardIO::readFEN(board, fen)) {
+            std::cerr << "testHashCodes: error in FEN: " << fen << std::endl;
+            ++errs;
+            continue;
+        }
+        RootMoveGenerator mg(board);
+        BoardState state = board.state;
+        Move m;
+        int order;
+        while ((m = mg.nextMove(order)) != NullMove) {
+            const hash_t h = board.hashCode(m);
+            const hash_t ph = board.pawnHash(m);
+            board.doMove(m);
+            if (h != board.hashCode()) {
+                std::cerr << "testHashCodes: wrong hash code for move ";
+                MoveImage(m,std::cerr);
+                std::cerr << " in " << fen << std::endl;
+                ++errs;
+            }
+            if (ph != board.pawnHash()) {
+                std::cerr << "testHashCodes: wrong pawn hash code for move ";
+                MoveImage(m,std::cerr);
+                std::cerr << " in " << fen << std::endl;
+                ++errs;
+            }
+            board.undoMove(m,state);
+        }
+    }
+    return errs;
+}
+
+static int testHashFile()
+{
+    int errs = 0;
+    const std::string fileName("unit_test.hash");
+    Board board;
+    Hash hashTable;
+    hashTable.initHash(1024*1024);
+    hashTable.storeHash(board.hashCode(),5*DEPTH_INCREMENT,3,HashEntry::LowerBound,
+                        score_t(45),score_t(12),0,NullMove);
+    std::string err;
+    if (!hashTable.save(fileName,3,err)) {
+        std::cerr << "testHashFile: save failed: " << err << std::endl;
+        return 1;
+    }
+    Hash restored;
+    restored.initHash(1024*1024);
+    unsigned age = 0;
+    if (!restored.load(fileName,age,err)) {
+        std::cerr << "testHashFile: load failed: " << err << std::endl;
+        ++errs;
+    } else {
+        HashEntry he;
+        if (age != 3) {
+            std::cerr << "testHashFile: wrong age" << std::endl;
+            ++errs;
+        }
+        if (restored.searchHash(board.hashCode(),5*DEPTH_INCREMENT,3,he) != HashEntry::LowerBound ||
+            he.getValue() != 45 || he.staticValue() != 12) {
+            std::cerr << "testHashFile: entry not restored" << std::endl;
+            ++errs;
+        }
+        if (restored.pctFull() != hashTable.pctFull()) {
+            std::cerr << "testHashFile: fill count not restored" << std::endl;
+            ++errs;
+        }
+    }
+    // table size mismatch must be rejected
+    Hash other;
+    other.initHash(2*1024*1024);
+    if (other.load(fileName,age,err)) {
+        std::cerr << "testHashFile: size mismatch not detected" << std::endl;
+        ++errs;
+    }
+    std::remove(fileName.c_str());
+    return errs;
+}
+
 static int testMoveGen()
 {
     // Some basic tests for move generation, including routines used
@@ -1116,7 +1400,7 @@ static int testMoveGen()
           };
     };
 
-    static const std::array<Case,7> cases = { Case("rn1rb2k/1p2q3/p2NpB1p/1Pb5/P5Q1/5N2/5PPP/3R1RK1 b - - 0 25",
+    static const std::array<Case,8> cases = { Case("rn1rb2k/1p2q3/p2NpB1p/1Pb5/P5Q1/5N2/5PPP/3R1RK1 b - - 0 25",
                                                    "Qxf6 Qg7 Kh7",
                                                    "Qxf6 Qg7 Kh7",
                                                    "Qxf6 Qg7 Kh7",
@@ -1150,7 +1434,12 @@ static int testMoveGen()
              "Kf6 Kf7 Kh7 Kf8 Kg8 Kh8 Qc7 Qe7 Qb8 Qf8 Qc6 Qe6 Qf6 Qg6 Qd7 Qd8 Ra1 Ra2 Ra3 Ra4 Ra5 Ra6 Rb7 Rc7 Rd7 Re7 Rf7 Ra8 e4+ b5 Qxd5",
              "Kf6 Kf7 Kh7 Kf8 Kg8 Kh8 Qc7 Qe7 Qb8 Qf8 Qc6 Qe6 Qf6 Qg6 Qd7 Qd8 Ra1 Ra2 Ra3 Ra4 Ra5 Ra6 Rb7 Rc7 Rd7 Re7 Rf7 Ra8 e4+ b5 Qxd5 Kg6",
              "Qxd5",
-             "Qxd5 e4+")
+             "Qxd5 e4+"),
+        Case("8/3p4/8/8/4K3/8/1N6/k7 b - - 0 1",
+             "Kxb2 Ka2 Kb1 d6 d5+",
+             "Kxb2 Ka2 Kb1 d6 d5+",
+             "Kxb2",
+             "Kxb2 d5+")
     };
 
     struct MoveKey
@@ -1348,11 +1637,150 @@ static int testPerft()
          ++errs;
          continue;
       }
-      uint64_t result;
-      if ((result = RootMoveGenerator::perft(board,acase.depth)) != acase.result) {
-         std::cerr << "testPerft: error in test case " << i << " wrong result: " << result << std::endl;
+      for (bool legal : {false, true}) {
+         uint64_t result;
+         if ((result = RootMoveGenerator::perft(board,acase.depth,legal)) != acase.result) {
+            std::cerr << "testPerft: error in test case " << i << (legal ? " (legal movegen)" : "") << " wrong result: " << result << std::endl;
+            ++errs;
+         }
+      }
+   }
+   return errs;
+}
+
+static int testParallelPerft()
+{
+   // Threaded, hashed perft must agree with the known counts, and the
+   // divide counts must sum to the total.
+   Board board;
+   if (!BoardIO::readFEN(board, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1")) {
+      std::cerr << "testParallelPerft: error in FEN" << std::endl;
+      return 1;
+   }
+   int errs = 0;
+   Perft::PerftOptions opts;
+   opts.threads = 3;
+   opts.hashSize = 1024*1024;
+   for (bool legal : {true, false}) {
+      opts.legal = legal;
+      Perft perft(opts);
+      Perft::Results results = perft.run(board,4);
+      uint64_t sum = 0ULL;
+      for (const auto &entry : results.divide) sum += entry.second;
+      if (results.nodes != 4085603ULL || sum != results.nodes || results.divide.size() != 48) {
+         std::cerr << "testParallelPerft: wrong result" << (legal ? "" : " (pseudo-legal)") << ": " << results.nodes << std::endl;
+         ++errs;
+      }
+   }
+   return errs;
+}
+
+static int testLegalMoves()
+{
+   // Compare mg::isLegal with the result of making each
+   // pseudo-legal move, including moves generated when in check.
+   static const std::string fens[] = {
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+      "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1",
+      "8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"
+   };
+   int errs = 0;
+   std::function<void(Board &,int)> walk = [&](Board &board, int depth) {
+      Move moves[Constants::MaxMoves];
+      unsigned n = mg::generateCaptures(board,moves,true);
+      n += mg::generateNonCaptures(board,moves+n);
+      const Bitboard pinned(mg::pinnedPieces(board));
+      const BoardState state(board.state);
+      for (unsigned i = 0; i < n; i++) {
+         const bool legal = mg::isLegal(board,moves[i],pinned);
+         board.doMove(moves[i]);
+         const bool expected = !board.anyAttacks(board.kingSquare(board.oppositeSide()),board.sideToMove());
+         if (legal != expected) {
+            std::cerr << "testLegalMoves: wrong result for ";
+            MoveImage(moves[i],std::cerr);
+            std::cerr << " in position " << std::endl;
+            board.undoMove(moves[i],state);
+            std::cerr << board << std::endl;
+            ++errs;
+            continue;
+         }
+         if (expected && depth > 1) {
+            walk(board,depth-1);
+         }
+         board.undoMove(moves[i],state);
+      }
+   };
+   for (const std::string &fen : fens) {
+      Board board;
+      if (!BoardIO::readFEN(board, fen.c_str())) {
+         std::cerr << "testLegalMoves: error in FEN: " << fen << std::endl;
+         ++errs;
+         continue;
+      }
+      walk(board,3);
+   }
+   return errs;
+}
+
+static int testAttackCache()
+{
+   // Check the cached checkers, pinned pieces and attacked squares
+   // against a full calculation, through make/unmake of moves and
+   // with the cache filled at different points.
+   static const std::string fens[] = {
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"
+   };
+   int errs = 0;
+   auto verify = [&](const Board &board, const char *where) {
+      const ColorType side = board.sideToMove();
+      const ColorType oside = board.oppositeSide();
+      int err = 0;
+      if (board.checkers() != board.calcAttacks(board.kingSquare(side),oside)) ++err;
+      if ((board.checkStatus() == InCheck) == board.checkers().isClear()) ++err;
+      if (board.pinned() != board.getPinned(board.kingSquare(side),oside,side)) ++err;
+      for (int c = 0; c < 2; c++) {
+         if (board.hasAttackedSquares(ColorType(c)) &&
+             board.attackedSquares(ColorType(c)) != board.allAttacks(ColorType(c))) ++err;
+      }
+      if (err) {
+         std::cerr << "testAttackCache: wrong cached attacks " << where << std::endl;
+         std::cerr << board << std::endl;
+      }
+      errs += err;
+   };
+   std::function<void(Board &,int)> walk = [&](Board &board, int depth) {
+      Move moves[Constants::MaxMoves];
+      MoveGenerator mg(board,nullptr,nullptr,0,NullMove,0,true);
+      const unsigned n = mg.generateAllMoves(moves,0);
+      // fill part of the cache before and after saving the state:
+      // undoMove must not leave any of it stale
+      if (depth % 2) board.attackedSquares(board.sideToMove());
+      const BoardState state(board.state);
+      board.attackedSquares(board.oppositeSide());
+      for (unsigned i = 0; i < n; i++) {
+         board.doMove(moves[i]);
+         verify(board,"after doMove");
+         if (depth > 1) {
+            walk(board,depth-1);
+         }
+         board.undoMove(moves[i],state);
+         verify(board,"after undoMove");
+      }
+   };
+   for (const std::string &fen : fens) {
+      Board board;
+      if (!BoardIO::readFEN(board, fen.c_str())) {
+         std::cerr << "testAttackCache: error in FEN: " << fen << std::endl;
          ++errs;
+         continue;
       }
+      verify(board,"after readFEN");
+      walk(board,2);
    }
    return errs;
 }
@@ -1435,43 +1863,101 @@ static int testSearch()
    return errs;
 }
 
+static int testThreadResize()
+{
+   // Search while shrinking and growing the thread pool. Retired
+   // threads must not search, and must be reusable.
+   static const std::array<int,6> sizes = {4, 2, 1, 3, 4, 2};
+   SearchController *searcher = new SearchController();
+   Board board;
+   Statistics stats;
+   int errs = 0;
+   for (int threads : sizes) {
+       searcher->setThreadCount(threads);
+       stats.clear();
+       Move m = searcher->findBestMove(board,
+                              FixedDepth,
+                              999999,
+                              0,            /* extra time allowed */
+                              6,            /* ply limit */
+                              false,        /* background */
+                              false,        /* UCI */
+                              stats,
+                              TalkLevel::Silent);
+       if (IsNull(m) || !legalMove(board,m)) {
+           std::cerr << "error in thread resize: no legal move with " <<
+               threads << " thread(s)" << std::endl;
+           ++errs;
+       }
+   }
+   delete searcher;
+   return errs;
+}
+
 #ifdef NNUE
 static int testNNUE() {
     int errs = 0;
-    // NNUE code has its own tests, but here we test state update in doMove/undoMove
-    const std::string fen("r1bq1r1k/p1pnbpp1/1p2p3/6p1/3PB3/5N2/PPPQ1PPP/2KR3R w - - 0 1");
-    const std::array<std::string,3> moves = {"g4","f5","Bxa8"};
-    Board board, start;
-    if (!BoardIO::readFEN(board, fen)) {
-        std::cerr << "warning: testNNUE: error in FEN" << std::endl;
-        return ++errs;
-    }
-    start = board;
+    // NNUE code has its own tests, but here we test state update in doMove/undoMove.
+    // The cases cover castling on both sides, en passant and promotions
+    // with and without capture, since the changed pieces for these are
+    // derived from the move when the accumulator is updated.
+    struct Case {
+        std::string fen;
+        std::vector<std::string> moves;
+    };
+    const std::array<Case,3> cases = {
+        Case{"r1bq1r1k/p1pnbpp1/1p2p3/6p1/3PB3/5N2/PPPQ1PPP/2KR3R w - - 0 1",
+             {"g4","f5","Bxa8"}},
+        Case{"r3k2r/pppq1ppp/2n2n2/3pp3/3PP3/2N2N2/PPPQ1PPP/R3K2R w KQkq - 0 1",
+             {"O-O","O-O-O"}},
+        Case{"r3k3/1P5P/8/3pP3/8/8/8/4K3 w - d6 0 1",
+             {"exd6","Kd7","bxa8=Q","Kxd6","h8=Q"}}
+    };
+    Board board;
     Scoring s;
-    // make sure starting position has an eval
-    NodeInfo *nodes = new Search::NodeStack;
-    s.evalu8NNUE(board,nodes);
-    unsigned i = 0;
-    // update the board
-    for (const std::string &mv : moves) {
-        Move m = Notation::value(board,board.sideToMove(),Notation::InputFormat::SAN,mv,true);
-        assert(!IsNull(m));
-        nodes[i].ply = i;
-        board.doMove(m,nodes+i);
-        ++i;
+    SearchStack *stack = new SearchStack();
+    NodeInfo *nodes = stack->base();
+    int casenum = 0;
+    for (const Case &c : cases) {
+        ++casenum;
+        if (!BoardIO::readFEN(board, c.fen)) {
+            std::cerr << "warning: testNNUE: error in FEN, case " << casenum << std::endl;
+            ++errs;
+            continue;
+        }
+        // make sure starting position has an eval
+        s.evalu8NNUE(board,nodes);
+        unsigned i = 0;
+        // update the board
+        for (const std::string &mv : c.moves) {
+            Move m = Notation::value(board,board.sideToMove(),Notation::InputFormat::SAN,mv,true);
+            assert(!IsNull(m));
+            nodes[i].ply = i;
+            board.doMove(m,nodes+i);
+            ++i;
+        }
+        // perform incremental eval
+        score_t endScore = s.evalu8NNUE(board,nodes+i);
+        // compare w. non-incremental
+        if (endScore != s.evalu8NNUE(board)) {
+            std::cerr << "error in testNNUE - test 1, case " << casenum << std::endl;
+            ++errs;
+        }
+    }
+    if (!BoardIO::readFEN(board, cases[0].fen)) {
+        ++errs;
+    }
+    else {
+        // test after null move
+        s.evalu8NNUE(board,nodes);
+        board.doNull(nodes);
+        score_t endScore = s.evalu8NNUE(board,nodes+1);
+        if (endScore != s.evalu8NNUE(board)) {
+            std::cerr << "error in testNNUE - test 2" << std::endl;
+            ++errs;
+        }
     }
-    // perform incremental eval
-    score_t endScore = s.evalu8NNUE(board,nodes+i);
-    // compare w. non-incremental
-    errs += endScore != s.evalu8NNUE(board);
-    if (errs) std::cout << "error in testNNUE - test 1" << std::endl;
-    board = start;
-    // test after null move
-    board.doNull(nodes);
-    endScore = s.evalu8NNUE(board,nodes+1);
-    errs += endScore != s.evalu8NNUE(board);
-    if (errs) std::cerr << "error in testNNUE - test 2" << std::endl;
-    delete [] nodes;
+    delete stack;
     return errs;
 }
 #endif
@@ -1664,9 +2150,17 @@ int doUnit() {
    errs += testEPD();
    errs += testHash();
    errs += testRep();
+   errs += testSharedHistory();
+   errs += testRepFilter();
+   errs += testHashCodes();
+   errs += testHashFile();
    errs += testMoveGen();
    errs += testPerft();
+   errs += testLegalMoves();
+   errs += testAttackCache();
+   errs += testParallelPerft();
    errs += testSearch();
+   errs += testThreadResize();
    errs += testOptions();
 #ifdef NNUE
    errs += testNNUE();
@@ -92,6 +92,7 @@ static struct SelfPlayOptions {
     unsigned cores = 1;
     unsigned posCount = 10000000;
     unsigned depthLimit = 6;
+    uint64_t nodeLimit = 0; // if non-zero, search fixed nodes, not depth
     bool adjudicateDraw = true;
     unsigned outputPlyFrequency = 1; // output every nth move
     unsigned drawAdjudicationMoves = 5;
@@ -343,31 +344,16 @@ static Move pick(const Move *moves, unsigned count, ThreadData &td) {
     return moves[select];
 }
 
-class Monitor {
-  public:
-    Monitor(uint64_t limit) : nodeTarget(limit) {}
-    virtual ~Monitor() = default;
-    int nodeMonitor(SearchController *, const Statistics &stats) {
-        return (stats.completedDepth > 0 && stats.num_nodes >= nodeTarget);
-    }
-
-  private:
-    uint64_t nodeTarget;
-};
-
 // Somewhat randomize moves by doing a fixed-node instead of fixed-depth search.
 static Move semiRandomMove(const Board &board, Statistics &stats,
                            ThreadData &td, uint64_t nodeTarget) {
-    Monitor monitor(nodeTarget);
-    auto oldMonitor = td.searcher->registerMonitorFunction(
-        std::bind(&Monitor::nodeMonitor, &monitor, _1, _2));
-    Move m = td.searcher->findBestMove(board, FixedDepth, Constants::INFINITE_TIME,
+    td.searcher->setNodeLimit(nodeTarget);
+    Move m = td.searcher->findBestMove(board, FixedNodes, Constants::INFINITE_TIME,
                                        0, // extra time
-                                       sp_options.depthLimit + 2,
+                                       Constants::MaxPly,
                                        false, // background
                                        false, // uci
                                        stats, TalkLevel::Silent);
-    td.searcher->registerMonitorFunction(oldMonitor);
     assert(!(stats.state == NormalState && IsNull(m)));
     return m;
 }
@@ -439,7 +425,7 @@ static void selfplay(ThreadData &td) {
                     // adjudication counter
                     zero_score_count = 0;
                 } else if (sp_options.semiRandomize && !skipRandom &&
-                           prevNodes && prevDepth >= sp_options.depthLimit &&
+                           prevNodes && (sp_options.nodeLimit || prevDepth >= sp_options.depthLimit) &&
                            rand2_dist(td.engine) ==
                                sp_options.semiRandomizeInterval) {
                     // Base the target node count on the node count for the
@@ -454,9 +440,12 @@ static void selfplay(ThreadData &td) {
                     else
                         zero_score_count = 0;
                 } else {
-                    m = searcher->findBestMove(board, FixedDepth, Constants::INFINITE_TIME,
+                    searcher->setNodeLimit(sp_options.nodeLimit);
+                    m = searcher->findBestMove(board,
+                                               sp_options.nodeLimit ? FixedNodes : FixedDepth,
+                                               Constants::INFINITE_TIME,
                                                0, // extra time
-                                               sp_options.depthLimit,
+                                               sp_options.nodeLimit ? Constants::MaxPly : sp_options.depthLimit,
                                                false, // background
                                                false, // uci
                                                stats, TalkLevel::Silent);
@@ -585,7 +574,7 @@ static void threadp(ThreadData *td) {
 
 static void usage() {
     std::cerr << "Usage:" << std::endl;
-    std::cerr << "selfplay [-a (append)] [-d depth] [-v (verbose)] [-c cores] [-n positions] [-o output file]"  << std::endl;
+    std::cerr << "selfplay [-a (append)] [-d depth] [-N nodes] [-v (verbose)] [-c cores] [-n positions] [-o output file]"  << std::endl;
     std::cerr << "         [-m output every m positions] [-f output format (bin or epd)] [-g filename (save games)]" \
               << std::endl;
 }
@@ -687,6 +676,17 @@ int CDECL main(int argc, char **argv) {
                 std::cerr << "error in depth limit after -d" << std::endl;
                 return -1;
             }
+        } else if (strcmp(argv[arg], "-N") == 0) {
+            if (arg + 1 >= argc) {
+                std::cerr << "expected number after -N" << std::endl;
+                return -1;
+            }
+            std::stringstream s(argv[++arg]);
+            s >> sp_options.nodeLimit;
+            if (s.bad() || s.fail()) {
+                std::cerr << "error in node limit after -N" << std::endl;
+                return -1;
+            }
         } else if (strcmp(argv[arg], "-f") == 0) {
             if (arg + 1 >= argc) {
                 std::cerr << "expected bin or epd after -f" << std::endl;